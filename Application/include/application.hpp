@@ -36,10 +36,16 @@ class Application
         std::string *input;
     };
 
+    // Stores the file where the program is written translated to C++ (nullptr runs it).
+    std::string *cpp_output = nullptr;
+
     // Opens the file and returns it's contents.
     // Used when the application type requires it.
     std::string open_file();
 
+    // Returns the size stored in an environment variable (0 if it's not set).
+    uint64_t environment_size(const char *name);
+
     // Run the application in prompt mode.
     void prompt();
 
@@ -9,10 +9,13 @@
 #include "../include/application.hpp"
 #include <iostream>
 #include <fstream>
+#include <stdlib.h>
 
 void Application::prompt()
 {
     std::string input;
+    // Every printed line is shown right away.
+    this->virtual_machine.set_line_buffered(true);
     for (;;) {
         printf(">>> ");
         std::getline(std::cin, input);
@@ -44,20 +47,83 @@ std::string Application::open_file()
     return std::string((std::istreambuf_iterator<char>(file_stream)), (std::istreambuf_iterator<char>()));
 }
 
+uint64_t Application::environment_size(const char *name)
+{
+    auto value = getenv(name);
+    if (!value) return 0;
+
+    char *end;
+    auto size = strtoull(value, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': { size <<= 10; break; }
+        case 'm': case 'M': { size <<= 20; break; }
+        case 'g': case 'G': { size <<= 30; break; }
+        default: { break; }
+    }
+
+    return size;
+}
+
 Application::Application(int argc, char *argv[])
 {
-    switch (argc) {
-        case 1: { this->application_type = APPLICATION_PROMPT; break; }
-        case 2: { this->application_type = APPLICATION_FILE; this->file_name = new std::string(argv[1]); break; }
-        default: { fprintf(stderr, "Invalid usage. Try: nuua <path_to_file>\n"); exit(64); } // Exit status for incorrect command usage.
+    this->application_type = APPLICATION_PROMPT;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--jit") this->virtual_machine.set_jit(true);
+        else if (argument == "--trace") this->virtual_machine.set_tracing(true);
+        else if (argument == "--osr") this->virtual_machine.set_osr(true);
+        else if (argument == "--tiered") this->virtual_machine.set_tiering(true);
+        else if (argument == "--profile-ops") this->virtual_machine.set_profiling(true, "");
+        else if (argument.rfind("--profile-ops=", 0) == 0) this->virtual_machine.set_profiling(true, argument.substr(14));
+        else if (argument == "--stats") this->virtual_machine.set_statistics(true, "");
+        else if (argument.rfind("--stats=", 0) == 0) this->virtual_machine.set_statistics(true, argument.substr(8));
+        else if (argument == "--runtime-stats") this->virtual_machine.set_runtime_statistics(true);
+        else if (argument == "--profile-calls") this->virtual_machine.set_call_profiling(true);
+        else if (argument == "--profile-lines") this->virtual_machine.set_sampling("nuua.folded");
+        else if (argument.rfind("--profile-lines=", 0) == 0) this->virtual_machine.set_sampling(argument.substr(16));
+        else if (argument == "--heap-snapshot") this->virtual_machine.set_heap_snapshot("nuua.heap");
+        else if (argument.rfind("--heap-snapshot=", 0) == 0) this->virtual_machine.set_heap_snapshot(argument.substr(16));
+        else if (argument == "--heap-diff" && i + 2 < argc) {
+            // Two snapshots are compared without running anything.
+            if (!HeapSnapshot::diff(argv[i + 1], argv[i + 2])) {
+                fprintf(stderr, "Unable to read the heap snapshots '%s' and '%s'\n", argv[i + 1], argv[i + 2]);
+                exit(EXIT_FAILURE);
+            }
+            exit(EXIT_SUCCESS);
+        }
+        else if (argument == "--emit-cpp" && i + 1 < argc && !this->cpp_output) this->cpp_output = new std::string(argv[++i]);
+        else if (argument[0] != '-' && this->application_type == APPLICATION_PROMPT) {
+            this->application_type = APPLICATION_FILE;
+            this->file_name = new std::string(argument);
+        } else {
+            fprintf(stderr, "Invalid usage. Try: nuua [--stats[=<json_file>]] [--runtime-stats] [--jit] [--trace] [--osr] [--tiered] [--profile-ops[=<json_file>]] [--profile-calls] [--profile-lines[=<folded_file>]] [--heap-snapshot[=<snapshot_file>]] [--heap-diff <before> <after>] [--emit-cpp <output_file>] <path_to_file>\n");
+            exit(64); // Exit status for incorrect command usage.
+        }
+    }
+
+    // Only files can be translated to C++.
+    if (this->cpp_output && this->application_type != APPLICATION_FILE) {
+        fprintf(stderr, "Invalid usage. Try: nuua --emit-cpp <output_file> <path_to_file>\n");
+        fprintf(stderr, "The int, float and bool variables of the main code become native C++ locals, the variables of the functions stay boxed in their frames.\n");
+        exit(64);
     }
+
+    // The heap limits can be configured with NUUA_NURSERY_SIZE and NUUA_HEAP_LIMIT (in bytes, with an optional K, M or G suffix).
+    this->virtual_machine.set_heap_limits(this->environment_size("NUUA_NURSERY_SIZE"), this->environment_size("NUUA_HEAP_LIMIT"));
+
+    // The number of threads that mark the heap can be set with NUUA_GC_THREADS.
+    this->virtual_machine.set_mark_threads(this->environment_size("NUUA_GC_THREADS"));
 }
 
 void Application::start()
 {
     switch (this->application_type) {
         case APPLICATION_PROMPT: { this->prompt(); break; }
-        case APPLICATION_FILE: { this->string(this->open_file()); break; }
+        case APPLICATION_FILE: {
+            if (this->cpp_output) this->virtual_machine.emit_cpp(this->open_file().c_str(), *this->file_name, *this->cpp_output);
+            else this->string(this->open_file());
+            break;
+        }
         case APPLICATION_STRING: { this->string(""); break; }
     }
 }
@@ -0,0 +1,70 @@
+/**
+ * |-----------------------------|
+ * | Nuua Microbenchmark Harness |
+ * |-----------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef MICRO_HPP
+#define MICRO_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Default repetitions discarded before measuring and measured.
+#define MICRO_WARMUP 3
+#define MICRO_REPETITIONS 15
+
+// Minimum seconds a repetition lasts (the iterations are doubled until it does).
+#define MICRO_TARGET 0.01
+
+// Keeps the compiler from removing the computation of a value that is never used.
+template <typename T>
+inline void micro_keep(T &value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+// Stores the measures of a microbenchmark (the times are in nanoseconds per iteration).
+class MicroResult
+{
+    public:
+        // The microbenchmark name.
+        std::string name;
+
+        // The iterations of every repetition and the bytes processed by an iteration (0 if it's not a throughput).
+        uint64_t iterations = 0, bytes = 0;
+
+        // The statistics of the repetitions.
+        double mean = 0, median = 0, deviation = 0, minimum = 0;
+};
+
+// Runs the microbenchmarks: every one is calibrated to last MICRO_TARGET seconds per
+// repetition, warmed up and measured a number of repetitions.
+class MicroHarness
+{
+    // Stores the results in the order they run.
+    std::vector<MicroResult> results;
+
+    // Returns the seconds the body takes to run the given iterations.
+    static double time(const std::function<void(uint64_t)> &body, uint64_t iterations);
+
+    public:
+        // Stores the repetitions done before measuring and the measured ones.
+        uint64_t warmup = MICRO_WARMUP, repetitions = MICRO_REPETITIONS;
+
+        // Only the microbenchmarks whose name contains it are run.
+        std::string filter;
+
+        // Measures a body that runs the operation the given iterations. The bytes
+        // an iteration processes (if any) are used to report the throughput.
+        void run(const std::string &name, const std::function<void(uint64_t)> &body, uint64_t bytes = 0);
+
+        // Prints the results.
+        void report();
+};
+
+#endif
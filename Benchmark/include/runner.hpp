@@ -0,0 +1,66 @@
+/**
+ * |-----------------------|
+ * | Nuua Benchmark Runner |
+ * |-----------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef RUNNER_HPP
+#define RUNNER_HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+// Default runs of every benchmark (a warmup run is done before them).
+#define RUNNER_RUNS 5
+
+// Default percentage a median can grow over the baseline before it's a regression.
+#define RUNNER_THRESHOLD 10.0
+
+// Stores the measures of a benchmark.
+class BenchmarkResult
+{
+    public:
+        // The median and the 95th percentile of the wall time (in seconds).
+        double median = 0, p95 = 0;
+
+        // The highest peak resident set size of the runs (in kilobytes).
+        uint64_t rss = 0;
+
+        // Determines if a run failed.
+        bool failed = false;
+};
+
+// Runs every benchmark program a number of times with the nuua executable and
+// compares the medians with a baseline written by a previous run.
+class BenchmarkRunner
+{
+    // The nuua executable and the arguments given to it before the program.
+    std::string executable;
+    std::vector<std::string> flags;
+
+    // Runs a program once. Returns false if it failed.
+    bool run(const std::string &program, double *time, uint64_t *rss);
+
+    public:
+        // Stores the number of runs and the regression threshold (in percent).
+        uint64_t runs = RUNNER_RUNS;
+        double threshold = RUNNER_THRESHOLD;
+
+        BenchmarkRunner(const std::string &executable, const std::vector<std::string> &flags)
+            : executable(executable), flags(flags) {};
+
+        // Measures a program.
+        BenchmarkResult measure(const std::string &program);
+
+        // Reads a baseline. Returns false if the file can't be read.
+        static bool read_baseline(const std::string &path, std::unordered_map<std::string, BenchmarkResult> *baseline);
+
+        // Writes the results as a baseline. Returns false if the file can't be written.
+        static bool write_baseline(const std::string &path, const std::vector<std::pair<std::string, BenchmarkResult>> &results);
+};
+
+#endif
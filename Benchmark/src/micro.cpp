@@ -0,0 +1,171 @@
+/**
+ * |-----------------------------|
+ * | Nuua Microbenchmark Harness |
+ * |-----------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/micro.hpp"
+#include "../../Lexer/include/lexer.hpp"
+#include "../../Parser/include/parser.hpp"
+#include "../../Compiler/include/compiler.hpp"
+#include "../../Virtual-Machine/include/virtual_machine.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+
+double MicroHarness::time(const std::function<void(uint64_t)> &body, uint64_t iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    body(iterations);
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void MicroHarness::run(const std::string &name, const std::function<void(uint64_t)> &body, uint64_t bytes)
+{
+    if (name.find(this->filter) == std::string::npos) return;
+
+    MicroResult result;
+    result.name = name;
+    result.bytes = bytes;
+
+    // The iterations are calibrated so the clock resolution doesn't matter.
+    result.iterations = 1;
+    while (MicroHarness::time(body, result.iterations) < MICRO_TARGET) result.iterations *= 2;
+
+    for (uint64_t i = 0; i < this->warmup; i++) MicroHarness::time(body, result.iterations);
+    std::vector<double> samples;
+    for (uint64_t i = 0; i < this->repetitions; i++) samples.push_back(MicroHarness::time(body, result.iterations) * 1e9 / result.iterations);
+
+    std::sort(samples.begin(), samples.end());
+    for (auto sample : samples) result.mean += sample;
+    result.mean /= samples.size();
+    for (auto sample : samples) result.deviation += (sample - result.mean) * (sample - result.mean);
+    result.deviation = std::sqrt(result.deviation / samples.size());
+    auto size = samples.size();
+    result.median = size % 2 == 1 ? samples[size / 2] : (samples[size / 2 - 1] + samples[size / 2]) / 2;
+    result.minimum = samples.front();
+
+    this->results.push_back(result);
+}
+
+void MicroHarness::report()
+{
+    printf("%-28s %12s %14s %14s %10s %14s %10s\n", "Benchmark", "Iterations", "Mean ns", "Median ns", "Stddev", "Min ns", "MB/s");
+    for (auto &result : this->results) {
+        printf(
+            "%-28s %12llu %14.2f %14.2f %9.1f%% %14.2f", result.name.c_str(), static_cast<unsigned long long>(result.iterations),
+            result.mean, result.median, result.mean > 0 ? 100 * result.deviation / result.mean : 0.0, result.minimum
+        );
+        if (result.bytes > 0) printf(" %10.1f", result.bytes * 1e3 / result.median);
+        printf("\n");
+    }
+}
+
+// Returns a program with the given number of functions, used to measure the front end.
+static std::string front_end_source(uint64_t functions)
+{
+    std::string source;
+    for (uint64_t i = 0; i < functions; i++) {
+        auto index = std::to_string(i);
+        source +=
+            "f" + index + ": fun = (a: int, b: float): float {\n"
+            "    c: float = a * b + " + index + "\n"
+            "    d: list = [a, b, c]\n"
+            "    while (a < 10) {\n"
+            "        c = c + a / 2\n"
+            "        a = a + 1\n"
+            "    }\n"
+            "    return c - d[0]\n"
+            "}\n"
+            "r" + index + ": float = f" + index + "(3, 1.5)\n";
+    }
+
+    return source;
+}
+
+static void usage()
+{
+    fprintf(stderr, "Invalid usage. Try: micro [--filter <substring>] [--warmup <n>] [--repetitions <n>]\n");
+    exit(64); // Exit status for incorrect command usage.
+}
+
+int main(int argc, char *argv[])
+{
+    MicroHarness harness;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--filter" && i + 1 < argc) harness.filter = argv[++i];
+        else if (argument == "--warmup" && i + 1 < argc) harness.warmup = strtoull(argv[++i], nullptr, 10);
+        else if (argument == "--repetitions" && i + 1 < argc) harness.repetitions = strtoull(argv[++i], nullptr, 10);
+        else usage();
+    }
+    if (harness.repetitions == 0) usage();
+
+    // Value operations (the operands are reloaded every iteration so they are not folded).
+    Value integer(static_cast<int64_t>(7)), other_integer(static_cast<int64_t>(3)), real(2.5), other_real(0.5);
+    harness.run("value/add_int", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = integer + other_integer; micro_keep(result); } });
+    harness.run("value/add_float", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = real + other_real; micro_keep(result); } });
+    harness.run("value/mul_mixed", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = integer * real; micro_keep(result); } });
+    harness.run("value/lt_int", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = integer < other_integer; micro_keep(result); } });
+    harness.run("value/div", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = integer / other_integer; micro_keep(result); } });
+    harness.run("value/cast_int_float", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = integer.cast(Type(VALUE_FLOAT)); micro_keep(result); } });
+    harness.run("value/cast_float_int", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = real.cast(Type(VALUE_INT)); micro_keep(result); } });
+    harness.run("value/to_string_int", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = integer.to_string(); micro_keep(result); } });
+
+    // Type comparisons.
+    Type int_type(VALUE_INT), float_type(VALUE_FLOAT), other_int_type(VALUE_INT);
+    Type int_list(VALUE_LIST, &int_type), other_int_list(VALUE_LIST, &other_int_type), float_list(VALUE_LIST, &float_type);
+    harness.run("type/same_as_simple", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = int_type.same_as(&other_int_type); micro_keep(result); } });
+    harness.run("type/same_as_list", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = int_list.same_as(&other_int_list); micro_keep(result); } });
+    harness.run("type/same_as_list_mismatch", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto result = int_list.same_as(&float_list); micro_keep(result); } });
+
+    // The front end, measured over the same program. The AST and the constants live in a
+    // region released after every iteration.
+    auto source = front_end_source(100);
+    harness.run("lexer/scan", [&](uint64_t n) { for (uint64_t i = 0; i < n; i++) { auto tokens = Lexer().scan(source.c_str()); micro_keep(tokens); } }, source.size());
+    harness.run("parser/parse", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            Region region;
+            RegionScope scope(&region);
+            auto ast = Parser().parse(source.c_str());
+            micro_keep(ast);
+        }
+    }, source.size());
+    harness.run("compiler/compile", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            Region region;
+            RegionScope scope(&region);
+            auto program = Compiler().compile(source.c_str());
+            micro_keep(program);
+        }
+    }, source.size());
+
+    // The dispatch loop, measured per loop iteration of the programs (their compilation is included
+    // but the iterations are calibrated until it's negligible). Every run uses a new virtual machine
+    // since the globals of a program survive a reset.
+    auto interpret = [](const std::string &program) {
+        auto vm = new VirtualMachine;
+        vm->interpret(program.c_str());
+        delete vm;
+    };
+    harness.run("dispatch/while_loop", [&](uint64_t n) {
+        auto program = "i: int = 0\nwhile (i < " + std::to_string(n) + ") {\n    i = i + 1\n}\n";
+        interpret(program);
+    });
+    harness.run("dispatch/call", [&](uint64_t n) {
+        auto program = "f: fun = (a: int): int {\n    return a + 1\n}\ni: int = 0\nwhile (i < " + std::to_string(n) + ") {\n    i = f(i)\n}\n";
+        interpret(program);
+    });
+    harness.run("dispatch/list_access", [&](uint64_t n) {
+        auto program = "l: list = [1, 2, 3]\ni: int = 0\ns: int = 0\nwhile (i < " + std::to_string(n) + ") {\n    s = s + l[1]\n    i = i + 1\n}\n";
+        interpret(program);
+    });
+    harness.report();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+/**
+ * |-----------------------|
+ * | Nuua Benchmark Runner |
+ * |-----------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/runner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+bool BenchmarkRunner::run(const std::string &program, double *time, uint64_t *rss)
+{
+    std::vector<char *> arguments = { const_cast<char *>(this->executable.c_str()) };
+    for (auto &flag : this->flags) arguments.push_back(const_cast<char *>(flag.c_str()));
+    arguments.push_back(const_cast<char *>(program.c_str()));
+    arguments.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    auto pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        // The output of the program is not measured.
+        auto null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(arguments[0], arguments.data());
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) return false;
+    *time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    #if defined(__APPLE__)
+        *rss = usage.ru_maxrss / 1024;
+    #else
+        *rss = usage.ru_maxrss;
+    #endif
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+BenchmarkResult BenchmarkRunner::measure(const std::string &program)
+{
+    BenchmarkResult result;
+    std::vector<double> times;
+    double time;
+    uint64_t rss;
+
+    // The warmup run loads the executable and the program in the caches.
+    if (!this->run(program, &time, &rss)) {
+        result.failed = true;
+        return result;
+    }
+    for (uint64_t i = 0; i < this->runs; i++) {
+        if (!this->run(program, &time, &rss)) {
+            result.failed = true;
+            return result;
+        }
+        times.push_back(time);
+        result.rss = std::max(result.rss, rss);
+    }
+
+    std::sort(times.begin(), times.end());
+    auto size = times.size();
+    result.median = size % 2 == 1 ? times[size / 2] : (times[size / 2 - 1] + times[size / 2]) / 2;
+    result.p95 = times[static_cast<uint64_t>(std::ceil(size * 0.95)) - 1];
+
+    return result;
+}
+
+bool BenchmarkRunner::read_baseline(const std::string &path, std::unordered_map<std::string, BenchmarkResult> *baseline)
+{
+    auto file_stream = std::ifstream(path);
+    if (!file_stream.is_open()) return false;
+
+    // Every benchmark is in it's own line, as written by write_baseline.
+    std::string line;
+    while (std::getline(file_stream, line)) {
+        char name[256];
+        BenchmarkResult result;
+        unsigned long long rss;
+        if (sscanf(line.c_str(), " \"%255[^\"]\": { \"median\": %lf, \"p95\": %lf, \"rss\": %llu }", name, &result.median, &result.p95, &rss) != 4) continue;
+        result.rss = rss;
+        (*baseline)[name] = result;
+    }
+
+    return true;
+}
+
+bool BenchmarkRunner::write_baseline(const std::string &path, const std::vector<std::pair<std::string, BenchmarkResult>> &results)
+{
+    auto file_stream = std::ofstream(path);
+    if (!file_stream.is_open()) return false;
+
+    file_stream << "{\n  \"benchmarks\": {";
+    bool first = true;
+    for (auto &result : results) {
+        if (result.second.failed) continue;
+        file_stream << (first ? "\n" : ",\n") << "    \"" << result.first << "\": { \"median\": " << result.second.median
+            << ", \"p95\": " << result.second.p95 << ", \"rss\": " << result.second.rss << " }";
+        first = false;
+    }
+    file_stream << "\n  }\n}\n";
+
+    return true;
+}
+
+// Returns the name of a benchmark (the file name of the program).
+static std::string benchmark_name(const std::string &program)
+{
+    auto slash = program.find_last_of('/');
+    return slash == std::string::npos ? program : program.substr(slash + 1);
+}
+
+static void usage()
+{
+    fprintf(
+        stderr, "Invalid usage. Try: bench [--runs <n>] [--threshold <percent>] [--baseline <json_file>] [--save <json_file>] "
+        "[--flag <nuua_argument>]... <nuua_executable> <programs>...\n"
+    );
+    exit(64); // Exit status for incorrect command usage.
+}
+
+int main(int argc, char *argv[])
+{
+    std::string baseline_file, save_file;
+    std::vector<std::string> flags, positional;
+    uint64_t runs = RUNNER_RUNS;
+    double threshold = RUNNER_THRESHOLD;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--runs" && i + 1 < argc) runs = strtoull(argv[++i], nullptr, 10);
+        else if (argument == "--threshold" && i + 1 < argc) threshold = strtod(argv[++i], nullptr);
+        else if (argument == "--baseline" && i + 1 < argc) baseline_file = argv[++i];
+        else if (argument == "--save" && i + 1 < argc) save_file = argv[++i];
+        else if (argument == "--flag" && i + 1 < argc) flags.push_back(argv[++i]);
+        else if (argument[0] != '-') positional.push_back(argument);
+        else usage();
+    }
+    if (positional.size() < 2 || runs == 0) usage();
+
+    std::unordered_map<std::string, BenchmarkResult> baseline;
+    if (!baseline_file.empty() && !BenchmarkRunner::read_baseline(baseline_file, &baseline)) {
+        fprintf(stderr, "Unable to read the baseline '%s', the results are not compared\n", baseline_file.c_str());
+    }
+
+    BenchmarkRunner runner(positional[0], flags);
+    runner.runs = runs;
+    runner.threshold = threshold;
+
+    uint64_t regressions = 0, failures = 0;
+    std::vector<std::pair<std::string, BenchmarkResult>> results;
+    printf("%-20s %12s %12s %14s %12s %9s\n", "Benchmark", "Median ms", "P95 ms", "Peak RSS KB", "Baseline ms", "Change");
+    for (uint64_t i = 1; i < positional.size(); i++) {
+        auto name = benchmark_name(positional[i]);
+        auto result = runner.measure(positional[i]);
+        results.push_back({ name, result });
+        if (result.failed) {
+            printf("%-20s %12s\n", name.c_str(), "FAILED");
+            failures++;
+            continue;
+        }
+
+        printf("%-20s %12.2f %12.2f %14llu", name.c_str(), result.median * 1000, result.p95 * 1000, static_cast<unsigned long long>(result.rss));
+        auto previous = baseline.find(name);
+        if (previous != baseline.end() && previous->second.median > 0) {
+            auto change = 100 * (result.median - previous->second.median) / previous->second.median;
+            auto regression = change > threshold;
+            if (regression) regressions++;
+            printf(" %12.2f %+8.1f%%%s", previous->second.median * 1000, change, regression ? "  REGRESSION" : "");
+        }
+        printf("\n");
+    }
+
+    if (!save_file.empty()) {
+        if (BenchmarkRunner::write_baseline(save_file, results)) printf("Baseline written to %s\n", save_file.c_str());
+        else fprintf(stderr, "Unable to write the baseline '%s'\n", save_file.c_str());
+    }
+
+    if (regressions > 0) printf("%llu regressions over %.1f%%\n", static_cast<unsigned long long>(regressions), threshold);
+
+    return regressions > 0 || failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
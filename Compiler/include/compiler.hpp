@@ -21,6 +21,21 @@ class Compiler
     // Stores the currently used memory where compilation result is going.
     MemoryType current_memory = PROGRAM_MEMORY;
 
+    // Determines if the function currently beeing compiled contains a yield.
+    bool yields = false;
+
+    // Stores the name the next compiled function is bound to (empty if it's anonymous).
+    std::string function_name;
+
+    // Stores the variable the next compiled function is declared with (empty if it's not a declaration).
+    std::string function_binding;
+
+    // Stores the declared classes (their layout is known at compile time).
+    std::unordered_map<std::string, ValueClass *> classes;
+
+    // Stores the class of the variables declared with a class type in the current function.
+    std::unordered_map<std::string, ValueClass *> object_types;
+
     // Defines a basic compilation for a Statement.
     void compile(Statement *rule);
 
@@ -42,6 +57,18 @@ class Compiler
     // Modifies a constant given it's index in the current memory to the given value.
     void modify_constant(uint64_t index, Value value);
 
+    // Adds empty words to the code to be used as an inline cache.
+    void add_inline_cache(uint8_t words);
+
+    // Adds a property load or store. Uses the slot offset if the object class is known.
+    void add_property(Expression *object, std::string name, bool store);
+
+    // Returns the type given it's name, including the declared classes.
+    Type resolve_type(std::string name);
+
+    // Returns the class of an expression if it's known at compile time.
+    ValueClass *static_class(Expression *rule);
+
     // Returns the currently used memory.
     Memory *get_current_memory();
 
@@ -52,6 +79,12 @@ class Compiler
         // Stores the program itself where everything is beeing compiled to.
         Program program;
 
+        // Stores the tokens scanned and the AST nodes parsed.
+        uint64_t tokens = 0, nodes = 0;
+
+        // Stores the time (in seconds) spent in every phase of the compilation.
+        double scanning_time = 0, parsing_time = 0, optimizing_time = 0, compiling_time = 0;
+
         // Compile an input source and returns the result program.
         Program compile(const char *source);
 };
@@ -0,0 +1,324 @@
+/**
+ * |------------------------|
+ * | Nuua Garbage Collector |
+ * |------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef GC_HPP
+#define GC_HPP
+
+#include "program.hpp"
+#include "pool.hpp"
+#include <vector>
+#include <initializer_list>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+
+// Default bytes allocated in the nursery before a minor collection.
+#define GC_NURSERY_SIZE (1 << 20)
+
+// Default old generation bytes that start the first major collection.
+#define GC_OLD_INITIAL (4 << 20)
+
+// The next major collection starts when the old generation grows this many times the live bytes.
+#define GC_OLD_GROWTH 2
+
+// Minimum number of objects marked on every incremental marking step.
+#define GC_MARK_SLICE 256
+
+// Objects marked on every incremental step for each object promoted since the last one,
+// it keeps the marking ahead of the promotions so it always finishes.
+#define GC_MARK_RATE 4
+
+// Minimum number of gray objects to mark them in parallel.
+#define GC_PARALLEL_THRESHOLD 1024
+
+// Maximum number of threads used to mark.
+#define GC_MAX_MARK_THREADS 8
+
+// Object header flags used by the collector.
+#define GC_TRACKED 1
+#define GC_MARKED 2
+#define GC_REMEMBERED 4
+
+// Defines the collection that is traversing the objects (a snapshot only finds them).
+typedef enum : uint8_t {
+    GC_MINOR, GC_MAJOR, GC_SNAPSHOT
+} CollectionKind;
+
+// Stores the values held by native code (outside the stack and the frames).
+// The collector updates them in place when it moves their objects.
+class HeapHandles
+{
+    public:
+        // The single values and the lists of values.
+        std::vector<Value *> values;
+        std::vector<std::vector<Value> *> lists;
+};
+
+// Keeps the values of native code visible to the collector while it's in scope.
+// Nested executions may collect and move the nursery objects, so the objects
+// must be read again from the values after them.
+class RootScope
+{
+    // Stores the handles and their sizes before the scope.
+    HeapHandles *handles;
+    size_t values, lists;
+
+    public:
+        RootScope(HeapHandles *handles, std::initializer_list<Value *> values, std::initializer_list<std::vector<Value> *> lists = {})
+            : handles(handles), values(handles->values.size()), lists(handles->lists.size())
+        {
+            handles->values.insert(handles->values.end(), values);
+            handles->lists.insert(handles->lists.end(), lists);
+        }
+        ~RootScope()
+        {
+            this->handles->values.resize(this->values);
+            this->handles->lists.resize(this->lists);
+        }
+};
+
+// Stores where the values the program can still reach are.
+class HeapRoots
+{
+    public:
+        // The used part of the value stack.
+        Value *stack, *stack_top;
+
+        // The active frames (including the last one).
+        Frame *frames, *frames_top;
+
+        // The memories whose constants are used by the program.
+        std::vector<Memory *> memories;
+
+        // The values held by native code (if any).
+        HeapHandles *handles = nullptr;
+};
+
+// The mark stack of a marking thread. The owner pushes and pops at
+// the back and the other threads steal from the front.
+class MarkDeque
+{
+    // Protects the objects.
+    std::mutex lock;
+
+    // Stores the gray objects.
+    std::deque<void *> objects;
+
+    public:
+        // Pushes a gray object.
+        void push(void *object);
+
+        // Pops the last pushed object. Returns false if it's empty.
+        bool pop(void *&object);
+
+        // Steals the oldest object. Returns false if it's empty.
+        bool steal(void *&object);
+
+        // Returns true if there are no objects.
+        bool empty();
+};
+
+// Stores the collector statistics.
+class HeapStatistics
+{
+    public:
+        // Number of collections, incremental marking steps and parallel markings.
+        uint64_t minor_collections = 0, major_collections = 0, mark_steps = 0, parallel_marks = 0;
+
+        // Bytes allocated in the nursery, promoted to the old generation and freed from it.
+        uint64_t nursery_bytes = 0, promoted_bytes = 0, freed_bytes = 0;
+
+        // Number of pauses, their total and their maximum duration (in seconds).
+        uint64_t pauses = 0;
+        double pause_total = 0, pause_max = 0;
+};
+
+// The heap is split in two generations. New objects are bump allocated in the
+// nursery (a region) and the survivors of a minor collection are copied to the
+// old generation, that lives in the pools and is never moved. The old generation
+// is collected by an incremental mark and sweep. Mutations of old objects must go
+// through the write barrier so they are found by the next minor collection and
+// rescanned by an ongoing marking.
+class Heap
+{
+    // Stores the old generation objects.
+    std::vector<void *> old;
+
+    // Stores the old objects that may point to the nursery.
+    std::vector<void *> remembered;
+
+    // Stores the marked objects whose references are not marked yet.
+    std::vector<void *> gray;
+
+    // Stores the promoted objects whose references are not promoted yet.
+    std::vector<void *> promoted;
+
+    // Maps the nursery objects to their copy in the old generation.
+    std::unordered_map<void *, void *> forwarded;
+
+    // Stores the objects found by a snapshot and the ones whose references are not visited yet.
+    std::unordered_set<void *> found;
+    std::vector<void *> unvisited;
+
+    // The collection that is traversing the objects.
+    CollectionKind mode = GC_MINOR;
+
+    // Number of objects promoted since the last marking step.
+    uint64_t promoted_objects = 0;
+
+    // Bytes of the buffers owned by the nursery objects (they are not part of the region).
+    uint64_t nursery_payload = 0;
+
+    // Stores the marking threads (the collector thread is the first one, it has no thread here).
+    std::vector<std::thread> workers;
+
+    // Stores the mark stack of every marking thread.
+    std::unique_ptr<MarkDeque[]> deques;
+
+    // Synchronizes the start and the end of a parallel marking.
+    std::mutex workers_lock;
+    std::condition_variable workers_wake, workers_done;
+
+    // Counts the parallel markings started and the workers still running the current one.
+    uint64_t workers_phase = 0, workers_running = 0;
+
+    // Tells the workers to finish.
+    bool workers_stop = false;
+
+    // Number of marking threads without work.
+    std::atomic<uint64_t> idle_markers;
+
+    // Number of objects the marking threads can still mark.
+    std::atomic<int64_t> mark_budget;
+
+    // Visits a reference, promoting it (minor), marking it (major) or finding it (snapshot).
+    template <typename T>
+    void visit(T *&object);
+    void visit(Value &value);
+    void visit(Type *type);
+
+    // Visits the references of an object.
+    void scan(void *object);
+
+    // Returns the copy of a nursery object in the old generation.
+    template <typename T>
+    T *forward(T *object);
+
+    // Marks an old object.
+    void mark(void *object);
+
+    // Visits the roots.
+    void visit_roots(HeapRoots &roots, bool constants);
+
+    // Destroys and releases an old object.
+    void destroy(void *object);
+
+    // Promotes the nursery survivors and releases the nursery.
+    void minor(HeapRoots &roots);
+
+    // Starts marking the old generation.
+    void start_major(HeapRoots &roots);
+
+    // Marks objects until the budget is spent (in parallel if the gray set is wide).
+    // Returns true if no gray objects are left.
+    bool mark_step(uint64_t budget);
+
+    // Marks the gray objects with all the marking threads until the budget
+    // is spent. Returns the budget left.
+    uint64_t parallel_mark(uint64_t budget);
+
+    // Marks the objects of a thread mark stack, stealing from the others when it's empty.
+    void mark_worker(uint64_t index);
+
+    // The loop of a marking thread.
+    void worker_main(uint64_t index);
+
+    // Remarks the roots and sweeps the old generation.
+    void finish_major(HeapRoots &roots);
+
+    public:
+        // The nursery where new objects are allocated.
+        Region nursery;
+
+        // Bytes used by the old generation (with the buffers of the objects) and the bytes that start the next major collection.
+        uint64_t old_bytes = 0, next_major = GC_OLD_INITIAL;
+
+        // Bytes allocated in the nursery before a minor collection.
+        uint64_t nursery_size = GC_NURSERY_SIZE;
+
+        // Maximum bytes of the old generation after a major collection (0 means no limit).
+        uint64_t heap_limit = 0;
+
+        // Number of threads used to mark.
+        uint64_t mark_threads;
+
+        // Determines if a major marking is in progress.
+        bool marking = false;
+
+        // Stores the collector statistics.
+        HeapStatistics statistics;
+
+        // Adds an object allocated outside the nursery to the old generation.
+        void track(void *object);
+
+        // Must be called after a reference is stored in an object.
+        void write_barrier(void *object);
+
+        // Charges the buffers an object owns to it's generation. It must be called
+        // after they may have grown (the allocator calls it for new objects).
+        void charge(void *object);
+
+        // Returns the bytes allocated in the nursery since the last minor collection (with the buffers of the objects).
+        uint64_t nursery_used() { return this->nursery.bytes + this->nursery_payload; }
+
+        // Returns true if the collector has work to do at the next safepoint.
+        bool pending() { return this->nursery_used() >= this->nursery_size || this->marking || this->old_bytes >= this->next_major; }
+
+        // Does the pending work: a minor collection if the nursery is full
+        // and a bounded step of the old generation collection.
+        void collect(HeapRoots &roots);
+
+        // Collects both generations without interruption.
+        void collect_full(HeapRoots &roots);
+
+        // Returns the objects reachable from the roots (in both generations) without moving or marking them.
+        std::vector<void *> reachable(HeapRoots &roots);
+
+        // Prints the collector statistics given the running time (in seconds).
+        void print_statistics(double run_time);
+
+        Heap();
+
+        // Stops the marking threads.
+        ~Heap();
+};
+
+// Returns the bytes a string keeps outside the object (none if it's short enough to be stored inside).
+uint64_t string_payload(const std::string &string);
+
+// Stores the heap of the current thread (nullptr if there's no collector).
+extern thread_local Heap *current_heap;
+
+// Sets the current heap while it's in scope.
+class HeapScope
+{
+    // Stores the heap that was used before.
+    Heap *previous;
+
+    public:
+        HeapScope(Heap *heap)
+            : previous(current_heap) { current_heap = heap; }
+        ~HeapScope() { current_heap = previous; }
+};
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * |--------------------|
+ * | Nuua Output Buffer |
+ * |--------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include "value.hpp"
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the output buffer, it's written when it's full.
+#define OUTPUT_BUFFER_SIZE 65536
+
+// Space kept free to format a number (a float printed with %f may have more than 300 digits).
+#define OUTPUT_NUMBER_SIZE 512
+
+// Buffers what a program prints to the standard output. The values are formatted
+// straight into the buffer and it's handed to the standard output when it's full,
+// when it's flushed, before the logger writes a message and when the program exits.
+// In line buffered mode (used interactively) it's also flushed after every line.
+class Output
+{
+    // Stores the bytes that are not written yet.
+    char buffer[OUTPUT_BUFFER_SIZE];
+    size_t used = 0;
+
+    // Makes sure the buffer has space for the given bytes.
+    void reserve(size_t size) { if (this->used + size > OUTPUT_BUFFER_SIZE) this->drain(); }
+
+    public:
+        // Determines if the output is flushed after every line.
+        bool line_buffered;
+
+        // Writes the given bytes.
+        void write(const char *data, size_t size);
+        void write(const std::string &string) { this->write(string.data(), string.size()); }
+        void write(char character) { this->reserve(1); this->buffer[this->used++] = character; }
+
+        // Writes a number.
+        void write(int64_t number);
+        void write(double number);
+
+        // Writes a value as it's converted to a string (quoted if it's a string inside another value).
+        void write(const Value &value, bool quoted = false);
+
+        // Writes a value followed by a new line.
+        void write_line(const Value &value);
+
+        // Hands the buffered bytes to the standard output.
+        void drain();
+
+        // Writes the buffered bytes to the standard output and flushes it.
+        void flush();
+
+        // Drains every output (called before the logger writes and when the program exits).
+        static void drain_all();
+
+        // The output is line buffered if the standard output is a terminal.
+        Output();
+        ~Output();
+};
+
+#endif
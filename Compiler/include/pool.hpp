@@ -0,0 +1,239 @@
+/**
+ * |-------------------|
+ * | Nuua Object Pools |
+ * |-------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+// Size of the blocks the pools request to the system.
+#define POOL_BLOCK_SIZE 65536
+
+// Granularity (in bytes) of the size classes.
+#define POOL_SIZE_STEP 16
+
+// Number of size classes. Bigger objects use the system allocator.
+#define POOL_SIZE_CLASSES 32
+
+// Size class used by the objects allocated in a region.
+#define POOL_REGION (POOL_SIZE_CLASSES + 1)
+
+// Size of the chunks a region requests to the system.
+#define REGION_CHUNK_SIZE 65536
+
+// Defines the kinds of objects allocated by the virtual machine.
+typedef enum : uint8_t {
+    OBJECT_STRING, OBJECT_LIST, OBJECT_DICT, OBJECT_FUNCTION, OBJECT_ITERATOR,
+    OBJECT_CLASS, OBJECT_OBJECT, OBJECT_SLOTS, OBJECT_FRAME
+} ObjectKind;
+
+// Number of object kinds.
+#define OBJECT_KINDS 9
+
+// The header stored right before every allocated object.
+class ObjectHeader
+{
+    public:
+        // The kind of the object.
+        ObjectKind kind;
+
+        // The size class of the object (POOL_SIZE_CLASSES if it's a big object, POOL_REGION if it lives in a region).
+        uint8_t size_class;
+
+        // The garbage collector flags of the object.
+        uint8_t flags;
+
+        // The requested size in bytes.
+        uint32_t size;
+
+        // The program line that allocated the object (0 if it's not known).
+        uint32_t line;
+
+        // The bytes of the buffers the object owns (characters, elements, buckets)
+        // the last time they were charged to the garbage collector.
+        uint32_t payload;
+};
+
+// Stores the allocation statistics of an object kind.
+class PoolStatistics
+{
+    public:
+        // Number of allocations and releases.
+        uint64_t allocations = 0, releases = 0;
+
+        // Currently used bytes and the highest value they got.
+        uint64_t bytes = 0, peak_bytes = 0;
+};
+
+// A pool of fixed size slots. Slots are carved from big blocks
+// and released slots are kept in a free list for reuse.
+class Pool
+{
+    // Stores the first free slot (each free slot points to the next one).
+    void *free_list = nullptr;
+
+    // Stores the unused part of the current block.
+    char *next = nullptr, *end = nullptr;
+
+    public:
+        // The size of every slot.
+        size_t slot_size = 0;
+
+        // The number of blocks requested to the system.
+        uint64_t blocks = 0;
+
+        // Returns a free slot.
+        void *allocate();
+
+        // Gives back a slot to the pool.
+        void release(void *slot);
+};
+
+// A region (arena) allocates by bumping a pointer and releases
+// all it's memory at once. Objects with a destructor register a
+// finalizer that runs when the region is released.
+class Region
+{
+    // Stores the chunks in use and their size.
+    std::vector<std::pair<char *, size_t>> chunks;
+
+    // Stores the released chunks (of REGION_CHUNK_SIZE) kept for reuse.
+    std::vector<char *> spare;
+
+    // Stores the unused part of the current chunk.
+    char *next = nullptr, *end = nullptr;
+
+    // Stores the objects to destroy when the region is released.
+    std::vector<std::pair<void *, void (*)(void *)>> finalizers;
+
+    public:
+        // Stores the allocated bytes since the last release.
+        uint64_t bytes = 0;
+
+        // Stores the number of objects and bytes allocated per kind since the last release.
+        uint64_t kind_objects[OBJECT_KINDS] = { 0 }, kind_bytes[OBJECT_KINDS] = { 0 };
+
+        // Allocates memory in the region.
+        void *allocate(size_t size);
+
+        // Registers the destructor of an object allocated in the region.
+        void finalize(void *object, void (*destructor)(void *));
+
+        // Destroys every object and releases all the memory (the chunks are kept for reuse).
+        void release();
+
+        // Releases the region memory.
+        ~Region();
+};
+
+// Stores the region where the current thread allocates (nullptr allocates from the pools).
+extern thread_local Region *current_region;
+
+// Sets the current region while it's in scope.
+class RegionScope
+{
+    // Stores the region that was used before.
+    Region *previous;
+
+    public:
+        RegionScope(Region *region)
+            : previous(current_region) { current_region = region; }
+        ~RegionScope() { current_region = previous; }
+};
+
+// Tells the allocator where the running program is, so every object remembers the line that allocated it.
+class AllocationSite
+{
+    public:
+        // The program counter of the virtual machine.
+        uint64_t *const *program_counter;
+
+        // The code being run, it's size (in words) and the line of every word.
+        const uint64_t *code;
+        uint64_t size;
+        const uint32_t *lines;
+};
+
+// Stores the allocation site of the current thread (nullptr if no program is running).
+extern thread_local const AllocationSite *allocation_site;
+
+// Sets the allocation site while it's in scope.
+class AllocationSiteScope
+{
+    // Stores the allocation site that was used before.
+    const AllocationSite *previous;
+
+    public:
+        AllocationSiteScope(const AllocationSite *site)
+            : previous(allocation_site) { allocation_site = site; }
+        ~AllocationSiteScope() { allocation_site = previous; }
+};
+
+// Allocates the memory for an object of the given kind and size.
+void *pool_allocate(ObjectKind kind, size_t size);
+
+// Releases the memory of an object allocated with pool_allocate.
+void pool_release(void *object);
+
+// Returns the header of an allocated object.
+ObjectHeader *object_header(const void *object);
+
+// Returns the allocation statistics of an object kind (of the current thread).
+const PoolStatistics &pool_statistics(ObjectKind kind);
+
+// Returns the name of an object kind.
+std::string object_kind_to_string(ObjectKind kind);
+
+// Prints the allocation statistics of every object kind.
+void print_pool_statistics();
+
+// Returns true if the object was allocated in a region.
+bool in_region(const void *object);
+
+// Lets the garbage collector of the current thread (if any) manage an object.
+void heap_track(void *object);
+
+// Charges the buffers an object owns to the garbage collector of the current thread (if any).
+void heap_charge(void *object);
+
+// Destroys an object of the given type (used as a region finalizer).
+template <typename T>
+void destroy(void *object)
+{
+    static_cast<T *>(object)->~T();
+}
+
+// Allocates and constructs an object of the given kind.
+template <typename T, typename... Arguments>
+T *allocate(ObjectKind kind, Arguments&&... arguments)
+{
+    auto object = new (pool_allocate(kind, sizeof(T))) T(std::forward<Arguments>(arguments)...);
+    if (!in_region(object)) heap_track(object);
+    else if (!std::is_trivially_destructible<T>::value) current_region->finalize(object, &destroy<T>);
+    heap_charge(object);
+
+    return object;
+}
+
+// Destroys and releases an object created with allocate.
+// Objects in a region are destroyed when the region is released.
+template <typename T>
+void release(T *object)
+{
+    if (in_region(object)) return;
+    object->~T();
+    pool_release(object);
+}
+
+#endif
@@ -36,12 +36,38 @@ typedef enum : uint8_t {
     OP_LIST, OP_DICTIONARY, OP_ACCESS,
 
     // Functions
-    OP_FUNCTION, OP_RETURN, OP_CALL,
+    OP_FUNCTION, OP_RETURN, OP_CALL, OP_YIELD,
+
+    // Iterators
+    OP_ITER, OP_FOR_NEXT,
+
+    // Classes and objects
+    OP_CLASS, OP_GET_SLOT, OP_SET_SLOT, OP_GET_FIELD, OP_SET_FIELD, OP_INVOKE,
 
     // Others
-    OP_LEN, OP_PRINT, OP_EXIT
+    OP_LEN, OP_PRINT, OP_EXIT,
+
+    // Quickened instructions. The compiler never emits them, the virtual machine rewrites
+    // the generic instructions into them after observing the operands and rewrites them
+    // back when their guard fails.
+    OP_ADD_INT, OP_SUB_INT, OP_MUL_INT, OP_EQ_INT, OP_NEQ_INT, OP_LT_INT, OP_LTE_INT, OP_HT_INT, OP_HTE_INT,
+    OP_ADD_FLOAT, OP_SUB_FLOAT, OP_MUL_FLOAT, OP_EQ_FLOAT, OP_NEQ_FLOAT, OP_LT_FLOAT, OP_LTE_FLOAT, OP_HT_FLOAT, OP_HTE_FLOAT,
+    OP_CALL_FUNCTION, OP_CALL_NATIVE
 } OpCode;
 
+// Number of code words used by the call cache (the function of OP_CALL_FUNCTION or the native function of OP_CALL_NATIVE).
+#define CALL_CACHE_WORDS 1
+
+// Number of code words used by the field inline cache (shape, slot).
+#define FIELD_CACHE_WORDS 2
+
+// Number of shapes a method inline cache remembers before going megamorphic.
+#define INVOKE_CACHE_ENTRIES 4
+
+// Number of code words used by the method inline cache. It stores the hit and
+// miss counters followed by the entries (shape, function, code index).
+#define INVOKE_CACHE_WORDS (2 + 3 * INVOKE_CACHE_ENTRIES)
+
 // Defines the basic memories that exist in the program.
 typedef enum : uint8_t {
     PROGRAM_MEMORY, FUNCTIONS_MEMORY, CLASSES_MEMORY
@@ -63,6 +89,10 @@ class Memory
         // Dumps the memory.
         void dump();
 
+        // Returns the maximum stack depth reached by the code that starts at the given
+        // index (relative to the stack at that point) following every possible path.
+        uint64_t max_stack(uint64_t entry);
+
         // Reset the memory.
         void reset();
 };
@@ -80,6 +110,34 @@ class Frame
 
         // Stores the frame caller (the function)
         Value caller;
+
+        // Stores the first stack slot that belongs to the frame.
+        Value *stack_base = nullptr;
+
+        // Stores the generator that owns the frame (if it's a resumed generator).
+        ValueIterator *generator = nullptr;
+};
+
+// Describes a compiled function.
+class FunctionInfo
+{
+    public:
+        // The index of it's first instruction (in the functions memory until it's linked).
+        uint64_t entry;
+
+        // The number of arguments it stores when it starts.
+        uint64_t arity;
+
+        // The maximum stack depth it's body reaches (not counting the arguments).
+        uint64_t max_stack;
+
+        // The name it was bound to (the variable or Class.method) and the line it's defined at.
+        std::string name;
+        uint32_t line;
+
+        // The variable it's declared with (empty if it's not a declaration). The function
+        // is stored in it inside the frame it captures, so it can call itself.
+        std::string binding;
 };
 
 // The base program class that represents a nuua program.
@@ -95,10 +153,46 @@ class Program
         // Stores the code regarding to classes.
         Memory classes;
 
+        // Stores the linked code of all the memories. The main code starts at index 0
+        // and the constant operands refer to the image constants.
+        Memory image;
+
+        // Stores every function, OP_FUNCTION refers to them by their index.
+        std::vector<FunctionInfo> function_table;
+
+        // Stores the maximum stack depth of the main code.
+        uint64_t max_stack = 0;
+
+        // Links the memories into the image, they are left empty.
+        void link();
+
+        // Returns the function of every instruction of the image (0 is the main code, n + 1 the
+        // function n of the table). The operands and the unreachable code are -1.
+        std::vector<int64_t> instruction_owners();
+
         // Resets the whole program memory.
         void reset();
 };
 
+// Returns the number of constant operands that follow the opcode.
+uint8_t opcode_constants(uint64_t opcode);
+
+// Returns the number of inline cache words that follow the constant operands.
+uint8_t opcode_cache(uint64_t opcode);
+
+// Sets the number of stack slots popped and pushed by the instruction at the given index.
+// The conditional jumps report the path that does not jump (OP_FOR_NEXT pops the iterator when it jumps).
+void opcode_stack_effect(Memory *memory, uint64_t index, int64_t *pops, int64_t *pushes);
+
+// Returns true if the instruction at the given index may jump and sets the target index.
+bool opcode_jump_target(Memory *memory, uint64_t index, uint64_t *target);
+
+// Returns true if the execution may continue with the next instruction after the opcode.
+bool opcode_falls_through(uint64_t opcode);
+
+// Returns the generic opcode of a quickened one (any other opcode is returned as is).
+uint64_t opcode_generic(uint64_t opcode);
+
 // Basic conversation from opcode to string.
 std::string opcode_to_string(uint64_t opcode);
 
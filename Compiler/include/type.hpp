@@ -2,14 +2,18 @@
 #define TYPE_HPP
 
 #include <stdint.h>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+class ValueClass;
+
 // Determines the available native types in nuua.
 typedef enum : uint8_t {
     VALUE_NONE, VALUE_INT, VALUE_FLOAT, VALUE_BOOL,
-    VALUE_STRING, VALUE_LIST, VALUE_DICT, VALUE_FUN
+    VALUE_STRING, VALUE_LIST, VALUE_DICT, VALUE_FUN,
+    VALUE_ITER, VALUE_CLASS, VALUE_OBJECT
 } ValueType;
 
 class Type
@@ -26,16 +30,21 @@ class Type
 
             // Stores the pair of value of a VALUE_DICT.
             std::pair<Type *, Type *> *dictType;
+
+            // Stores the class of a VALUE_OBJECT.
+            ValueClass *classType;
         };
 
         Type()
-            : type(VALUE_NONE) {}
+            : type(VALUE_NONE), listType(nullptr) {}
         Type(ValueType type)
-            : type(type) {}
+            : type(type), listType(nullptr) {}
         Type(ValueType type, Type *listType)
             : type(type), listType(listType) {}
         Type(ValueType type, std::pair<Type *, Type *> *dictType)
             : type(type), dictType(dictType) {}
+        Type(ValueType type, ValueClass *classType)
+            : type(type), classType(classType) {}
         Type(std::string name);
 
         // Checks to see if the current type is a given ValueType.
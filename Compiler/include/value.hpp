@@ -10,12 +10,16 @@
 #define VALUE_HPP
 
 #include "type.hpp"
+#include "pool.hpp"
 #include <string>
 #include <vector>
 
 class Frame;
+class Output;
 class ValueDictionary;
 class ValueFunction;
+class ValueIterator;
+class ValueObject;
 
 // Base value class representing a nuua value.
 class Value
@@ -46,6 +50,15 @@ class Value
 
             // Stores the representation of the VALUE_FUN.
             ValueFunction *value_fun;
+
+            // Stores the representation of the VALUE_ITER.
+            ValueIterator *value_iter;
+
+            // Stores the representation of the VALUE_CLASS.
+            ValueClass *value_class;
+
+            // Stores the representation of the VALUE_OBJECT.
+            ValueObject *value_object;
         };
 
         // The following are the basic constructors for the value. Each one respresents
@@ -69,16 +82,29 @@ class Value
 
         // String value.
         Value(std::string a)
-            : type(Type(VALUE_STRING)), value_string(new std::string(a)) {}
+            : type(Type(VALUE_STRING)), value_string(allocate<std::string>(OBJECT_STRING, a)) {}
 
         // List value.
         Value(std::vector<Value> a)
-            : type(Type(VALUE_LIST)), value_list(new std::vector(a)) {}
+            : type(Type(VALUE_LIST)), value_list(allocate<std::vector<Value>>(OBJECT_LIST, a)) {}
+
+        // Iterator value (it takes the ownership of the given iterator).
+        Value(ValueIterator *a)
+            : type(Type(VALUE_ITER)), value_iter(a) {}
+
+        // Function value (from an already existing function).
+        Value(ValueFunction *a)
+            : type(Type(VALUE_FUN)), value_fun(a) {}
+
+        // Class value.
+        Value(ValueClass *a)
+            : type(Type(VALUE_CLASS)), value_class(a) {}
 
-        // The following two constructors are basically defined in the value.cpp since
+        // The following constructors are basically defined in the value.cpp since
         // They make use of a forward declared constructor.
         Value(std::unordered_map<std::string, Value> a, std::vector<std::string> b);
-        Value(uint64_t index, Type return_type, Frame *frame);
+        Value(uint64_t index, Type return_type, Frame *frame, bool generator = false, uint64_t max_stack = 0);
+        Value(ValueObject *a);
 
         // Create default initialized value, given the type.
         Value(Type type);
@@ -104,11 +130,11 @@ class Value
         // Returns a new value representing the length of the current value.
         Value length();
 
-        // Prints the value to the screen.
-        void print();
+        // Prints the value to the given output.
+        void print(Output *output);
 
-        // Prints the value to the screen with a new line '\n' at the end.
-        void println();
+        // Prints the value to the given output with a new line '\n' at the end.
+        void println(Output *output);
 
         // The following are the operations to perform diferent taks between values.
         // They simply overload the default C++ operators.
@@ -156,9 +182,114 @@ class ValueFunction
         // Stores the frame where the function relies on.
         Frame *frame;
 
+        // Determines if the function is a generator (it contains a yield).
+        // Calling a generator returns an iterator instead of running the body.
+        bool generator;
+
+        // Stores the maximum stack depth the function body reaches.
+        uint64_t max_stack;
+
         // Basic constructor for the function value.
-        ValueFunction(uint64_t index, Type return_type, Frame *frame)
-            : index(index), return_type(return_type), frame(frame) {}
+        ValueFunction(uint64_t index, Type return_type, Frame *frame, bool generator = false, uint64_t max_stack = 0)
+            : index(index), return_type(return_type), frame(frame), generator(generator), max_stack(max_stack) {}
+};
+
+// Determines the available iterator kinds. The adaptors (map, filter, take and zip)
+// wrap other iterators and only pull the elements they need.
+typedef enum : uint8_t {
+    ITERATOR_LIST, ITERATOR_GENERATOR, ITERATOR_MAP,
+    ITERATOR_FILTER, ITERATOR_TAKE, ITERATOR_ZIP
+} IteratorKind;
+
+// Defines how an iterator value is. Iterators are lazy, no intermediate
+// list is created when chaining them.
+class ValueIterator
+{
+    public:
+        // The kind of the iterator.
+        IteratorKind kind;
+
+        // Stores the iterated list (ITERATOR_LIST), the generator function (ITERATOR_GENERATOR)
+        // or the callback to apply (ITERATOR_MAP and ITERATOR_FILTER).
+        Value target;
+
+        // Stores the source iterators of the adaptors.
+        std::vector<Value> sources;
+
+        // Stores the next list index (ITERATOR_LIST) or the remaining elements (ITERATOR_TAKE).
+        int64_t index = 0;
+
+        // Stores the suspended frame of a generator.
+        Frame *frame = nullptr;
+
+        // Stores the code index where the generator resumes.
+        uint64_t resume = 0;
+
+        // Stores the operand stack of a suspended generator.
+        std::vector<Value> stack;
+
+        // Determines if the generator is currently executing.
+        bool running = false;
+
+        // Determines if the iterator is exhausted.
+        bool done = false;
+
+        // Constructor for the list iterator and the adaptors.
+        ValueIterator(IteratorKind kind, Value target, std::vector<Value> sources = {}, int64_t index = 0)
+            : kind(kind), target(target), sources(sources), index(index) {}
+
+        // Constructor for the generator iterator.
+        ValueIterator(Value function, Frame *frame, uint64_t resume, std::vector<Value> stack)
+            : kind(ITERATOR_GENERATOR), target(function), frame(frame), resume(resume), stack(stack) {}
+};
+
+// Defines how a class value is. The class determines the fixed layout (the shape)
+// of all it's instances: every field has a slot offset known at compile time.
+class ValueClass
+{
+    public:
+        // Stores the class name.
+        std::string name;
+
+        // Stores the field names in slot order.
+        std::vector<std::string> fields;
+
+        // Stores the field types in slot order.
+        std::vector<Type> field_types;
+
+        // Maps a field name to it's slot offset.
+        std::unordered_map<std::string, uint64_t> slots;
+
+        // Stores the method functions (bound when the class declaration runs).
+        std::vector<Value> methods;
+
+        // Maps a method name to it's index in the methods.
+        std::unordered_map<std::string, uint64_t> method_slots;
+
+        // Basic constructor for the class value.
+        ValueClass(std::string name)
+            : name(name) {}
+
+        // Adds a field at the end of the layout.
+        void add_field(std::string field, Type type);
+
+        // Adds a method name, the function is bound later.
+        void add_method(std::string method);
+};
+
+// Defines how an object (class instance) is. It's a fixed size slot array
+// whose layout is determined by it's class.
+class ValueObject
+{
+    public:
+        // Stores the class (and so, the shape) of the object.
+        ValueClass *klass;
+
+        // Stores the field values.
+        Value *slots;
+
+        // Creates an object with default initialized fields.
+        ValueObject(ValueClass *klass);
 };
 
 #endif
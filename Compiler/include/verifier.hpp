@@ -0,0 +1,49 @@
+/**
+ * |------------------------|
+ * | Nuua Bytecode Verifier |
+ * |------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef VERIFIER_HPP
+#define VERIFIER_HPP
+
+#include "program.hpp"
+#include <vector>
+#include <string>
+
+// Verifies the linked bytecode of a program once before it runs. A verified program
+// only has known opcodes, operands inside the constants with the expected types, jumps
+// and function entries landing on instructions and the same stack depth on every path
+// that reaches an instruction, never deeper than the recorded maximum. The virtual
+// machine runs verified code without checking any of them.
+class Verifier
+{
+    // The program to verify.
+    Program *program;
+
+    // Stores the start of every instruction of the image.
+    std::vector<bool> boundaries;
+
+    // Stops the program with an error at an instruction.
+    void error(const std::string &message, uint64_t index);
+
+    // Checks the type of the constant operand of an instruction.
+    void check_operand(uint64_t index, uint8_t operand, ValueType expected);
+
+    // Checks every instruction and it's operands.
+    void verify_instructions();
+
+    // Follows every path from an entry checking the stack depth.
+    void verify_stack(uint64_t entry, int64_t depth, uint64_t max_stack);
+
+    public:
+        Verifier(Program *program)
+            : program(program) {}
+
+        // Verifies the program, it stops with an error if it's not valid.
+        void verify();
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include "../include/compiler.hpp"
 #include "../../Parser/include/parser.hpp"
 #include "../../Logger/include/logger.hpp"
+#include <chrono>
 
 Memory *Compiler::get_current_memory()
 {
@@ -33,25 +34,42 @@ void Compiler::add_constant(Value value)
 
 Program Compiler::compile(const char *source)
 {
-    Parser parser;
-
-    auto structure = parser.parse(source);
+    // The AST only lives while compiling, the constants are allocated
+    // outside of it (in the region of the caller, if any).
+    Region ast;
+    std::vector<Statement *> structure;
+    {
+        RegionScope scope(&ast);
+        Parser parser;
+        structure = parser.parse(source);
+        this->tokens = parser.tokens;
+        this->nodes = parser.nodes;
+        this->scanning_time = parser.scanning_time;
+        this->parsing_time = parser.parsing_time;
+        this->optimizing_time = parser.optimizing_time;
+    }
 
-    logger->info("Started compiling...");
+    LOG_INFO("Started compiling...");
+    auto start = std::chrono::steady_clock::now();
 
     for (auto node : structure) this->compile(node);
     this->add_opcode(OP_EXIT);
+    this->program.max_stack = this->program.program.max_stack(0);
 
     #if DEBUG
-        logger->info("Program memory:");
+        LOG_INFO("Program memory:");
         this->program.program.dump();
-        logger->info("Functions memory:");
+        LOG_INFO("Functions memory:");
         this->program.functions.dump();
-        logger->info("Classes memory:");
+        LOG_INFO("Classes memory:");
         this->program.classes.dump();
+        LOG_INFO("AST region: " + std::to_string(ast.bytes) + " bytes");
     #endif
 
-    logger->success("Compiling completed");
+    this->program.link();
+    this->compiling_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG_SUCCESS("Compiling completed");
 
     return this->program;
 }
@@ -84,10 +102,16 @@ void Compiler::compile(Statement *rule)
 
             this->add_opcode(OP_DECLARE);
             this->add_constant_only(declaration->name);
-            this->add_constant_only(Type(declaration->type));
+            auto type = this->resolve_type(declaration->type);
+            this->add_constant_only(type);
             // this->add_constant_only(Value(Type(declaration->type))); // This is the long version
 
+            // Remember the class of the variable to resolve it's field offsets.
+            if (type.is(VALUE_OBJECT)) this->object_types[declaration->name] = type.classType;
+            else this->object_types.erase(declaration->name);
+
             if (declaration->initializer) {
+                if (declaration->initializer->rule == RULE_FUNCTION) this->function_name = this->function_binding = declaration->name;
                 this->compile(declaration->initializer);
                 this->add_opcode(OP_STORE);
                 this->add_constant_only(declaration->name);
@@ -116,7 +140,7 @@ void Compiler::compile(Statement *rule)
 
                 for (auto stmt : rif->thenBranch) this->compile(stmt);
 
-                this->modify_constant(constant_index, Value(static_cast<int64_t>(this->current_code_line() - start_index)));
+                this->modify_constant(constant_index, Value(static_cast<int64_t>(this->current_code_line() - start_index + 1)));
             }
             break;
         }
@@ -138,6 +162,38 @@ void Compiler::compile(Statement *rule)
 
             break;
         }
+        case RULE_YIELD: {
+            if (this->current_memory != FUNCTIONS_MEMORY) {
+                logger->error("A yield can only be used inside a function.", rule->line);
+                exit(EXIT_FAILURE);
+            }
+            this->compile(static_cast<Yield *>(rule)->value);
+            this->add_opcode(OP_YIELD);
+            this->yields = true;
+            break;
+        }
+        case RULE_FOR: {
+            // The iterator stays on the stack while the loop runs. OP_FOR_NEXT
+            // binds the next element or pops the iterator and exits the loop.
+            auto rfor = static_cast<For *>(rule);
+            this->compile(rfor->iterable);
+            this->add_opcode(OP_ITER);
+
+            int64_t initial_index = this->current_code_line();
+            this->add_opcode(OP_FOR_NEXT);
+            this->add_constant_only(rfor->variable);
+            auto constant_index = this->add_constant_only(static_cast<int64_t>(0));
+            auto start_index = this->current_code_line();
+
+            for (auto stmt : rfor->body) this->compile(stmt);
+
+            this->add_opcode(OP_RJUMP);
+            this->add_constant_only(static_cast<int64_t>(-(this->current_code_line() - initial_index)));
+
+            this->modify_constant(constant_index, Value(static_cast<int64_t>(this->current_code_line() - start_index + 1)));
+
+            break;
+        }
         default: {
             logger->error("Invalid statemetn to compile.", rule->line);
             exit(EXIT_FAILURE);
@@ -170,7 +226,7 @@ void Compiler::compile(Expression *rule)
             auto list = static_cast<List *>(rule);
             for (int i = list->value.size() - 1; i >= 0; i--) this->compile(list->value.at(i));
             this->add_opcode(OP_LIST);
-            this->add_constant_only(static_cast<double>(list->value.size()));
+            this->add_constant_only(static_cast<int64_t>(list->value.size()));
             break;
         }
         case RULE_DICTIONARY: {
@@ -180,7 +236,7 @@ void Compiler::compile(Expression *rule)
                 this->compile(dictionary->value.at(dictionary->key_order[i]));
             }
             this->add_opcode(OP_DICTIONARY);
-            this->add_constant_only(static_cast<double>(dictionary->value.size()));
+            this->add_constant_only(static_cast<int64_t>(dictionary->value.size()));
             break;
         }
         case RULE_NONE: {
@@ -234,8 +290,24 @@ void Compiler::compile(Expression *rule)
         case RULE_FUNCTION: {
             auto function = static_cast<Function *>(rule);
             auto memory = this->current_memory;
+            auto yields = this->yields;
+            auto object_types = this->object_types;
+            auto name = this->function_name.empty() ? std::string("<anonymous>") : this->function_name;
+            auto binding = this->function_binding;
+            this->function_name.clear();
+            this->function_binding.clear();
+
+            // A function declared inside another one has it's body in the middle
+            // of the outer body, so the outer function jumps over it.
+            uint64_t skip_constant = 0, skip_start = 0;
+            if (memory == FUNCTIONS_MEMORY) {
+                this->add_opcode(OP_RJUMP);
+                skip_constant = this->add_constant_only(static_cast<int64_t>(0));
+                skip_start = this->current_code_line();
+            }
 
             this->current_memory = FUNCTIONS_MEMORY;
+            this->yields = false;
 
             double index = this->current_code_line();
 
@@ -257,11 +329,31 @@ void Compiler::compile(Expression *rule)
             this->add_constant(Value());
             this->add_opcode(OP_RETURN);
 
+            // A function containing a yield is a generator.
+            auto generator = this->yields;
+            auto return_type = this->resolve_type(function->return_type);
+            if (generator && !return_type.is(VALUE_ITER)) {
+                logger->error("A function containing a yield must return 'iter'.", rule->line);
+                exit(EXIT_FAILURE);
+            }
+
+            // The maximum stack depth lets the virtual machine check the stack once per call.
+            auto max_stack = this->program.functions.max_stack(static_cast<uint64_t>(index));
+
             this->current_memory = memory;
+            this->yields = yields;
+            this->object_types = object_types;
+
+            if (memory == FUNCTIONS_MEMORY) {
+                this->modify_constant(skip_constant, Value(static_cast<int64_t>(this->current_code_line() - skip_start + 1)));
+            }
+
+            this->program.function_table.push_back({ static_cast<uint64_t>(index), function->arguments.size(), max_stack, name, rule->line, binding });
 
             this->add_opcode(OP_FUNCTION);
-            this->add_constant_only(static_cast<int64_t>(index));
-            this->add_constant_only(function->return_type);
+            this->add_constant_only(static_cast<int64_t>(this->program.function_table.size() - 1));
+            this->add_constant_only(return_type);
+            this->add_constant_only(generator);
 
             break;
         }
@@ -271,6 +363,7 @@ void Compiler::compile(Expression *rule)
             this->add_opcode(OP_CALL);
             this->add_constant_only(call->callee);
             this->add_constant_only(static_cast<int64_t>(call->arguments.size()));
+            this->add_inline_cache(CALL_CACHE_WORDS);
             break;
         }
         case RULE_ACCESS: {
@@ -280,6 +373,50 @@ void Compiler::compile(Expression *rule)
             this->add_constant_only(access->name);
             break;
         }
+        case RULE_CLASS: {
+            auto declaration = static_cast<Class *>(rule);
+
+            // The class layout is created at compile time. Fields get their
+            // slot offset in declaration order.
+            auto klass = allocate<ValueClass>(OBJECT_CLASS, declaration->name);
+            this->classes[declaration->name] = klass;
+            for (auto field : declaration->fields) klass->add_field(field->name, this->resolve_type(field->type));
+            for (auto method : declaration->methods) klass->add_method(method->name);
+
+            // The methods are bound when the class declaration runs.
+            for (auto method : declaration->methods) {
+                this->function_name = declaration->name + "." + method->name;
+                this->compile(method->initializer);
+            }
+
+            this->add_opcode(OP_CLASS);
+            this->add_constant_only(Value(klass));
+            this->add_constant_only(static_cast<int64_t>(declaration->methods.size()));
+            break;
+        }
+        case RULE_PROPERTY: {
+            auto property = static_cast<Property *>(rule);
+            this->compile(property->object);
+            this->add_property(property->object, property->name, false);
+            break;
+        }
+        case RULE_ASSIGN_PROPERTY: {
+            auto assign_property = static_cast<AssignProperty *>(rule);
+            this->compile(assign_property->value);
+            this->compile(assign_property->object);
+            this->add_property(assign_property->object, assign_property->name, true);
+            break;
+        }
+        case RULE_INVOKE: {
+            auto invoke = static_cast<Invoke *>(rule);
+            this->compile(invoke->object);
+            for (auto argument : invoke->arguments) this->compile(argument);
+            this->add_opcode(OP_INVOKE);
+            this->add_constant_only(invoke->name);
+            this->add_constant_only(static_cast<int64_t>(invoke->arguments.size()));
+            this->add_inline_cache(INVOKE_CACHE_WORDS);
+            break;
+        }
         default: {
             logger->error("Invalid expression to compile.", rule->line);
             exit(EXIT_FAILURE);
@@ -317,6 +454,7 @@ uint64_t Compiler::add_constant_only(Value value)
 
     uint64_t index = this->get_current_memory()->constants.size() - 1;
     this->get_current_memory()->code.push_back(index);
+    this->get_current_memory()->lines.push_back(this->current_line);
 
     return index;
 }
@@ -326,6 +464,69 @@ void Compiler::modify_constant(uint64_t index, Value value)
     this->get_current_memory()->constants[index] = value;
 }
 
+void Compiler::add_inline_cache(uint8_t words)
+{
+    for (; words > 0; words--) {
+        this->get_current_memory()->code.push_back(0);
+        this->get_current_memory()->lines.push_back(this->current_line);
+    }
+}
+
+void Compiler::add_property(Expression *object, std::string name, bool store)
+{
+    auto klass = this->static_class(object);
+
+    if (klass) {
+        // The object layout is known, the field offset is resolved right now.
+        auto slot = klass->slots.find(name);
+        if (slot == klass->slots.end()) {
+            logger->error("The class '" + klass->name + "' has no field '" + name + "'.", this->current_line);
+            exit(EXIT_FAILURE);
+        }
+        this->add_opcode(store ? OP_SET_SLOT : OP_GET_SLOT);
+        this->add_constant_only(static_cast<int64_t>(slot->second));
+        return;
+    }
+
+    // Unknown class, the field is looked up by name and cached by the object shape.
+    this->add_opcode(store ? OP_SET_FIELD : OP_GET_FIELD);
+    this->add_constant_only(name);
+    this->add_inline_cache(FIELD_CACHE_WORDS);
+}
+
+Type Compiler::resolve_type(std::string name)
+{
+    auto klass = this->classes.find(name);
+    if (klass != this->classes.end()) return Type(VALUE_OBJECT, klass->second);
+
+    return Type(name);
+}
+
+ValueClass *Compiler::static_class(Expression *rule)
+{
+    switch (rule->rule) {
+        case RULE_VARIABLE: {
+            auto klass = this->object_types.find(static_cast<Variable *>(rule)->name);
+            return klass != this->object_types.end() ? klass->second : nullptr;
+        }
+        case RULE_GROUP: { return this->static_class(static_cast<Group *>(rule)->expression); }
+        case RULE_PROPERTY: {
+            auto property = static_cast<Property *>(rule);
+            auto klass = this->static_class(property->object);
+            if (!klass) return nullptr;
+            auto slot = klass->slots.find(property->name);
+            if (slot == klass->slots.end() || !klass->field_types[slot->second].is(VALUE_OBJECT)) return nullptr;
+            return klass->field_types[slot->second].classType;
+        }
+        case RULE_CALL: {
+            // Calling a class constructs an instance of it.
+            auto klass = this->classes.find(static_cast<Call *>(rule)->callee);
+            return klass != this->classes.end() ? klass->second : nullptr;
+        }
+        default: { return nullptr; }
+    }
+}
+
 uint32_t Compiler::current_code_line()
 {
     return this->get_current_memory()->code.size();
@@ -0,0 +1,577 @@
+/**
+ * |------------------------|
+ * | Nuua Garbage Collector |
+ * |------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/gc.hpp"
+#include "../../Logger/include/logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+thread_local Heap *current_heap = nullptr;
+
+// Stores the mark stack of the current thread while it marks in parallel.
+static thread_local MarkDeque *mark_deque = nullptr;
+
+void MarkDeque::push(void *object)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->objects.push_back(object);
+}
+
+bool MarkDeque::pop(void *&object)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->objects.empty()) return false;
+    object = this->objects.back();
+    this->objects.pop_back();
+
+    return true;
+}
+
+bool MarkDeque::steal(void *&object)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (this->objects.empty()) return false;
+    object = this->objects.front();
+    this->objects.pop_front();
+
+    return true;
+}
+
+bool MarkDeque::empty()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->objects.empty();
+}
+
+Heap::Heap()
+{
+    auto threads = std::thread::hardware_concurrency();
+    this->mark_threads = threads == 0 ? 1 : (threads > GC_MAX_MARK_THREADS ? GC_MAX_MARK_THREADS : threads);
+}
+
+Heap::~Heap()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->workers_lock);
+        this->workers_stop = true;
+    }
+    this->workers_wake.notify_all();
+    for (auto &worker : this->workers) worker.join();
+}
+
+void heap_track(void *object)
+{
+    if (current_heap) current_heap->track(object);
+}
+
+void heap_charge(void *object)
+{
+    if (current_heap) current_heap->charge(object);
+}
+
+uint64_t string_payload(const std::string &string)
+{
+    auto data = string.data();
+    auto object = reinterpret_cast<const char *>(&string);
+    if (data >= object && data < object + sizeof(std::string)) return 0;
+
+    return string.capacity() + 1;
+}
+
+// Returns the bytes of a hash map besides the map object: the buckets and the entry nodes
+// (with the next pointer and the cached hash). The characters of long keys are not counted.
+static uint64_t map_payload(const std::unordered_map<std::string, Value> &map)
+{
+    return map.bucket_count() * sizeof(void *) + map.size() * (sizeof(std::pair<const std::string, Value>) + sizeof(void *) + sizeof(size_t));
+}
+
+// Returns the bytes of the buffers an object owns (they are not part of it's size).
+static uint64_t object_payload(void *object)
+{
+    switch (object_header(object)->kind) {
+        case OBJECT_STRING: { return string_payload(*static_cast<std::string *>(object)); }
+        case OBJECT_LIST: { return static_cast<std::vector<Value> *>(object)->capacity() * sizeof(Value); }
+        case OBJECT_DICT: {
+            auto dictionary = static_cast<ValueDictionary *>(object);
+            return map_payload(dictionary->values) + dictionary->key_order.capacity() * sizeof(std::string);
+        }
+        case OBJECT_ITERATOR: {
+            auto iterator = static_cast<ValueIterator *>(object);
+            return (iterator->sources.capacity() + iterator->stack.capacity()) * sizeof(Value);
+        }
+        case OBJECT_FRAME: { return map_payload(static_cast<Frame *>(object)->heap); }
+        default: { return 0; }
+    }
+}
+
+void Heap::track(void *object)
+{
+    auto header = object_header(object);
+    header->flags |= GC_TRACKED;
+    this->old.push_back(object);
+    this->old_bytes += header->size;
+
+    // Objects created while marking are live (allocated black) but their
+    // references still need to be marked.
+    if (this->marking) {
+        header->flags |= GC_MARKED;
+        this->gray.push_back(object);
+    }
+}
+
+void Heap::charge(void *object)
+{
+    auto header = object_header(object);
+    uint32_t payload = std::min<uint64_t>(object_payload(object), UINT32_MAX);
+    if (payload == header->payload) return;
+
+    // The difference goes to the generation of the object (an old object is counted once it's tracked).
+    if (in_region(object)) this->nursery_payload = this->nursery_payload + payload - header->payload;
+    else if (header->flags & GC_TRACKED) this->old_bytes = this->old_bytes + payload - header->payload;
+    header->payload = payload;
+}
+
+void Heap::write_barrier(void *object)
+{
+    if (in_region(object)) return;
+
+    auto header = object_header(object);
+    if (!(header->flags & GC_TRACKED)) return;
+
+    if (!(header->flags & GC_REMEMBERED)) {
+        header->flags |= GC_REMEMBERED;
+        this->remembered.push_back(object);
+    }
+
+    // A marked object may now reference an unmarked one, scan it again.
+    if (this->marking && (header->flags & GC_MARKED)) this->gray.push_back(object);
+}
+
+template <typename T>
+T *Heap::forward(T *object)
+{
+    auto found = this->forwarded.find(object);
+    if (found != this->forwarded.end()) return static_cast<T *>(found->second);
+
+    // The copy is allocated (and tracked) in the old generation.
+    RegionScope scope(nullptr);
+    auto copy = allocate<T>(object_header(object)->kind, std::move(*object));
+    object_header(copy)->line = object_header(object)->line;
+    this->forwarded[object] = copy;
+    this->promoted.push_back(copy);
+    this->promoted_objects++;
+    this->statistics.promoted_bytes += object_header(copy)->size + object_header(copy)->payload;
+
+    return copy;
+}
+
+template <typename T>
+void Heap::visit(T *&object)
+{
+    if (!object) return;
+
+    if (this->mode == GC_MINOR) {
+        if (in_region(object)) object = this->forward(object);
+    } else if (this->mode == GC_SNAPSHOT) {
+        if (this->found.insert(object).second) this->unvisited.push_back(object);
+    } else this->mark(object);
+}
+
+void Heap::visit(Value &value)
+{
+    switch (value.type.type) {
+        case VALUE_STRING: { this->visit(value.value_string); break; }
+        case VALUE_LIST: { this->visit(value.value_list); break; }
+        case VALUE_DICT: { this->visit(value.value_dict); break; }
+        case VALUE_FUN: { this->visit(value.value_fun); break; }
+        case VALUE_ITER: { this->visit(value.value_iter); break; }
+        case VALUE_CLASS: { this->visit(value.value_class); break; }
+        case VALUE_OBJECT: { this->visit(value.value_object); break; }
+        default: { break; }
+    }
+    this->visit(&value.type);
+}
+
+void Heap::visit(Type *type)
+{
+    switch (type->type) {
+        case VALUE_LIST: { if (type->listType) this->visit(type->listType); break; }
+        case VALUE_DICT: {
+            if (type->dictType && type->dictType->first) this->visit(type->dictType->first);
+            if (type->dictType && type->dictType->second) this->visit(type->dictType->second);
+            break;
+        }
+        case VALUE_OBJECT: { this->visit(type->classType); break; }
+        default: { break; }
+    }
+}
+
+void Heap::scan(void *object)
+{
+    switch (object_header(object)->kind) {
+        case OBJECT_LIST: {
+            for (auto &value : *static_cast<std::vector<Value> *>(object)) this->visit(value);
+            break;
+        }
+        case OBJECT_DICT: {
+            for (auto &value : static_cast<ValueDictionary *>(object)->values) this->visit(value.second);
+            break;
+        }
+        case OBJECT_FUNCTION: {
+            auto function = static_cast<ValueFunction *>(object);
+            this->visit(&function->return_type);
+            this->visit(function->frame);
+            break;
+        }
+        case OBJECT_ITERATOR: {
+            auto iterator = static_cast<ValueIterator *>(object);
+            this->visit(iterator->target);
+            for (auto &source : iterator->sources) this->visit(source);
+            this->visit(iterator->frame);
+            for (auto &value : iterator->stack) this->visit(value);
+            break;
+        }
+        case OBJECT_CLASS: {
+            auto klass = static_cast<ValueClass *>(object);
+            for (auto &type : klass->field_types) this->visit(&type);
+            for (auto &method : klass->methods) this->visit(method);
+            break;
+        }
+        case OBJECT_OBJECT: {
+            auto instance = static_cast<ValueObject *>(object);
+            auto fields = instance->klass->fields.size();
+            // The slots of a promoted object are still in the nursery.
+            if (this->mode != GC_SNAPSHOT && in_region(instance->slots)) {
+                RegionScope scope(nullptr);
+                auto slots = static_cast<Value *>(pool_allocate(OBJECT_SLOTS, sizeof(Value) * fields));
+                object_header(slots)->line = object_header(instance)->line;
+                for (uint64_t i = 0; i < fields; i++) new (&slots[i]) Value(instance->slots[i]);
+                instance->slots = slots;
+            }
+            this->visit(instance->klass);
+            for (uint64_t i = 0; i < fields; i++) this->visit(instance->slots[i]);
+            break;
+        }
+        case OBJECT_FRAME: {
+            auto frame = static_cast<Frame *>(object);
+            for (auto &variable : frame->heap) this->visit(variable.second);
+            this->visit(frame->caller);
+            this->visit(frame->generator);
+            break;
+        }
+        default: { break; }
+    }
+}
+
+void Heap::mark(void *object)
+{
+    // Nursery objects are marked when they get promoted.
+    if (in_region(object)) return;
+
+    auto header = object_header(object);
+    if (!(__atomic_load_n(&header->flags, __ATOMIC_RELAXED) & GC_TRACKED)) return;
+
+    // The mark bit is set atomically since the marking threads may race for the same object.
+    if (__atomic_fetch_or(&header->flags, GC_MARKED, __ATOMIC_RELAXED) & GC_MARKED) return;
+
+    if (mark_deque) mark_deque->push(object);
+    else this->gray.push_back(object);
+}
+
+void Heap::visit_roots(HeapRoots &roots, bool constants)
+{
+    for (auto value = roots.stack; value < roots.stack_top; value++) this->visit(*value);
+
+    for (auto frame = roots.frames; frame <= roots.frames_top; frame++) {
+        for (auto &variable : frame->heap) this->visit(variable.second);
+        this->visit(frame->caller);
+        this->visit(frame->generator);
+    }
+
+    if (roots.handles) {
+        for (auto value : roots.handles->values) this->visit(*value);
+        for (auto list : roots.handles->lists) {
+            for (auto &value : *list) this->visit(value);
+        }
+    }
+
+    if (constants) {
+        for (auto memory : roots.memories) {
+            for (auto &constant : memory->constants) this->visit(constant);
+        }
+    }
+}
+
+void Heap::destroy(void *object)
+{
+    switch (object_header(object)->kind) {
+        case OBJECT_STRING: { release(static_cast<std::string *>(object)); break; }
+        case OBJECT_LIST: { release(static_cast<std::vector<Value> *>(object)); break; }
+        case OBJECT_DICT: { release(static_cast<ValueDictionary *>(object)); break; }
+        case OBJECT_FUNCTION: { release(static_cast<ValueFunction *>(object)); break; }
+        case OBJECT_ITERATOR: { release(static_cast<ValueIterator *>(object)); break; }
+        case OBJECT_CLASS: { release(static_cast<ValueClass *>(object)); break; }
+        case OBJECT_OBJECT: {
+            auto instance = static_cast<ValueObject *>(object);
+            if (!in_region(instance->slots)) pool_release(instance->slots);
+            release(instance);
+            break;
+        }
+        case OBJECT_FRAME: { release(static_cast<Frame *>(object)); break; }
+        default: { pool_release(object); break; }
+    }
+}
+
+void Heap::minor(HeapRoots &roots)
+{
+    this->mode = GC_MINOR;
+    this->statistics.nursery_bytes += this->nursery_used();
+
+    // The constants are never in the nursery, they are allocated by the compiler.
+    this->visit_roots(roots, false);
+
+    for (auto object : this->remembered) {
+        object_header(object)->flags &= ~GC_REMEMBERED;
+        this->scan(object);
+    }
+    this->remembered.clear();
+
+    while (!this->promoted.empty()) {
+        auto object = this->promoted.back();
+        this->promoted.pop_back();
+        this->scan(object);
+    }
+
+    this->forwarded.clear();
+    this->nursery.release();
+    this->nursery_payload = 0;
+    this->statistics.minor_collections++;
+}
+
+void Heap::start_major(HeapRoots &roots)
+{
+    this->marking = true;
+    this->mode = GC_MAJOR;
+    this->visit_roots(roots, true);
+}
+
+bool Heap::mark_step(uint64_t budget)
+{
+    this->mode = GC_MAJOR;
+    this->statistics.mark_steps++;
+
+    while (budget > 0 && !this->gray.empty()) {
+        // Wide graphs are marked by all the marking threads.
+        if (this->mark_threads > 1 && this->gray.size() >= GC_PARALLEL_THRESHOLD) {
+            budget = this->parallel_mark(budget);
+            continue;
+        }
+
+        auto object = this->gray.back();
+        this->gray.pop_back();
+        this->scan(object);
+        budget--;
+    }
+
+    return this->gray.empty();
+}
+
+void Heap::mark_worker(uint64_t index)
+{
+    auto deque = &this->deques[index];
+    mark_deque = deque;
+
+    for (void *object;;) {
+        if (this->mark_budget.fetch_sub(1, std::memory_order_relaxed) <= 0) break;
+
+        bool found = deque->pop(object);
+        for (uint64_t i = 1; !found && i < this->mark_threads; i++) found = this->deques[(index + i) % this->mark_threads].steal(object);
+        if (found) {
+            this->scan(object);
+            continue;
+        }
+        this->mark_budget.fetch_add(1, std::memory_order_relaxed);
+
+        // The marking is finished when every thread is idle (they only push to their own stack).
+        this->idle_markers++;
+        for (bool work = false; !work;) {
+            if (this->idle_markers == this->mark_threads || this->mark_budget.load(std::memory_order_relaxed) <= 0) {
+                mark_deque = nullptr;
+                return;
+            }
+            for (uint64_t i = 0; !work && i < this->mark_threads; i++) work = !this->deques[i].empty();
+            if (work) this->idle_markers--;
+            else std::this_thread::yield();
+        }
+    }
+
+    mark_deque = nullptr;
+}
+
+void Heap::worker_main(uint64_t index)
+{
+    for (uint64_t phase = 0;;) {
+        {
+            std::unique_lock<std::mutex> guard(this->workers_lock);
+            this->workers_wake.wait(guard, [&] { return this->workers_stop || this->workers_phase != phase; });
+            if (this->workers_stop) return;
+            phase = this->workers_phase;
+        }
+
+        this->mark_worker(index);
+
+        std::lock_guard<std::mutex> guard(this->workers_lock);
+        if (--this->workers_running == 0) this->workers_done.notify_one();
+    }
+}
+
+uint64_t Heap::parallel_mark(uint64_t budget)
+{
+    // The threads are started the first time they are needed.
+    if (!this->deques) {
+        // The number of threads is clamped where the deques are allocated, it may have been set from outside.
+        uint64_t threads = std::min<uint64_t>(std::max<uint64_t>(this->mark_threads, 1), GC_MAX_MARK_THREADS);
+        this->mark_threads = threads;
+        this->deques.reset(new MarkDeque[threads]);
+        for (uint64_t i = 1; i < threads; i++) this->workers.emplace_back(&Heap::worker_main, this, i);
+    }
+
+    for (uint64_t i = 0; i < this->gray.size(); i++) this->deques[i % this->mark_threads].push(this->gray[i]);
+    this->gray.clear();
+    this->idle_markers = 0;
+    this->mark_budget = budget > INT64_MAX ? INT64_MAX : static_cast<int64_t>(budget);
+
+    {
+        std::lock_guard<std::mutex> guard(this->workers_lock);
+        this->workers_running = this->mark_threads - 1;
+        this->workers_phase++;
+    }
+    this->workers_wake.notify_all();
+
+    this->mark_worker(0);
+
+    {
+        std::unique_lock<std::mutex> guard(this->workers_lock);
+        this->workers_done.wait(guard, [&] { return this->workers_running == 0; });
+    }
+    this->statistics.parallel_marks++;
+
+    // The objects left when the budget is spent are marked by the next step.
+    for (uint64_t i = 0; i < this->mark_threads; i++) {
+        for (void *object; this->deques[i].pop(object);) this->gray.push_back(object);
+    }
+
+    auto left = this->mark_budget.load();
+    return left > 0 ? left : 0;
+}
+
+void Heap::finish_major(HeapRoots &roots)
+{
+    // Empty the nursery (the survivors get marked) and remark the roots,
+    // they are not protected by the write barrier.
+    this->minor(roots);
+    this->mode = GC_MAJOR;
+    this->visit_roots(roots, true);
+    this->mark_step(UINT64_MAX);
+
+    uint64_t live = 0;
+    for (auto object : this->old) {
+        auto header = object_header(object);
+        if (header->flags & GC_MARKED) {
+            header->flags &= ~GC_MARKED;
+            this->old[live++] = object;
+        } else {
+            this->old_bytes -= header->size + header->payload;
+            this->statistics.freed_bytes += header->size + header->payload;
+            this->destroy(object);
+        }
+    }
+    this->old.resize(live);
+
+    this->marking = false;
+    this->next_major = this->old_bytes * GC_OLD_GROWTH > GC_OLD_INITIAL ? this->old_bytes * GC_OLD_GROWTH : GC_OLD_INITIAL;
+    this->statistics.major_collections++;
+
+    if (this->heap_limit > 0 && this->old_bytes > this->heap_limit) {
+        logger->error("Heap limit exceeded: " + std::to_string(this->old_bytes) + " live bytes (limit " + std::to_string(this->heap_limit) + ")");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Heap::collect(HeapRoots &roots)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (this->nursery_used() >= this->nursery_size) this->minor(roots);
+
+    if (this->marking) {
+        auto budget = this->promoted_objects * GC_MARK_RATE > GC_MARK_SLICE ? this->promoted_objects * GC_MARK_RATE : GC_MARK_SLICE;
+        this->promoted_objects = 0;
+        if (this->mark_step(budget)) this->finish_major(roots);
+    } else if (this->old_bytes >= this->next_major) this->start_major(roots);
+
+    std::chrono::duration<double> pause = std::chrono::steady_clock::now() - start;
+    this->statistics.pauses++;
+    this->statistics.pause_total += pause.count();
+    if (pause.count() > this->statistics.pause_max) this->statistics.pause_max = pause.count();
+}
+
+void Heap::collect_full(HeapRoots &roots)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (!this->marking) this->start_major(roots);
+    this->finish_major(roots);
+
+    std::chrono::duration<double> pause = std::chrono::steady_clock::now() - start;
+    this->statistics.pauses++;
+    this->statistics.pause_total += pause.count();
+    if (pause.count() > this->statistics.pause_max) this->statistics.pause_max = pause.count();
+}
+
+std::vector<void *> Heap::reachable(HeapRoots &roots)
+{
+    auto mode = this->mode;
+    this->mode = GC_SNAPSHOT;
+    this->visit_roots(roots, true);
+    while (!this->unvisited.empty()) {
+        auto object = this->unvisited.back();
+        this->unvisited.pop_back();
+        this->scan(object);
+    }
+    this->mode = mode;
+
+    std::vector<void *> objects(this->found.begin(), this->found.end());
+    this->found.clear();
+
+    return objects;
+}
+
+void Heap::print_statistics(double run_time)
+{
+    auto stats = &this->statistics;
+    printf(
+        "Collections: %llu minor, %llu major (%llu marking steps, %llu parallel markings on %llu threads)\n",
+        static_cast<unsigned long long>(stats->minor_collections), static_cast<unsigned long long>(stats->major_collections),
+        static_cast<unsigned long long>(stats->mark_steps), static_cast<unsigned long long>(stats->parallel_marks),
+        static_cast<unsigned long long>(this->mark_threads)
+    );
+    printf(
+        "Nursery: %llu bytes allocated, %llu bytes promoted | Old generation: %llu live bytes, %llu bytes freed\n",
+        static_cast<unsigned long long>(stats->nursery_bytes + this->nursery_used()), static_cast<unsigned long long>(stats->promoted_bytes),
+        static_cast<unsigned long long>(this->old_bytes), static_cast<unsigned long long>(stats->freed_bytes)
+    );
+    printf(
+        "Pauses: %llu, total %.3f ms, max %.3f ms, mean %.3f ms | GC time: %.2f%% of %.3f ms\n",
+        static_cast<unsigned long long>(stats->pauses), stats->pause_total * 1000, stats->pause_max * 1000,
+        stats->pauses > 0 ? stats->pause_total * 1000 / stats->pauses : 0.0,
+        run_time > 0 ? stats->pause_total * 100 / run_time : 0.0, run_time * 1000
+    );
+}
@@ -0,0 +1,165 @@
+/**
+ * |--------------------|
+ * | Nuua Output Buffer |
+ * |--------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/output.hpp"
+#include "../../Logger/include/logger.hpp"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Stores the outputs in use, they are drained when the program exits (even with exit()).
+static std::vector<Output *> outputs;
+
+Output::Output()
+{
+    static bool registered = false;
+    if (!registered) {
+        atexit(&Output::drain_all);
+        registered = true;
+    }
+    logger->synchronize = &Output::drain_all;
+    this->line_buffered = isatty(STDOUT_FILENO);
+    outputs.push_back(this);
+}
+
+Output::~Output()
+{
+    this->flush();
+    outputs.erase(std::remove(outputs.begin(), outputs.end(), this), outputs.end());
+}
+
+void Output::drain_all()
+{
+    for (auto output : outputs) output->drain();
+}
+
+void Output::drain()
+{
+    if (this->used > 0) fwrite(this->buffer, 1, this->used, stdout);
+    this->used = 0;
+}
+
+void Output::flush()
+{
+    this->drain();
+    fflush(stdout);
+}
+
+void Output::write(const char *data, size_t size)
+{
+    // Big writes skip the buffer.
+    if (size > OUTPUT_BUFFER_SIZE / 2) {
+        this->drain();
+        fwrite(data, 1, size, stdout);
+        return;
+    }
+    this->reserve(size);
+    memcpy(this->buffer + this->used, data, size);
+    this->used += size;
+}
+
+void Output::write(int64_t number)
+{
+    char digits[20];
+    size_t length = 0;
+    // The magnitude is computed unsigned so the minimum integer doesn't overflow.
+    auto magnitude = number < 0 ? 0 - static_cast<uint64_t>(number) : static_cast<uint64_t>(number);
+    do {
+        digits[length++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    this->reserve(length + 1);
+    if (number < 0) this->buffer[this->used++] = '-';
+    while (length > 0) this->buffer[this->used++] = digits[--length];
+}
+
+void Output::write(double number)
+{
+    this->reserve(OUTPUT_NUMBER_SIZE);
+    this->used += snprintf(this->buffer + this->used, OUTPUT_NUMBER_SIZE, "%f", number);
+}
+
+void Output::write(const Value &value, bool quoted)
+{
+    switch (value.type.type) {
+        case VALUE_INT: { this->write(value.value_int); break; }
+        case VALUE_FLOAT: { this->write(value.value_float); break; }
+        case VALUE_BOOL: { value.value_bool ? this->write("true", 4) : this->write("false", 5); break; }
+        case VALUE_STRING: {
+            if (quoted) this->write('\'');
+            this->write(*value.value_string);
+            if (quoted) this->write('\'');
+            break;
+        }
+        case VALUE_LIST: {
+            this->write('[');
+            bool first = true;
+            for (auto &element : *value.value_list) {
+                if (!first) this->write(", ", 2);
+                this->write(element, true);
+                first = false;
+            }
+            this->write(']');
+            break;
+        }
+        case VALUE_DICT: {
+            this->write('{');
+            bool first = true;
+            for (auto &key : value.value_dict->key_order) {
+                if (!first) this->write(", ", 2);
+                this->write(key);
+                this->write(": ", 2);
+                this->write(value.value_dict->values.at(key), true);
+                first = false;
+            }
+            this->write('}');
+            break;
+        }
+        case VALUE_FUN:
+        case VALUE_ITER: {
+            this->reserve(OUTPUT_NUMBER_SIZE);
+            this->used += snprintf(
+                this->buffer + this->used, OUTPUT_NUMBER_SIZE, value.type.type == VALUE_FUN ? "<Function: 0x%llx>" : "<Iterator: 0x%llx>",
+                static_cast<unsigned long long>(value.type.type == VALUE_FUN ? reinterpret_cast<uintptr_t>(value.value_fun) : reinterpret_cast<uintptr_t>(value.value_iter))
+            );
+            break;
+        }
+        case VALUE_CLASS: {
+            if (!value.value_class) { this->write("none", 4); break; }
+            this->write("<Class: ", 8);
+            this->write(value.value_class->name);
+            this->write('>');
+            break;
+        }
+        case VALUE_OBJECT: {
+            if (!value.value_object) { this->write("none", 4); break; }
+            auto klass = value.value_object->klass;
+            this->write(klass->name);
+            this->write(" {", 2);
+            for (uint64_t i = 0; i < klass->fields.size(); i++) {
+                if (i > 0) this->write(", ", 2);
+                this->write(klass->fields[i]);
+                this->write(": ", 2);
+                this->write(value.value_object->slots[i], true);
+            }
+            this->write('}');
+            break;
+        }
+        default: { this->write("none", 4); break; }
+    }
+}
+
+void Output::write_line(const Value &value)
+{
+    this->write(value);
+    this->write('\n');
+    if (this->line_buffered) this->flush();
+}
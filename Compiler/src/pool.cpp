@@ -0,0 +1,224 @@
+/**
+ * |-------------------|
+ * | Nuua Object Pools |
+ * |-------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/pool.hpp"
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstddef>
+
+// The header size keeps the objects aligned.
+#define HEADER_SIZE ((sizeof(ObjectHeader) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1))
+
+static const char *object_kind_names[OBJECT_KINDS] = {
+    "string", "list", "dict", "function", "iterator",
+    "class", "object", "slots", "frame"
+};
+
+// Every thread has it's own pools so no locking is required.
+static thread_local Pool pools[POOL_SIZE_CLASSES];
+static thread_local PoolStatistics statistics[OBJECT_KINDS];
+
+thread_local Region *current_region = nullptr;
+thread_local const AllocationSite *allocation_site = nullptr;
+
+// Returns the line of the instruction that is running (0 if it's not known).
+static uint32_t allocation_line()
+{
+    if (!allocation_site) return 0;
+    // The program counter points after the instruction being run (at least after it's opcode).
+    auto index = *allocation_site->program_counter - allocation_site->code;
+    if (index <= 0 || static_cast<uint64_t>(index) > allocation_site->size) return 0;
+
+    return allocation_site->lines[index - 1];
+}
+
+void *Pool::allocate()
+{
+    if (this->free_list) {
+        auto slot = this->free_list;
+        this->free_list = *static_cast<void **>(slot);
+        return slot;
+    }
+
+    if (this->next + this->slot_size > this->end) {
+        this->next = static_cast<char *>(malloc(POOL_BLOCK_SIZE));
+        if (!this->next) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        this->end = this->next + POOL_BLOCK_SIZE;
+        this->blocks++;
+    }
+
+    auto slot = this->next;
+    this->next += this->slot_size;
+
+    return slot;
+}
+
+void Pool::release(void *slot)
+{
+    *static_cast<void **>(slot) = this->free_list;
+    this->free_list = slot;
+}
+
+void *Region::allocate(size_t size)
+{
+    size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+    if (this->next + size > this->end) {
+        // Reuse a spare chunk if possible, otherwise request a new one.
+        auto chunk_size = size > REGION_CHUNK_SIZE ? size : REGION_CHUNK_SIZE;
+        char *chunk = nullptr;
+        if (chunk_size == REGION_CHUNK_SIZE && !this->spare.empty()) {
+            chunk = this->spare.back();
+            this->spare.pop_back();
+        } else {
+            chunk = static_cast<char *>(malloc(chunk_size));
+            if (!chunk) {
+                fprintf(stderr, "Out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        this->chunks.push_back({ chunk, chunk_size });
+        this->next = chunk;
+        this->end = chunk + chunk_size;
+    }
+
+    auto memory = this->next;
+    this->next += size;
+    this->bytes += size;
+
+    return memory;
+}
+
+void Region::finalize(void *object, void (*destructor)(void *))
+{
+    this->finalizers.push_back({ object, destructor });
+}
+
+void Region::release()
+{
+    for (auto finalizer = this->finalizers.rbegin(); finalizer != this->finalizers.rend(); finalizer++) {
+        finalizer->second(finalizer->first);
+    }
+    this->finalizers.clear();
+
+    for (uint8_t kind = 0; kind < OBJECT_KINDS; kind++) {
+        statistics[kind].releases += this->kind_objects[kind];
+        statistics[kind].bytes -= this->kind_bytes[kind];
+        this->kind_objects[kind] = this->kind_bytes[kind] = 0;
+    }
+
+    // Keep the regular chunks, they are reused by the next allocations.
+    for (auto &chunk : this->chunks) {
+        if (chunk.second == REGION_CHUNK_SIZE) this->spare.push_back(chunk.first);
+        else free(chunk.first);
+    }
+    this->chunks.clear();
+    this->next = this->end = nullptr;
+    this->bytes = 0;
+}
+
+Region::~Region()
+{
+    this->release();
+    for (auto chunk : this->spare) free(chunk);
+}
+
+void *pool_allocate(ObjectKind kind, size_t size)
+{
+    auto total = HEADER_SIZE + size;
+    uint8_t size_class = (total + POOL_SIZE_STEP - 1) / POOL_SIZE_STEP - 1;
+    char *memory;
+
+    if (current_region) {
+        size_class = POOL_REGION;
+        memory = static_cast<char *>(current_region->allocate(total));
+        current_region->kind_objects[kind]++;
+        current_region->kind_bytes[kind] += size;
+    } else if (total > POOL_SIZE_CLASSES * POOL_SIZE_STEP) {
+        size_class = POOL_SIZE_CLASSES;
+        memory = static_cast<char *>(malloc(total));
+        if (!memory) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        auto pool = &pools[size_class];
+        if (pool->slot_size == 0) pool->slot_size = (size_class + 1) * POOL_SIZE_STEP;
+        memory = static_cast<char *>(pool->allocate());
+    }
+
+    auto header = reinterpret_cast<ObjectHeader *>(memory);
+    header->kind = kind;
+    header->size_class = size_class;
+    header->flags = 0;
+    header->size = size;
+    header->line = allocation_line();
+    header->payload = 0;
+
+    auto stats = &statistics[kind];
+    stats->allocations++;
+    stats->bytes += size;
+    if (stats->bytes > stats->peak_bytes) stats->peak_bytes = stats->bytes;
+
+    return memory + HEADER_SIZE;
+}
+
+void pool_release(void *object)
+{
+    auto header = object_header(object);
+    if (header->size_class == POOL_REGION) return;
+
+    auto stats = &statistics[header->kind];
+    stats->releases++;
+    stats->bytes -= header->size;
+
+    if (header->size_class == POOL_SIZE_CLASSES) free(header);
+    else pools[header->size_class].release(header);
+}
+
+ObjectHeader *object_header(const void *object)
+{
+    return reinterpret_cast<ObjectHeader *>(const_cast<char *>(static_cast<const char *>(object)) - HEADER_SIZE);
+}
+
+bool in_region(const void *object)
+{
+    return object_header(object)->size_class == POOL_REGION;
+}
+
+const PoolStatistics &pool_statistics(ObjectKind kind)
+{
+    return statistics[kind];
+}
+
+std::string object_kind_to_string(ObjectKind kind)
+{
+    return object_kind_names[kind];
+}
+
+void print_pool_statistics()
+{
+    printf("%-10s %14s %14s %14s %14s\n", "Kind", "Allocations", "Releases", "Live bytes", "Peak bytes");
+    for (uint8_t kind = 0; kind < OBJECT_KINDS; kind++) {
+        auto stats = &statistics[kind];
+        printf(
+            "%-10s %14llu %14llu %14llu %14llu\n", object_kind_names[kind],
+            static_cast<unsigned long long>(stats->allocations), static_cast<unsigned long long>(stats->releases),
+            static_cast<unsigned long long>(stats->bytes), static_cast<unsigned long long>(stats->peak_bytes)
+        );
+    }
+
+    uint64_t blocks = 0;
+    for (uint8_t size_class = 0; size_class < POOL_SIZE_CLASSES; size_class++) blocks += pools[size_class].blocks;
+    printf("Pool blocks: %llu (%llu KB)\n", static_cast<unsigned long long>(blocks), static_cast<unsigned long long>(blocks * POOL_BLOCK_SIZE / 1024));
+}
+
+#undef HEADER_SIZE
@@ -30,10 +30,21 @@ static auto opcode_names = std::vector<std::string>({
     "OP_LIST", "OP_DICTIONARY", "OP_ACCESS",
 
     // Functions
-    "OP_FUNCTION", "OP_RETURN", "OP_CALL",
+    "OP_FUNCTION", "OP_RETURN", "OP_CALL", "OP_YIELD",
+
+    // Iterators
+    "OP_ITER", "OP_FOR_NEXT",
+
+    // Classes and objects
+    "OP_CLASS", "OP_GET_SLOT", "OP_SET_SLOT", "OP_GET_FIELD", "OP_SET_FIELD", "OP_INVOKE",
 
     // Others
-    "OP_LEN", "OP_PRINT", "OP_EXIT"
+    "OP_LEN", "OP_PRINT", "OP_EXIT",
+
+    // Quickened instructions
+    "OP_ADD_INT", "OP_SUB_INT", "OP_MUL_INT", "OP_EQ_INT", "OP_NEQ_INT", "OP_LT_INT", "OP_LTE_INT", "OP_HT_INT", "OP_HTE_INT",
+    "OP_ADD_FLOAT", "OP_SUB_FLOAT", "OP_MUL_FLOAT", "OP_EQ_FLOAT", "OP_NEQ_FLOAT", "OP_LT_FLOAT", "OP_LTE_FLOAT", "OP_HT_FLOAT", "OP_HTE_FLOAT",
+    "OP_CALL_FUNCTION", "OP_CALL_NATIVE"
 });
 
 void Memory::dump()
@@ -44,30 +55,14 @@ void Memory::dump()
         printf("(%lli, ", opcode);
         print_opcode(opcode);
         printf(") [");
-        if (
-            opcode == OP_PUSH
-            || opcode == OP_LOAD
-            || opcode == OP_STORE
-            || opcode == OP_ONLY_STORE
-            || opcode == OP_BRANCH_FALSE
-            || opcode == OP_BRANCH_TRUE
-            || opcode == OP_RJUMP
-            || opcode == OP_ACCESS
-            || opcode == OP_LIST
-            || opcode == OP_DICTIONARY
-            || opcode == OP_STORE_ACCESS
-            || opcode == OP_FUNCTION
-            || opcode == OP_CALL
-            || opcode == OP_DECLARE
-        ) {
-            this->constants[this->code[++i]].print();
-
-            if (opcode == OP_DECLARE || opcode == OP_CALL) {
-                // Requires 2 parameters
-                printf(", ");
-                this->constants[this->code[++i]].print();
-            }
-
+        for (uint8_t c = 0; c < opcode_constants(opcode); c++) {
+            if (c > 0) printf(", ");
+            printf("%s", this->constants[this->code[++i]].to_string().c_str());
+        }
+        if (opcode_cache(opcode) > 0) {
+            // The inline cache words live in the code itself.
+            printf(", cache:");
+            for (uint8_t c = 0; c < opcode_cache(opcode); c++) printf(" 0x%llx", static_cast<unsigned long long>(this->code[++i]));
         }
         printf("]\n");
     }
@@ -83,6 +78,43 @@ void Memory::dump()
     */
 }
 
+uint64_t Memory::max_stack(uint64_t entry)
+{
+    // Stores the depth at the start of every reached instruction. Every instruction
+    // is visited once, the paths that join have the same depth in well formed code.
+    std::unordered_map<uint64_t, int64_t> depths = { { entry, 0 } };
+    std::vector<uint64_t> pending = { entry };
+    int64_t max = 0;
+
+    while (!pending.empty()) {
+        auto index = pending.back();
+        pending.pop_back();
+
+        auto opcode = this->code[index];
+        int64_t pops, pushes;
+        opcode_stack_effect(this, index, &pops, &pushes);
+        auto depth = depths[index] - pops + pushes;
+        if (depth > max) max = depth;
+
+        std::pair<uint64_t, int64_t> successors[2] = {
+            { index + 1 + opcode_constants(opcode) + opcode_cache(opcode), depth }, { 0, depth }
+        };
+        uint8_t first = opcode_falls_through(opcode) ? 0 : 1, last = 1;
+        if (opcode_jump_target(this, index, &successors[1].first)) {
+            if (opcode == OP_FOR_NEXT) successors[1].second--;
+            last = 2;
+        }
+
+        for (auto i = first; i < last; i++) {
+            if (successors[i].first >= this->code.size() || depths.find(successors[i].first) != depths.end()) continue;
+            depths[successors[i].first] = successors[i].second;
+            pending.push_back(successors[i].first);
+        }
+    }
+
+    return max;
+}
+
 void Memory::reset()
 {
     this->code.clear();
@@ -90,17 +122,149 @@ void Memory::reset()
     this->lines.clear();
 }
 
+void Program::link()
+{
+    this->image.reset();
+
+    // The memories are placed one after the other. The jumps are relative so only
+    // the constant operands and the function entries need to be moved.
+    uint64_t functions_base = 0;
+    for (auto memory : { &this->program, &this->functions, &this->classes }) {
+        uint64_t code_base = this->image.code.size(), constants_base = this->image.constants.size();
+        if (memory == &this->functions) functions_base = code_base;
+
+        for (uint64_t i = 0; i < memory->code.size(); i += 1 + opcode_constants(memory->code[i]) + opcode_cache(memory->code[i])) {
+            for (uint8_t c = 0; c < opcode_constants(memory->code[i]); c++) memory->code[i + 1 + c] += constants_base;
+        }
+
+        this->image.code.insert(this->image.code.end(), memory->code.begin(), memory->code.end());
+        this->image.constants.insert(this->image.constants.end(), memory->constants.begin(), memory->constants.end());
+        this->image.lines.insert(this->image.lines.end(), memory->lines.begin(), memory->lines.end());
+        memory->reset();
+    }
+
+    for (auto &function : this->function_table) function.entry += functions_base;
+}
+
+std::vector<int64_t> Program::instruction_owners()
+{
+    auto size = this->image.code.size();
+    std::vector<int64_t> owners(size, -1);
+    std::vector<uint64_t> entries = { 0 };
+    for (auto &function : this->function_table) entries.push_back(function.entry);
+
+    // The instructions of a function are the ones reached from it's entry without calls
+    // (the nested functions are jumped over).
+    for (uint64_t function = 0; function < entries.size(); function++) {
+        std::vector<uint64_t> pending = { entries[function] };
+        while (!pending.empty()) {
+            auto i = pending.back();
+            pending.pop_back();
+            if (i >= size || owners[i] != -1) continue;
+            owners[i] = function;
+            uint64_t target;
+            auto opcode = this->image.code[i];
+            if (opcode_jump_target(&this->image, i, &target)) pending.push_back(target);
+            if (opcode_falls_through(opcode)) pending.push_back(i + 1 + opcode_constants(opcode) + opcode_cache(opcode));
+        }
+    }
+
+    return owners;
+}
+
 void Program::reset()
 {
     this->program.reset();
     this->functions.reset();
     this->classes.reset();
+    this->image.reset();
+    this->function_table.clear();
+}
+
+uint8_t opcode_constants(uint64_t opcode)
+{
+    switch (opcode) {
+        case OP_PUSH: case OP_LOAD: case OP_STORE: case OP_ONLY_STORE:
+        case OP_BRANCH_FALSE: case OP_BRANCH_TRUE: case OP_RJUMP:
+        case OP_ACCESS: case OP_LIST: case OP_DICTIONARY: case OP_STORE_ACCESS:
+        case OP_GET_SLOT: case OP_SET_SLOT: case OP_GET_FIELD: case OP_SET_FIELD: { return 1; }
+        case OP_CALL: case OP_DECLARE: case OP_FOR_NEXT: case OP_CLASS: case OP_INVOKE:
+        case OP_CALL_FUNCTION: case OP_CALL_NATIVE: { return 2; }
+        case OP_FUNCTION: { return 3; }
+        default: { return 0; }
+    }
+}
+
+uint8_t opcode_cache(uint64_t opcode)
+{
+    switch (opcode) {
+        case OP_CALL: case OP_CALL_FUNCTION: case OP_CALL_NATIVE: { return CALL_CACHE_WORDS; }
+        case OP_GET_FIELD: case OP_SET_FIELD: { return FIELD_CACHE_WORDS; }
+        case OP_INVOKE: { return INVOKE_CACHE_WORDS; }
+        default: { return 0; }
+    }
+}
+
+void opcode_stack_effect(Memory *memory, uint64_t index, int64_t *pops, int64_t *pushes)
+{
+    auto operand = [&](uint8_t n) { return memory->constants[memory->code[index + 1 + n]].value_int; };
+    *pops = 0;
+    *pushes = 0;
+
+    switch (memory->code[index]) {
+        case OP_PUSH: case OP_LOAD: case OP_FUNCTION: { *pushes = 1; break; }
+        case OP_POP: case OP_ONLY_STORE: case OP_BRANCH_TRUE: case OP_BRANCH_FALSE:
+        case OP_PRINT: case OP_YIELD: case OP_RETURN: { *pops = 1; break; }
+        case OP_MINUS: case OP_NOT: case OP_STORE: case OP_ACCESS: case OP_ITER:
+        case OP_GET_SLOT: case OP_GET_FIELD: case OP_LEN: { *pops = 1; *pushes = 1; break; }
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_EQ: case OP_NEQ:
+        case OP_LT: case OP_LTE: case OP_HT: case OP_HTE: case OP_STORE_ACCESS:
+        case OP_SET_SLOT: case OP_SET_FIELD:
+        case OP_ADD_INT: case OP_SUB_INT: case OP_MUL_INT: case OP_EQ_INT: case OP_NEQ_INT:
+        case OP_LT_INT: case OP_LTE_INT: case OP_HT_INT: case OP_HTE_INT:
+        case OP_ADD_FLOAT: case OP_SUB_FLOAT: case OP_MUL_FLOAT: case OP_EQ_FLOAT: case OP_NEQ_FLOAT:
+        case OP_LT_FLOAT: case OP_LTE_FLOAT: case OP_HT_FLOAT: case OP_HTE_FLOAT: { *pops = 2; *pushes = 1; break; }
+        case OP_LIST: { *pops = operand(0); *pushes = 1; break; }
+        case OP_DICTIONARY: { *pops = operand(0) * 2; *pushes = 1; break; }
+        case OP_CALL: case OP_CALL_FUNCTION: case OP_CALL_NATIVE: case OP_CLASS: { *pops = operand(1); *pushes = 1; break; }
+        case OP_INVOKE: { *pops = operand(1) + 1; *pushes = 1; break; }
+        default: { break; }
+    }
+}
+
+bool opcode_jump_target(Memory *memory, uint64_t index, uint64_t *target)
+{
+    auto opcode = memory->code[index];
+    switch (opcode) {
+        case OP_RJUMP: case OP_BRANCH_TRUE: case OP_BRANCH_FALSE: case OP_FOR_NEXT: {
+            // The offset is relative to the last constant operand.
+            auto offset = memory->constants[memory->code[index + opcode_constants(opcode)]].value_int;
+            *target = index + opcode_constants(opcode) + offset;
+            return true;
+        }
+        default: { return false; }
+    }
+}
+
+bool opcode_falls_through(uint64_t opcode)
+{
+    return opcode != OP_RETURN && opcode != OP_RJUMP && opcode != OP_EXIT;
+}
+
+uint64_t opcode_generic(uint64_t opcode)
+{
+    static const uint64_t generic[] = { OP_ADD, OP_SUB, OP_MUL, OP_EQ, OP_NEQ, OP_LT, OP_LTE, OP_HT, OP_HTE };
+    if (opcode >= OP_ADD_INT && opcode <= OP_HTE_INT) return generic[opcode - OP_ADD_INT];
+    if (opcode >= OP_ADD_FLOAT && opcode <= OP_HTE_FLOAT) return generic[opcode - OP_ADD_FLOAT];
+    if (opcode == OP_CALL_FUNCTION || opcode == OP_CALL_NATIVE) return OP_CALL;
+
+    return opcode;
 }
 
 std::string opcode_to_string(uint64_t opcode)
 {
     if (opcode > (opcode_names.size() - 1)) {
-        logger->warning("Opcode: " + std::to_string(opcode) + "Cannot be converted to string. Make sure you have a correct opcode number");
+        LOG_WARNING("Opcode: " + std::to_string(opcode) + "Cannot be converted to string. Make sure you have a correct opcode number");
         return "";
     }
 
@@ -10,14 +10,18 @@ const std::unordered_map<std::string, ValueType> Type::value_types = {
     { "list", VALUE_LIST },
     { "dict", VALUE_DICT },
     { "fun", VALUE_FUN },
+    { "iter", VALUE_ITER },
+    { "class", VALUE_CLASS },
 };
 
 const std::vector<std::string> Type::types_string = {
     "VALUE_NONE", "VALUE_INT", "VALUE_FLOAT", "VALUE_BOOL",
-    "VALUE_STRING", "VALUE_LIST", "VALUE_DICT", "VALUE_FUN"
+    "VALUE_STRING", "VALUE_LIST", "VALUE_DICT", "VALUE_FUN",
+    "VALUE_ITER", "VALUE_CLASS", "VALUE_OBJECT"
 };
 
 Type::Type(std::string name)
+    : listType(nullptr)
 {
     for (auto type : Type::value_types) {
         if (name.find(type.first) == 0) {
@@ -39,6 +43,13 @@ bool Type::same_as(Type *type)
     // General case.
     if (!this->is(type->type)) return false;
 
+    // Unspecified inner types (for example a plain 'list') match any inner type.
+    else if (!this->listType || !type->listType) return true;
+
+    // Objects must be instances of the same class.
+    else if (this->is(VALUE_OBJECT))
+        return this->classType == type->classType;
+
     // Recursive check for special cases.
     else if (this->is(VALUE_LIST))
         return this->listType->same_as(type->listType);
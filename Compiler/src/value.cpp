@@ -7,15 +7,37 @@
  * https://nuua.io
  */
 #include "../include/value.hpp"
+#include "../include/output.hpp"
 #include "../../Logger/include/logger.hpp"
 #include <algorithm>
 #include <cmath>
 
 Value::Value(std::unordered_map<std::string, Value> a, std::vector<std::string> b)
-    : type(Type(VALUE_DICT)), value_dict(new ValueDictionary(a, b)) {}
+    : type(Type(VALUE_DICT)), value_dict(allocate<ValueDictionary>(OBJECT_DICT, a, b)) {}
 
-Value::Value(uint64_t index, Type return_type, Frame *frame)
-    : type(Type(VALUE_FUN)), value_fun(new ValueFunction(index, return_type, frame)) {}
+Value::Value(uint64_t index, Type return_type, Frame *frame, bool generator, uint64_t max_stack)
+    : type(Type(VALUE_FUN)), value_fun(allocate<ValueFunction>(OBJECT_FUNCTION, index, return_type, frame, generator, max_stack)) {}
+
+Value::Value(ValueObject *a)
+    : type(Type(VALUE_OBJECT, a->klass)), value_object(a) {}
+
+void ValueClass::add_field(std::string field, Type type)
+{
+    this->slots[field] = this->fields.size();
+    this->fields.push_back(field);
+    this->field_types.push_back(type);
+}
+
+void ValueClass::add_method(std::string method)
+{
+    this->method_slots[method] = this->method_slots.size();
+}
+
+ValueObject::ValueObject(ValueClass *klass)
+    : klass(klass), slots(static_cast<Value *>(pool_allocate(OBJECT_SLOTS, sizeof(Value) * klass->fields.size())))
+{
+    for (uint64_t i = 0; i < klass->fields.size(); i++) new (&this->slots[i]) Value(klass->field_types[i]);
+}
 
 Value::Value(Type type)
 {
@@ -25,10 +47,13 @@ Value::Value(Type type)
         case VALUE_INT: { this->value_int = 0; break; }
         case VALUE_FLOAT: { this->value_float = 0.0; break; }
         case VALUE_BOOL: { this->value_bool = false; break; }
-        case VALUE_STRING: { this->value_string = new std::string(""); break; }
-        case VALUE_LIST: { this->value_list = new std::vector<Value>(); break; }
-        case VALUE_DICT: { this->value_dict = new ValueDictionary(std::unordered_map<std::string, Value>(), std::vector<std::string>()); break; }
-        case VALUE_FUN: { this->value_fun = new ValueFunction(0, Type(), nullptr); break; }
+        case VALUE_STRING: { this->value_string = allocate<std::string>(OBJECT_STRING); break; }
+        case VALUE_LIST: { this->value_list = allocate<std::vector<Value>>(OBJECT_LIST); break; }
+        case VALUE_DICT: { this->value_dict = allocate<ValueDictionary>(OBJECT_DICT, std::unordered_map<std::string, Value>(), std::vector<std::string>()); break; }
+        case VALUE_FUN: { this->value_fun = allocate<ValueFunction>(OBJECT_FUNCTION, 0, Type(), nullptr); break; }
+        case VALUE_ITER: { this->value_iter = allocate<ValueIterator>(OBJECT_ITERATOR, ITERATOR_LIST, Value(std::vector<Value>())); break; }
+        case VALUE_CLASS: { this->value_class = nullptr; break; }
+        case VALUE_OBJECT: { this->value_object = nullptr; break; } // Objects are empty until constructed.
         default: { logger->error("Can't declare this value type without an initializer."); exit(EXIT_FAILURE); }
     }
 }
@@ -53,6 +78,9 @@ double Value::to_double()
         case VALUE_LIST: { return static_cast<double>(this->value_list->size()); }
         case VALUE_DICT: { return static_cast<double>(this->value_dict->values.size()); }
         case VALUE_FUN: { return static_cast<double>(reinterpret_cast<std::uintptr_t>(this->value_fun)); } // This looks a bit bad...
+        case VALUE_ITER: { return static_cast<double>(reinterpret_cast<std::uintptr_t>(this->value_iter)); }
+        case VALUE_CLASS: { return static_cast<double>(reinterpret_cast<std::uintptr_t>(this->value_class)); }
+        case VALUE_OBJECT: { return static_cast<double>(reinterpret_cast<std::uintptr_t>(this->value_object)); }
         default: { return 0.0; }
     }
 }
@@ -92,9 +120,28 @@ std::string Value::to_string()
         }
         case VALUE_FUN: {
             char fn[256];
-            sprintf(fn, "<Function: 0x%llx>", reinterpret_cast<std::uintptr_t>(this->value_fun));
+            sprintf(fn, "<Function: 0x%llx>", static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(this->value_fun)));
             return fn;
         }
+        case VALUE_ITER: {
+            char it[256];
+            sprintf(it, "<Iterator: 0x%llx>", static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(this->value_iter)));
+            return it;
+        }
+        case VALUE_CLASS: { return this->value_class ? "<Class: " + this->value_class->name + ">" : "none"; }
+        case VALUE_OBJECT: {
+            if (!this->value_object) return "none";
+            auto klass = this->value_object->klass;
+            std::string object = klass->name + " {";
+            if (klass->fields.size() > 0) {
+                for (uint64_t i = 0; i < klass->fields.size(); i++) {
+                    auto value = this->value_object->slots[i];
+                    object += klass->fields[i] + ": " + (value.is(VALUE_STRING) ? '\'' + value.to_string() + '\'' : value.to_string()) + ", ";
+                }
+                object.pop_back(); object.pop_back(); // Pop the space and the comma
+            }
+            return object + "}";
+        }
         default: { return "none"; }
     }
 }
@@ -167,7 +214,10 @@ Value Value::cast(Type type)
             }
             break;
         }
-        case VALUE_FUN: {
+        case VALUE_FUN:
+        case VALUE_ITER:
+        case VALUE_CLASS:
+        case VALUE_OBJECT: {
             switch (type.type) {
                 case VALUE_STRING: { return Value(this->to_string()); }
                 default: { break; }
@@ -185,15 +235,14 @@ Value Value::length()
     return Value(this->to_double());
 }
 
-void Value::print()
+void Value::print(Output *output)
 {
-    printf("%s", this->to_string().c_str());
+    output->write(*this);
 }
 
-void Value::println()
+void Value::println(Output *output)
 {
-    this->print();
-    printf("\n");
+    output->write_line(*this);
 }
 
 Value Value::operator -()
@@ -0,0 +1,133 @@
+/**
+ * |------------------------|
+ * | Nuua Bytecode Verifier |
+ * |------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/verifier.hpp"
+#include "../../Logger/include/logger.hpp"
+#include <unordered_map>
+
+void Verifier::error(const std::string &message, uint64_t index)
+{
+    auto image = &this->program->image;
+    logger->error(
+        "Invalid bytecode at index " + std::to_string(index) + ": " + message,
+        index < image->lines.size() ? static_cast<int>(image->lines[index]) : -1
+    );
+    exit(EXIT_FAILURE);
+}
+
+void Verifier::check_operand(uint64_t index, uint8_t operand, ValueType expected)
+{
+    auto image = &this->program->image;
+    if (!image->constants[image->code[index + 1 + operand]].is(expected)) {
+        this->error(opcode_to_string(image->code[index]) + " operand " + std::to_string(operand) + " has the wrong type.", index);
+    }
+}
+
+void Verifier::verify_instructions()
+{
+    auto image = &this->program->image;
+    this->boundaries.assign(image->code.size(), false);
+
+    if (image->lines.size() != image->code.size()) this->error("The lines don't match the code.", 0);
+
+    for (uint64_t i = 0; i < image->code.size(); i += 1 + opcode_constants(image->code[i]) + opcode_cache(image->code[i])) {
+        auto opcode = image->code[i];
+        this->boundaries[i] = true;
+
+        // The quickened opcodes are only written by the virtual machine while running.
+        if (opcode > OP_EXIT) this->error("Unknown opcode " + std::to_string(opcode) + ".", i);
+        if (i + opcode_constants(opcode) + opcode_cache(opcode) >= image->code.size()) this->error("The operands are out of the code.", i);
+        for (uint8_t operand = 0; operand < opcode_constants(opcode); operand++) {
+            if (image->code[i + 1 + operand] >= image->constants.size()) this->error("Constant operand out of bounds.", i);
+        }
+
+        switch (opcode) {
+            case OP_RJUMP: case OP_BRANCH_TRUE: case OP_BRANCH_FALSE:
+            case OP_LIST: case OP_DICTIONARY: case OP_GET_SLOT: case OP_SET_SLOT: { this->check_operand(i, 0, VALUE_INT); break; }
+            case OP_DECLARE: case OP_STORE: case OP_ONLY_STORE: case OP_LOAD: case OP_STORE_ACCESS:
+            case OP_ACCESS: case OP_GET_FIELD: case OP_SET_FIELD: { this->check_operand(i, 0, VALUE_STRING); break; }
+            case OP_CALL: case OP_FOR_NEXT: case OP_INVOKE: { this->check_operand(i, 0, VALUE_STRING); this->check_operand(i, 1, VALUE_INT); break; }
+            case OP_CLASS: { this->check_operand(i, 0, VALUE_CLASS); this->check_operand(i, 1, VALUE_INT); break; }
+            case OP_FUNCTION: {
+                this->check_operand(i, 0, VALUE_INT);
+                this->check_operand(i, 2, VALUE_BOOL);
+                if (static_cast<uint64_t>(image->constants[image->code[i + 1]].value_int) >= this->program->function_table.size()) {
+                    this->error("Unknown function.", i);
+                }
+                break;
+            }
+            default: { break; }
+        }
+
+        // The counts can't be negative.
+        if ((opcode == OP_LIST || opcode == OP_DICTIONARY) && image->constants[image->code[i + 1]].value_int < 0) {
+            this->error("Negative element count.", i);
+        }
+        if ((opcode == OP_CALL || opcode == OP_CLASS || opcode == OP_INVOKE) && image->constants[image->code[i + 2]].value_int < 0) {
+            this->error("Negative argument count.", i);
+        }
+    }
+}
+
+void Verifier::verify_stack(uint64_t entry, int64_t depth, uint64_t max_stack)
+{
+    // The maximum depth doesn't count the values already in the stack at the entry.
+    auto image = &this->program->image;
+    auto limit = depth + static_cast<int64_t>(max_stack);
+    std::unordered_map<uint64_t, int64_t> depths = { { entry, depth } };
+    std::vector<uint64_t> pending = { entry };
+
+    while (!pending.empty()) {
+        auto index = pending.back();
+        pending.pop_back();
+
+        auto opcode = image->code[index];
+        int64_t pops, pushes;
+        opcode_stack_effect(image, index, &pops, &pushes);
+        depth = depths[index];
+        if (depth < pops) this->error("Stack underflow.", index);
+        depth += pushes - pops;
+        if (depth > limit) this->error("The stack is deeper than the recorded maximum.", index);
+
+        std::pair<uint64_t, int64_t> successors[2] = {
+            { index + 1 + opcode_constants(opcode) + opcode_cache(opcode), depth }, { 0, depth }
+        };
+        uint8_t first = opcode_falls_through(opcode) ? 0 : 1, last = 1;
+        if (opcode_jump_target(image, index, &successors[1].first)) {
+            if (opcode == OP_FOR_NEXT) successors[1].second--;
+            last = 2;
+        }
+
+        for (auto i = first; i < last; i++) {
+            auto target = successors[i].first;
+            if (target >= image->code.size()) this->error("The execution goes past the end of the code.", index);
+            if (!this->boundaries[target]) this->error("The jump target is not an instruction.", index);
+            auto known = depths.find(target);
+            if (known == depths.end()) {
+                depths[target] = successors[i].second;
+                pending.push_back(target);
+            } else if (known->second != successors[i].second) {
+                this->error("The stack depth differs between the paths that reach index " + std::to_string(target) + ".", index);
+            }
+        }
+    }
+}
+
+void Verifier::verify()
+{
+    this->verify_instructions();
+
+    if (!this->program->image.code.empty()) this->verify_stack(0, 0, this->program->max_stack);
+
+    for (auto &function : this->program->function_table) {
+        if (function.entry >= this->program->image.code.size() || !this->boundaries[function.entry]) {
+            this->error("The function entry " + std::to_string(function.entry) + " is not an instruction.", function.entry);
+        }
+        this->verify_stack(function.entry, function.arity, function.max_stack);
+    }
+}
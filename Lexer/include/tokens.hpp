@@ -62,7 +62,8 @@ typedef enum : uint8_t {
     TOKEN_BIG_RIGHT_ARROW, // =>
     TOKEN_COLON, // :
     TOKEN_RETURN, // return
-    TOKEN_PRINT // print
+    TOKEN_PRINT, // print
+    TOKEN_YIELD // yield
 } TokenType;
 
 class Token
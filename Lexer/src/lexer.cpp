@@ -34,7 +34,8 @@ const std::unordered_map<std::string, TokenType> Lexer::reserved_words = {
     { "return", TOKEN_RETURN },
     { "print", TOKEN_PRINT },
     { "class", TOKEN_CLASS },
-    { "self", TOKEN_SELF }
+    { "self", TOKEN_SELF },
+    { "yield", TOKEN_YIELD }
 };
 
 const std::string Lexer::token_error()
@@ -122,7 +123,7 @@ TokenType Lexer::is_identifier()
 
 std::vector<Token> Lexer::scan(const char *source)
 {
-    logger->info("Started scanning...");
+    LOG_INFO("Started scanning...");
 
     this->start = source;
     this->current = source;
@@ -179,7 +180,7 @@ std::vector<Token> Lexer::scan(const char *source)
         Token::debug_tokens(tokens);
     #endif
 
-    logger->success("Scanning complete");
+    LOG_SUCCESS("Scanning complete");
 
     return tokens;
 }
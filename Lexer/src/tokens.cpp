@@ -53,7 +53,8 @@ std::vector<std::string> Token::token_names = {
     "TOKEN_BIG_RIGHT_ARROW",
     "TOKEN_COLON",
     "TOKEN_RETURN",
-    "TOKEN_PRINT"
+    "TOKEN_PRINT",
+    "TOKEN_YIELD"
 };
 
 const std::unordered_map<char, char> Token::escaped_chars = {
@@ -11,36 +11,48 @@
 
 #include <string>
 
-// This controlls if we are debugginf the app depending on a preprocessor flag.
-#if DEBUG
-#define DEBUG_MODE() true
-#else
-#define DEBUG_MODE() false
+// The logging levels, every level also shows the ones above it.
+#define LOG_LEVEL_INFO 0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_ERROR 2
+
+// The level is chosen when compiling (with -D LOG_LEVEL=<level>), the debug builds show everything.
+#ifndef LOG_LEVEL
+    #if DEBUG
+        #define LOG_LEVEL LOG_LEVEL_INFO
+    #else
+        #define LOG_LEVEL LOG_LEVEL_WARNING
+    #endif
 #endif
 
-// The logger class.
+// Logs a message of the given level. The disabled levels compile to nothing,
+// not even the message is built (the arguments are never evaluated).
+#define LOG_INFO(...) do { if constexpr (LOG_LEVEL <= LOG_LEVEL_INFO) logger->info(__VA_ARGS__); } while (false)
+#define LOG_SUCCESS(...) do { if constexpr (LOG_LEVEL <= LOG_LEVEL_INFO) logger->success(__VA_ARGS__); } while (false)
+#define LOG_WARNING(...) do { if constexpr (LOG_LEVEL <= LOG_LEVEL_WARNING) logger->warning(__VA_ARGS__); } while (false)
+
+// The logger class. The messages are written to the buffered standard
+// output, so they keep their order with the program output.
 class Logger
 {
-    // Set the logger in debug mode or not.
-    bool debug = DEBUG_MODE();
-
     public:
+        // Called before a message is written (writes the buffered program output first).
+        void (*synchronize)() = nullptr;
+
         // Outputs an information message to the screen.
-        void info(const std::string error, int line = -1);
+        void info(const std::string &error, int line = -1);
 
         // Outputs a success message to the screen.
-        void success(const std::string error, int line = -1);
+        void success(const std::string &error, int line = -1);
 
         // Outputs a warning message to the screen.
-        void warning(const std::string error, int line = -1);
+        void warning(const std::string &error, int line = -1);
 
         // Outputs an error message to the screen.
-        void error(const std::string error, int line = -1);
+        void error(const std::string &error, int line = -1);
 };
 
 // logger will be a global class instance.
 extern Logger *logger;
 
-#undef DEBUG_MODE
-
 #endif
@@ -11,11 +11,16 @@
 
 Logger *logger = new Logger;
 
-#define DEBUG_CHECK() if (!this->debug) return
+// Returns from a logger method if the level is disabled.
+#define LEVEL_CHECK(level) if constexpr (LOG_LEVEL > level) return
 
-void Logger::info(const std::string error, int line)
+// Writes the buffered program output before the message.
+#define SYNCHRONIZE() if (this->synchronize) this->synchronize()
+
+void Logger::info(const std::string &error, int line)
 {
-    DEBUG_CHECK();
+    LEVEL_CHECK(LOG_LEVEL_INFO);
+    SYNCHRONIZE();
     std::cout
         << rang::style::bold
         << rang::fg::cyan
@@ -25,12 +30,13 @@ void Logger::info(const std::string error, int line)
         << rang::style::reset
         << rang::style::bold;
     if (line >= 0) std::cout << " [Line " << line << "]";
-    std::cout << rang::style::reset << std::endl;
+    std::cout << rang::style::reset << '\n';
 }
 
-void Logger::success(const std::string error, int line)
+void Logger::success(const std::string &error, int line)
 {
-    DEBUG_CHECK();
+    LEVEL_CHECK(LOG_LEVEL_INFO);
+    SYNCHRONIZE();
     std::cout
         << rang::style::bold
         << rang::fg::green
@@ -40,12 +46,13 @@ void Logger::success(const std::string error, int line)
         << rang::style::reset
         << rang::style::bold;
     if (line >= 0) std::cout << " [Line " << line << "]";
-    std::cout << rang::style::reset << std::endl;
+    std::cout << rang::style::reset << '\n';
 }
 
-void Logger::warning(const std::string error, int line)
+void Logger::warning(const std::string &error, int line)
 {
-    DEBUG_CHECK();
+    LEVEL_CHECK(LOG_LEVEL_WARNING);
+    SYNCHRONIZE();
     std::cout
         << rang::style::bold
         << " > "
@@ -54,11 +61,12 @@ void Logger::warning(const std::string error, int line)
         << rang::style::reset
         << rang::style::bold;
     if (line >= 0) std::cout << " [Line " << line << "]";
-    std::cout << rang::style::reset << std::endl;
+    std::cout << rang::style::reset << '\n';
 }
 
-void Logger::error(const std::string error, int line)
+void Logger::error(const std::string &error, int line)
 {
+    SYNCHRONIZE();
     std::cout
         << rang::style::bold
         << rang::fg::red
@@ -68,7 +76,8 @@ void Logger::error(const std::string error, int line)
         << rang::style::reset
         << rang::style::bold;
     if (line >= 0) std::cout << " [Line " << line << "]";
-    std::cout << rang::style::reset << std::endl;
+    std::cout << rang::style::reset << '\n';
 }
 
-#undef DEBUG_CHECK
+#undef LEVEL_CHECK
+#undef SYNCHRONIZE
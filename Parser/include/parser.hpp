@@ -29,6 +29,8 @@ class Parser
     bool is_function();
 
     // Parser basic operations.
+    std::vector<Declaration *> grouped_declaration();
+    Expression *class_body(std::string name);
     Expression *function();
     Expression *list();
     Expression *dictionary();
@@ -50,12 +52,19 @@ class Parser
     Statement *return_statement();
     Statement *if_statement();
     Statement *while_statement();
+    Statement *for_statement();
     Statement *statement(bool new_line_ending = true);
 
     static void debug_rules(std::vector<Rule> rules);
     static void debug_rules(std::vector<Statement *> rules);
 
     public:
+        // Stores the tokens scanned and the AST nodes parsed by the last parse.
+        uint64_t tokens = 0, nodes = 0;
+
+        // Stores the time (in seconds) spent scanning, parsing and optimizing the AST by the last parse.
+        double scanning_time = 0, parsing_time = 0, optimizing_time = 0;
+
         std::vector<Statement *> parse(const char *source);
 };
 
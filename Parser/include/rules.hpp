@@ -10,6 +10,7 @@
 #define RULES_HPP
 
 #include "../../Lexer/include/tokens.hpp"
+#include "../../Compiler/include/pool.hpp"
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -40,15 +41,34 @@ typedef enum : uint8_t {
     RULE_RETURN,
     RULE_IF,
     RULE_WHILE,
+    RULE_YIELD,
+    RULE_FOR,
+    RULE_CLASS,
+    RULE_PROPERTY,
+    RULE_ASSIGN_PROPERTY,
+    RULE_INVOKE,
 } Rule;
 
+// AST nodes are allocated in the current region (if any) and
+// destroyed all at once when the region is released.
+void *ast_allocate(size_t size, void (*destructor)(void *));
+
+// The line given to the new AST nodes (the parser keeps it at the line of the last token it consumed).
+extern uint32_t ast_line;
+
+// Number of AST nodes allocated.
+extern uint64_t ast_nodes;
+
 class Expression
 {
     public:
         uint32_t line;
         Rule rule;
 
-        Expression(Rule rule = RULE_EXPRESSION) : rule(rule) {};
+        Expression(Rule rule = RULE_EXPRESSION) : line(ast_line), rule(rule) {};
+        virtual ~Expression() {};
+        static void *operator new(size_t size) { return ast_allocate(size, &destroy<Expression>); }
+        static void operator delete(void *) {};
 };
 
 class Statement
@@ -58,7 +78,10 @@ class Statement
         Rule rule;
 
         Statement(Rule rule = RULE_STATEMENT)
-            : rule(rule) {};
+            : line(ast_line), rule(rule) {};
+        virtual ~Statement() {};
+        static void *operator new(size_t size) { return ast_allocate(size, &destroy<Statement>); }
+        static void operator delete(void *) {};
 };
 
 /* Expressions */
@@ -226,6 +249,51 @@ class Access : public Expression
             : Expression(RULE_ACCESS), name(name), index(index) {};
 };
 
+class Property : public Expression
+{
+    public:
+        Expression *object;
+        std::string name;
+
+        Property(Expression *object, std::string name)
+            : Expression(RULE_PROPERTY), object(object), name(name) {};
+};
+
+class AssignProperty : public Expression
+{
+    public:
+        Expression *object;
+        std::string name;
+        Expression *value;
+
+        AssignProperty(Expression *object, std::string name, Expression *value)
+            : Expression(RULE_ASSIGN_PROPERTY), object(object), name(name), value(value) {};
+};
+
+class Invoke : public Expression
+{
+    public:
+        Expression *object;
+        std::string name;
+        std::vector<Expression *> arguments;
+
+        Invoke(Expression *object, std::string name, std::vector<Expression *> arguments)
+            : Expression(RULE_INVOKE), object(object), name(name), arguments(arguments) {};
+};
+
+class Declaration;
+
+class Class : public Expression
+{
+    public:
+        std::string name;
+        std::vector<Declaration *> fields;
+        std::vector<Declaration *> methods;
+
+        Class(std::string name, std::vector<Declaration *> fields, std::vector<Declaration *> methods)
+            : Expression(RULE_CLASS), name(name), fields(fields), methods(methods) {};
+};
+
 /* Statements */
 
 class Print : public Statement
@@ -287,6 +355,26 @@ class While : public Statement
             : Statement(RULE_WHILE), condition(condition), body(body) {};
 };
 
+class Yield : public Statement
+{
+    public:
+        Expression *value;
+
+        Yield(Expression *value)
+            : Statement(RULE_YIELD), value(value) {}
+};
+
+class For : public Statement
+{
+    public:
+        std::string variable;
+        Expression *iterable;
+        std::vector<Statement *> body;
+
+        For(std::string variable, Expression *iterable, std::vector<Statement *> body)
+            : Statement(RULE_FOR), variable(variable), iterable(iterable), body(body) {};
+};
+
 void debug_rules(std::vector<Rule> rules);
 void debug_rules(std::vector<Statement *> rules);
 
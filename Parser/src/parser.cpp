@@ -9,11 +9,12 @@
 #include "../include/parser.hpp"
 #include "../../Lexer/include/lexer.hpp"
 #include "../../Logger/include/logger.hpp"
+#include <chrono>
 
 #define CURRENT() (*(this->current))
 #define PREVIOUS() (*(this->current - 1))
 #define CHECK(token) (CURRENT().is(token))
-#define NEXT() (*(this->current++))
+#define NEXT() (ast_line = this->current->line, *(this->current++))
 #define IS_AT_END() (this->current->is(TOKEN_EOF))
 #define LOOKAHEAD(n) (*(this->current + n))
 
@@ -76,24 +77,96 @@ bool Parser::is_function()
         || LOOKAHEAD(current + 3).is(TOKEN_RIGHT_ARROW));
 }
 
+std::vector<Declaration *> Parser::grouped_declaration()
+{
+    // Multiple names may share the same type, for example: a, b: int
+    std::vector<std::string> names;
+    do {
+        names.push_back(this->consume(TOKEN_IDENTIFIER, "Expected an identifier in a declaration").to_string());
+    } while (this->match(TOKEN_COMMA));
+
+    this->consume(TOKEN_COLON, "Expected ':' after identifier in a declaration");
+    auto type = this->consume(TOKEN_IDENTIFIER, "Expected a type after the ':' in a declaration").to_string();
+    Expression *initializer = nullptr;
+
+    if (names.size() == 1 && this->match(TOKEN_EQUAL)) initializer = this->expression();
+
+    std::vector<Declaration *> declarations;
+    for (auto name : names) declarations.push_back(new Declaration(name, type, initializer));
+
+    return declarations;
+}
+
+Expression *Parser::class_body(std::string name)
+{
+    std::vector<Declaration *> fields;
+    std::vector<Declaration *> methods;
+
+    this->consume(TOKEN_LEFT_BRACE, "Expected a '{' to define the class body");
+    this->consume(TOKEN_NEW_LINE, "Expected a new line after the '{'");
+
+    for (;;) {
+        while (this->match(TOKEN_NEW_LINE));
+        if (this->match(TOKEN_RIGHT_BRACE)) break;
+        if (IS_AT_END()) {
+            logger->error("Unterminated class body. Expected '}'", this->current->line);
+            exit(EXIT_FAILURE);
+        }
+
+        for (auto declaration : this->grouped_declaration()) {
+            if (!declaration->initializer) {
+                // Fields use the class name instead of Self.
+                if (declaration->type == "Self") declaration->type = name;
+                fields.push_back(declaration);
+                continue;
+            }
+
+            if (declaration->initializer->rule != RULE_FUNCTION) {
+                logger->error("Class fields can't have an initializer. Only methods can be assigned.", this->current->line);
+                exit(EXIT_FAILURE);
+            }
+
+            // Methods get the object as an implicit 'self' argument.
+            auto method = static_cast<Function *>(declaration->initializer);
+            for (auto argument : method->arguments) {
+                auto argument_declaration = static_cast<Declaration *>(argument);
+                if (argument_declaration->type == "Self") argument_declaration->type = name;
+            }
+            if (method->return_type == "Self") method->return_type = name;
+            method->arguments.insert(method->arguments.begin(), new Declaration("self", name, nullptr));
+
+            // The constructor always returns the constructed object.
+            if (declaration->name == "constructor") {
+                method->return_type = name;
+                method->body.push_back(new Return(new Variable("self")));
+            }
+
+            methods.push_back(declaration);
+        }
+
+        if (!CHECK(TOKEN_RIGHT_BRACE)) this->consume(TOKEN_NEW_LINE, "Expected a new line after the class member");
+    }
+
+    return new Class(name, fields, methods);
+}
+
 Expression *Parser::function()
 {
+    // The function is defined at the line where it starts (not where it's body ends).
+    auto line = ast_line;
     std::vector<Statement *> arguments;
     std::vector<Statement *> body;
 
     // Get the function arguments
     if (!CHECK(TOKEN_RIGHT_PAREN)) {
         do {
-            // Get statement without new line ending
-            Statement *argument = this->statement(false);
-
-            // Check if it's a correct argument type
-            if (argument->rule != RULE_DECLARATION) {
-                logger->error("Invalid argument when defining the function. Expected a declaration.", argument->line);
+            // Get the argument declarations (a few arguments may share the type)
+            if (!CHECK(TOKEN_IDENTIFIER)) {
+                logger->error("Invalid argument when defining the function. Expected a declaration.", this->current->line);
                 exit(EXIT_FAILURE);
             }
 
-            arguments.push_back(argument);
+            for (auto argument : this->grouped_declaration()) arguments.push_back(argument);
         } while (this->match(TOKEN_COMMA));
     }
 
@@ -114,7 +187,6 @@ Expression *Parser::function()
     // Get the function body
     if (this->match(TOKEN_LEFT_BRACE)) {
         this->consume(TOKEN_NEW_LINE, "Expected a new line after the '{'");
-        CURRENT().debug_token();
         body = this->get_block_body();
         this->consume(TOKEN_RIGHT_BRACE, "Unterminated block. Expected '}'");
         // This is checked already since it's an expression statement
@@ -128,7 +200,10 @@ Expression *Parser::function()
         exit(EXIT_FAILURE);
     }
 
-    return new Function(arguments, return_type, body);
+    auto function = new Function(arguments, return_type, body);
+    function->line = line;
+
+    return function;
 }
 
 Expression *Parser::list()
@@ -190,6 +265,7 @@ Expression *Parser::primary()
     if (this->match(TOKEN_FLOAT)) return new Float(std::stof(PREVIOUS().to_string()));
     if (this->match(TOKEN_STRING)) return new String(PREVIOUS().to_string());
     if (this->match(TOKEN_IDENTIFIER)) return new Variable(PREVIOUS().to_string());
+    if (this->match(TOKEN_SELF)) return new Variable("self");
     if (this->match(TOKEN_LEFT_SQUARE)) return this->list();
     if (this->match(TOKEN_LEFT_BRACE)) return this->dictionary();
     if (this->match(TOKEN_LEFT_PAREN)) {
@@ -207,7 +283,7 @@ Expression *Parser::primary()
 
 Expression *Parser::finish_call(Expression *callee)
 {
-    if (callee->rule != RULE_VARIABLE) {
+    if (callee->rule != RULE_VARIABLE && callee->rule != RULE_PROPERTY) {
         logger->error("Expected an identifier as the function name.", this->current->line);
         exit(EXIT_FAILURE);
     }
@@ -219,6 +295,11 @@ Expression *Parser::finish_call(Expression *callee)
 
     this->consume(TOKEN_RIGHT_PAREN, "Expected ')' after call arguments");
 
+    if (callee->rule == RULE_PROPERTY) {
+        auto property = static_cast<Property *>(callee);
+        return new Invoke(property->object, property->name, arguments);
+    }
+
     return new Call(static_cast<Variable *>(callee)->name, arguments);
 }
 
@@ -242,6 +323,9 @@ Expression *Parser::call()
             result = this->finish_call(result);
         } else if (this->match(TOKEN_LEFT_SQUARE)) {
             result = this->finish_access(result);
+        } else if (this->match(TOKEN_DOT)) {
+            auto name = this->consume(TOKEN_IDENTIFIER, "Expected a property name after the '.'");
+            result = new Property(result, name.to_string());
         } else {
             break;
         }
@@ -333,10 +417,13 @@ Expression *Parser::assignment()
         switch (result->rule) {
             case RULE_VARIABLE: { return new Assign(static_cast<Variable *>(result)->name, this->expression()); }
             case RULE_ACCESS: {
-                printf("Found assign access.\n");
                 auto res = static_cast<Access *>(result);
                 return new AssignAccess(res->name, res->index, this->expression());
             }
+            case RULE_PROPERTY: {
+                auto property = static_cast<Property *>(result);
+                return new AssignProperty(property->object, property->name, this->expression());
+            }
             default: { logger->error("Invalid assignment target", this->current->line); exit(EXIT_FAILURE); };
         }
     }
@@ -357,10 +444,17 @@ Statement *Parser::declaration_statement()
 {
     auto variable = this->consume(TOKEN_IDENTIFIER, "Expected an identifier in a declaration statement");
     this->consume(TOKEN_COLON, "Expected ':' after identifier in a declaration statement");
-    auto type = this->consume(TOKEN_IDENTIFIER, "Expected a type after the ':' in a declaration statement");
+    // Classes are declared with the 'class' keyword as their type.
+    auto type = this->match(TOKEN_CLASS)
+        ? PREVIOUS()
+        : this->consume(TOKEN_IDENTIFIER, "Expected a type after the ':' in a declaration statement");
     Expression *initializer = nullptr;
 
-    if (this->match(TOKEN_EQUAL)) initializer = this->expression();
+    if (this->match(TOKEN_EQUAL)) {
+        initializer = type.to_string() == "class"
+            ? this->class_body(variable.to_string())
+            : this->expression();
+    }
 
     return new Declaration(variable.to_string(), type.to_string(), initializer);
 }
@@ -391,6 +485,21 @@ Statement *Parser::while_statement()
     return new While(condition, body);
 }
 
+Statement *Parser::for_statement()
+{
+    this->consume(TOKEN_LEFT_PAREN, "Expected '(' after 'for'");
+    auto variable = this->consume(TOKEN_IDENTIFIER, "Expected an identifier after the '(' in a 'for' statement");
+    this->consume(TOKEN_LEFT_ARROW, "Expected '<-' after the 'for' variable");
+    auto iterable = this->expression();
+    this->consume(TOKEN_RIGHT_PAREN, "Expected ')' after 'for' iterable");
+    this->consume(TOKEN_LEFT_BRACE, "Expected a '{' after the ')'");
+    this->consume(TOKEN_NEW_LINE, "Expected a new line after the '{'");
+    auto body = this->get_block_body();
+    this->consume(TOKEN_RIGHT_BRACE, "Unterminated block. Expected '}'");
+
+    return new For(variable.to_string(), iterable, body);
+}
+
 Statement *Parser::statement(bool new_line_ending)
 {
     Statement *result;
@@ -398,11 +507,16 @@ Statement *Parser::statement(bool new_line_ending)
     // Remove blank lines
     while (this->match(TOKEN_NEW_LINE));
 
+    // Blocks are at the line where they start.
+    auto line = CURRENT().line;
+
     if (CHECK(TOKEN_IDENTIFIER) && LOOKAHEAD(1).is(TOKEN_COLON)) result = this->declaration_statement();
     else if (this->match(TOKEN_PRINT)) result = new Print(this->expression());
     else if (this->match(TOKEN_RETURN)) result = new Return(this->expression());
     else if (this->match(TOKEN_IF)) result = this->if_statement();
     else if (this->match(TOKEN_WHILE)) result = this->while_statement();
+    else if (this->match(TOKEN_FOR)) result = this->for_statement();
+    else if (this->match(TOKEN_YIELD)) result = new Yield(this->expression());
     else result = this->expression_statement();
 
     if (new_line_ending && !this->match_any(std::vector<TokenType>({ TOKEN_NEW_LINE, TOKEN_EOF }))) {
@@ -410,14 +524,22 @@ Statement *Parser::statement(bool new_line_ending)
         exit(EXIT_FAILURE);
     }
 
+    result->line = line;
+
     return result;
 }
 
 std::vector<Statement *> Parser::parse(const char *source)
 {
+    auto start = std::chrono::steady_clock::now();
     std::vector<Token> tokens = Lexer().scan(source);
+    auto scanned = std::chrono::steady_clock::now();
+    this->scanning_time = std::chrono::duration<double>(scanned - start).count();
+    this->tokens = tokens.size();
 
-    logger->info("Started parsing...");
+    LOG_INFO("Started parsing...");
+
+    auto nodes = ast_nodes;
 
     this->current = &tokens.front();
 
@@ -429,13 +551,19 @@ std::vector<Statement *> Parser::parse(const char *source)
         Parser::debug_rules(code);
     #endif
 
-    logger->success("Parsing completed");
+    LOG_SUCCESS("Parsing completed");
+
+    auto parsed = std::chrono::steady_clock::now();
+    this->parsing_time = std::chrono::duration<double>(parsed - scanned).count();
+    this->nodes = ast_nodes - nodes;
 
-    logger->info("Started optimizing AST...");
+    LOG_INFO("Started optimizing AST...");
 
     ParserOptimizer().optimize(&code);
 
-    logger->success("AST Optimized");
+    LOG_SUCCESS("AST Optimized");
+
+    this->optimizing_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - parsed).count();
 
     return code;
 }
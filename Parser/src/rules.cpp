@@ -7,6 +7,10 @@
  * https://nuua.io
  */
 #include "../include/parser.hpp"
+#include <stdlib.h>
+
+uint32_t ast_line = 0;
+uint64_t ast_nodes = 0;
 
 static std::vector<std::string> RuleNames = {
     "RULE_EXPRESSION",
@@ -34,8 +38,33 @@ static std::vector<std::string> RuleNames = {
     "RULE_RETURN",
     "RULE_IF",
     "RULE_WHILE",
+    "RULE_YIELD",
+    "RULE_FOR",
+    "RULE_CLASS",
+    "RULE_PROPERTY",
+    "RULE_ASSIGN_PROPERTY",
+    "RULE_INVOKE",
 };
 
+void *ast_allocate(size_t size, void (*destructor)(void *))
+{
+    ast_nodes++;
+
+    if (!current_region) {
+        auto memory = malloc(size);
+        if (!memory) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        return memory;
+    }
+
+    auto memory = current_region->allocate(size);
+    current_region->finalize(memory, destructor);
+
+    return memory;
+}
+
 void Parser::debug_rules(std::vector<Rule> rules)
 {
     for (auto rule : rules) printf("%s\n", RuleNames[rule].c_str());
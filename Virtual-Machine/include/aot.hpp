@@ -0,0 +1,180 @@
+/**
+ * |--------------------------------|
+ * | Nuua Ahead-Of-Time Compilation |
+ * |--------------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef AOT_HPP
+#define AOT_HPP
+
+#include "jit_helpers.hpp"
+#include "../../Logger/include/logger.hpp"
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// The compiled code of a program: it runs from the program counter until the until
+// frame returns (like VirtualMachine::execute). Returns false if the interpreter
+// must continue at the program counter.
+typedef bool (*AotExecute)(VirtualMachine *vm, Frame *until);
+
+// Builds the linked image, the function table and the maximum stack depth of the
+// translated program (so it starts without the lexer, the parser and the compiler).
+typedef void (*AotLoad)(Program *program);
+
+// A program translated to C++ and compiled ahead of time.
+class AotProgram
+{
+    public:
+        // The size and checksum of the linked image it was translated from.
+        uint64_t size, checksum;
+
+        // The compiled code.
+        AotExecute execute;
+
+        // Builds the program the code was translated from.
+        AotLoad load;
+};
+
+// A variable of the main code kept in a native local of the generated code.
+class AotVariable
+{
+    public:
+        // The type of the variable (VALUE_INT, VALUE_FLOAT or VALUE_BOOL).
+        ValueType type;
+
+        // The number of the local.
+        uint64_t local;
+};
+
+// A stack value known while translating: a C++ expression of a native type.
+class AotValue
+{
+    public:
+        // The expression and it's type (VALUE_INT, VALUE_FLOAT or VALUE_BOOL).
+        std::string expression;
+        ValueType type;
+
+        // The variables the expression reads.
+        std::vector<std::string> variables;
+};
+
+// Translates the linked image of a program to a C++ translation unit. Every instruction
+// becomes a label with it's C++ code, the jumps are gotos and the instructions that move
+// to another function continue at the label of the new program counter. The int, float
+// and bool variables of the main code are native locals and the expressions made of them
+// and of constants are native C++ expressions (the values are only boxed when they are
+// needed by the rest of instructions, that call the same helpers as the baseline JIT).
+// The variables of the functions stay in their frames: the calls share one C++ frame,
+// so a native local can't belong to a single activation.
+class Aot
+{
+    // The program being translated.
+    Program *program;
+
+    // Stores the generated code of the instructions.
+    std::ostringstream code;
+
+    // Determines if an instruction may be the program counter when the code is entered
+    // (so it needs a label in the dispatch) and if it's part of the main code.
+    std::vector<bool> entries, main;
+
+    // Stores the variables of the main code kept in native locals.
+    std::unordered_map<std::string, AotVariable> variables;
+
+    // Stores the stack values known while translating (they are above the real stack).
+    std::vector<AotValue> stack;
+
+    // Stores the type of every temporary local.
+    std::vector<ValueType> temporaries;
+
+    // Stores the classes used by the constants (and their number in the generated code).
+    std::unordered_map<ValueClass *, uint64_t> classes;
+    std::vector<ValueClass *> class_order;
+
+    // Finds the instruction entries, the main code and the variables that can be native locals.
+    void analyze();
+
+    // Pushes the known stack values to the real stack.
+    void flush();
+
+    // Copies the known stack values that read a variable to temporaries (before it's stored).
+    void detach(const std::string &name);
+
+    // Translates an instruction.
+    void translate_instruction(uint64_t index);
+
+    // Translates a unary or binary operator of known values. Returns false if they are not known.
+    bool translate_operator(uint64_t opcode);
+
+    // Returns the C++ expression of a constant, or an empty string if it has no native type.
+    std::string literal(Value *value);
+
+    // Returns the C++ name of a native local of a variable.
+    std::string local(const std::string &name);
+
+    // Numbers the classes used by a constant (and by the types of their fields).
+    void find_classes(Value *value);
+    void find_class(ValueClass *klass);
+
+    // Returns the C++ expression that builds a constant again.
+    std::string constant(Value *value);
+
+    // Returns the C++ string literal of a string.
+    static std::string string_literal(const std::string &value);
+
+    public:
+        // Returns the checksum of a linked image (to check the compiled code belongs to it).
+        static uint64_t checksum(Memory *image);
+
+        Aot(Program *program)
+            : program(program) {}
+
+        // Translates the program. The linked image is embedded, the program starts without compiling it again.
+        std::string translate(const std::string &name);
+};
+
+// Gives the ahead-of-time compiled code access to the virtual machine.
+class AotRuntime
+{
+    public:
+        static const uint64_t *code(VirtualMachine *vm) { return vm->code; }
+        static uint64_t index(VirtualMachine *vm) { return vm->program_counter - vm->code; }
+        static void constant(VirtualMachine *vm, const uint64_t *pc) { vm->push(OPERAND(0)); }
+        static void push(VirtualMachine *vm, Value value) { vm->push(value); }
+        static void pop(VirtualMachine *vm) { vm->pop(); }
+
+        // Pops a value casting it to the type of a native local.
+        static int64_t pop_int(VirtualMachine *vm) { auto value = vm->pop(); return value->is(VALUE_INT) ? value->value_int : value->cast(Type(VALUE_INT)).value_int; }
+        static double pop_float(VirtualMachine *vm) { auto value = vm->pop(); return value->is(VALUE_FLOAT) ? value->value_float : value->cast(Type(VALUE_FLOAT)).value_float; }
+        static bool pop_bool(VirtualMachine *vm) { auto value = vm->pop(); return value->is(VALUE_BOOL) ? value->value_bool : value->cast(Type(VALUE_BOOL)).value_bool; }
+
+        // Divides two native numbers like OP_DIV does.
+        static double divide(double a, double b)
+        {
+            if (b == 0) { logger->error("Division by zero."); exit(EXIT_FAILURE); }
+            return a / b;
+        }
+
+        // Copies a native local to the frame (functions and classes copy the frame when they are created).
+        static void sync(VirtualMachine *vm, const char *name, Value value) { vm->top_frame->heap[name] = value; }
+
+        // Fails like OP_DECLARE when a native local is declared twice.
+        static void redeclared(VirtualMachine *vm, const uint64_t *pc, const char *name)
+        {
+            vm->program_counter = const_cast<uint64_t *>(pc);
+            logger->error("Variable '" + std::string(name) + "' is already declared.", vm->get_current_line());
+            exit(EXIT_FAILURE);
+        }
+
+        // Leaves an instruction to the interpreter.
+        static bool fallback(VirtualMachine *vm, const uint64_t *pc) { vm->program_counter = const_cast<uint64_t *>(pc); return false; }
+
+        // Runs a program with it's compiled code (the main function of the generated code).
+        static int run(const AotProgram *program);
+};
+
+#endif
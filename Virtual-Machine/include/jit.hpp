@@ -0,0 +1,135 @@
+/**
+ * |-------------------|
+ * | Nuua Baseline JIT |
+ * |-------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "../../Compiler/include/program.hpp"
+#include <vector>
+#include <initializer_list>
+#include <stdint.h>
+#include <stddef.h>
+
+class VirtualMachine;
+
+// The native code tiers are only available on x86-64 Linux.
+#if defined(__x86_64__) && defined(__linux__)
+    #define JIT_SUPPORTED 1
+#else
+    #define JIT_SUPPORTED 0
+#endif
+
+// The machine code entry: it receives the virtual machine, the frame that stops
+// the execution and the native address to start at. Returns JIT_FINISHED or JIT_FALLBACK.
+typedef uint64_t (*JitEntry)(VirtualMachine *vm, Frame *until, void *target);
+
+// The execution finished (the program exited or the until frame was reached).
+#define JIT_FINISHED 0
+
+// The execution stopped at an instruction without template (the program counter points to it).
+#define JIT_FALLBACK 1
+
+// Stores machine code while it's generated and copies it to executable memory.
+class Assembler
+{
+    protected:
+        // Stores the code while it's generated.
+        std::vector<uint8_t> buffer;
+
+        // Emits raw bytes and values to the buffer.
+        void emit(std::initializer_list<uint8_t> bytes);
+        void emit32(uint32_t value);
+        void emit64(uint64_t value);
+
+        // Makes the rel32 at the given buffer position point to the given buffer offset.
+        void patch(size_t position, size_t offset);
+
+        // Copies the buffer to executable memory and clears it. Returns nullptr if it fails.
+        uint8_t *finish(size_t *size);
+
+    public:
+        // Releases the executable memory returned by finish.
+        static void release_code(uint8_t *memory, size_t size);
+};
+
+// A baseline template JIT for x86-64 Linux. Every instruction of the linked image
+// is translated into a fixed machine code template: the simple ones (constants,
+// pops and int arithmetic) run inline and the rest call back into the virtual
+// machine helpers. Jumps are native jumps and the instructions that move to
+// another function continue at the native address of the new program counter.
+// Instructions without a template give the execution back to the interpreter.
+class Jit : Assembler
+{
+    // Stores the buffer positions of the rel32 jumps and the instruction they go to.
+    std::vector<std::pair<size_t, uint64_t>> jumps;
+
+    // Stores the buffer offset of every instruction (SIZE_MAX if it's not the start of one).
+    std::vector<size_t> offsets;
+
+    // Stores the buffer offset of the exit that finishes the execution
+    // and of the one that gives it back to the interpreter.
+    size_t exit_offset = 0, fallback_offset = 0;
+
+    // The executable memory and it's size.
+    uint8_t *memory = nullptr;
+    size_t size = 0;
+
+    // Stores the memory of the code replaced by install (it may still be running).
+    std::vector<std::pair<uint8_t *, size_t>> retired;
+
+    // The virtual machine the code was generated for.
+    VirtualMachine *vm = nullptr;
+
+    // Emits a rel32 jump (or conditional jump) to an instruction or to a buffer offset.
+    void emit_jump(std::initializer_list<uint8_t> opcode, uint64_t instruction);
+    void emit_jump_offset(std::initializer_list<uint8_t> opcode, size_t offset);
+
+    // Emits a call to a helper with the virtual machine and the given address
+    // as arguments (and the until frame as the third argument).
+    void emit_call(void *helper, const uint64_t *address);
+
+    // Emits the template of an instruction, decoded from the given memory (a copy of the image
+    // or the image itself). Returns false if it has no template.
+    bool emit_instruction(Program *program, Memory *source, uint64_t index);
+
+    // Emits the inline int fast path of a binary operator.
+    void emit_int_binary(uint64_t opcode, void *helper, const uint64_t *address);
+
+    public:
+        // Number of instructions translated and without template in the last compilation.
+        uint64_t translated = 0, untranslated = 0;
+
+        // Translates the linked image of a program. Returns false if the platform is not supported
+        // (the interpreter is used). The instructions can be decoded from a copy of the image (to
+        // compile it in another thread while the interpreter quickens it) and only the selected
+        // instructions can be translated (the rest are left to the interpreter).
+        bool compile(VirtualMachine *vm, Program *program, Memory *source = nullptr, const std::vector<bool> *selected = nullptr);
+
+        // Replaces the code with the one of another compilation.
+        void install(Jit &compiled);
+
+        // Returns true if there's compiled code.
+        bool ready() { return this->memory != nullptr; }
+
+        // Returns true if an instruction of the image was translated.
+        bool covers(uint64_t index) { return this->memory && index < this->offsets.size() && this->offsets[index] != SIZE_MAX; }
+
+        // Returns the native address of an instruction of the image (the
+        // fallback to the interpreter if it's not the start of one).
+        void *address(uint64_t index);
+
+        // Runs the compiled code from the current program counter until the until frame
+        // returns. Returns false if it stopped at an instruction without template.
+        bool run(VirtualMachine *vm, Frame *until);
+
+        // Releases the compiled code.
+        void release();
+        ~Jit();
+};
+
+#endif
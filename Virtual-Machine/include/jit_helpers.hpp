@@ -0,0 +1,131 @@
+/**
+ * |--------------------------|
+ * | Nuua Native Code Helpers |
+ * |--------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef JIT_HELPERS_HPP
+#define JIT_HELPERS_HPP
+
+#include "virtual_machine.hpp"
+
+// Returns the constant operand n of the instruction whose operands start at pc.
+#define OPERAND(n) (vm->constants[pc[n]])
+
+// The helpers the JIT code and the ahead-of-time compiled code call. They receive the
+// virtual machine, the address of the instruction operands and the frame that stops
+// the execution.
+class JitHelpers
+{
+    public:
+        // Returns the offset of the top of the stack inside the virtual machine.
+        static int32_t top_stack_offset(VirtualMachine *vm)
+        {
+            return reinterpret_cast<char *>(&vm->top_stack) - reinterpret_cast<char *>(vm);
+        }
+
+        // Returns the native address of the current program counter (without
+        // compiled code, like in the ahead-of-time code, it's only non null).
+        static void *next(VirtualMachine *vm)
+        {
+            return vm->jit.ready() ? vm->jit.address(vm->program_counter - vm->code) : vm->program_counter;
+        }
+
+        static void set_program_counter(VirtualMachine *vm, const uint64_t *pc, Frame *)
+        {
+            vm->program_counter = const_cast<uint64_t *>(pc);
+        }
+
+        static void safepoint(VirtualMachine *vm, const uint64_t *pc, Frame *)
+        {
+            vm->program_counter = const_cast<uint64_t *>(pc);
+            vm->safepoint();
+        }
+
+        static bool truthy(VirtualMachine *vm, const uint64_t *, Frame *) { return vm->pop()->to_bool(); }
+        static void minus(VirtualMachine *vm, const uint64_t *, Frame *) { vm->push(-*vm->pop()); }
+        static void negate(VirtualMachine *vm, const uint64_t *, Frame *) { vm->push(!*vm->pop()); }
+        static void add(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a + *b); }
+        static void sub(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a - *b); }
+        static void mul(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a * *b); }
+        static void div(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a / *b); }
+        static void eq(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a == *b); }
+        static void neq(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a != *b); }
+        static void lt(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a < *b); }
+        static void lte(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a <= *b); }
+        static void ht(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a > *b); }
+        static void hte(VirtualMachine *vm, const uint64_t *, Frame *) { auto b = vm->pop(); auto a = vm->pop(); vm->push(*a >= *b); }
+        static void len(VirtualMachine *vm, const uint64_t *, Frame *) { vm->push(vm->pop()->length()); }
+        static void print(VirtualMachine *vm, const uint64_t *, Frame *) { vm->pop()->println(&vm->output); }
+
+        // The following ones read their operands (and errors report their line) through the program counter.
+        static void declare(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_declare(); }
+        static void store(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->store_variable(*OPERAND(0).value_string, vm->pop(), false); }
+        static void only_store(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->store_variable(*OPERAND(0).value_string, vm->pop(), true); }
+        static void load(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->push(vm->load_variable(*OPERAND(0).value_string)); }
+        static void store_access(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_store_access(); }
+        static void list(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_list(); }
+        static void dictionary(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_dictionary(); }
+        static void access(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_access(); }
+        static void iter(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_iter(); }
+        static void klass(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_class(); }
+        static void get_slot(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_slot(false); }
+        static void set_slot(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_slot(true); }
+        static void get_field(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_field(false); }
+        static void set_field(VirtualMachine *vm, const uint64_t *pc, Frame *until) { set_program_counter(vm, pc, until); vm->do_field(true); }
+
+        static void function(VirtualMachine *vm, const uint64_t *pc, Frame *) { vm->do_function(OPERAND(0).value_int, OPERAND(1).type, OPERAND(2).value_bool); }
+
+        // The helpers that may change the function return the native address to continue at (nullptr stops).
+        static void *call(VirtualMachine *vm, const uint64_t *pc, Frame *until)
+        {
+            safepoint(vm, pc, until);
+            // The call instruction may have been quickened by a previous run of the interpreter.
+            switch (*(pc - 1)) {
+                case OP_CALL_FUNCTION: { vm->do_call_function(); break; }
+                case OP_CALL_NATIVE: { vm->do_call_native(); break; }
+                default: { vm->do_call(); break; }
+            }
+            return next(vm);
+        }
+
+        static void *invoke(VirtualMachine *vm, const uint64_t *pc, Frame *until)
+        {
+            safepoint(vm, pc, until);
+            vm->do_invoke();
+            return next(vm);
+        }
+
+        static void *ret(VirtualMachine *vm, const uint64_t *pc, Frame *until)
+        {
+            set_program_counter(vm, pc, until);
+            vm->do_return();
+            return vm->top_frame == until ? nullptr : next(vm);
+        }
+
+        static void *yield(VirtualMachine *vm, const uint64_t *pc, Frame *until)
+        {
+            set_program_counter(vm, pc, until);
+            vm->do_yield();
+            return vm->top_frame == until ? nullptr : next(vm);
+        }
+
+        static void *loop(VirtualMachine *vm, const uint64_t *pc, Frame *)
+        {
+            vm->program_counter = const_cast<uint64_t *>(pc) + OPERAND(0).value_int;
+            vm->safepoint();
+            vm->tracer.loop(vm);
+            return next(vm);
+        }
+
+        static void *for_next(VirtualMachine *vm, const uint64_t *pc, Frame *until)
+        {
+            set_program_counter(vm, pc, until);
+            vm->do_for_next();
+            return next(vm);
+        }
+};
+
+#endif
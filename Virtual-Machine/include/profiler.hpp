@@ -0,0 +1,154 @@
+/**
+ * |----------------------|
+ * | Nuua Opcode Profiler |
+ * |----------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "../../Compiler/include/program.hpp"
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define PROFILER_UNIT "cycles"
+#else
+    #define PROFILER_UNIT "ns"
+#endif
+
+// Number of opcodes (the generic and the quickened ones).
+#define PROFILER_OPCODES (OP_CALL_NATIVE + 1)
+
+// Number of opcode pairs shown in the report.
+#define PROFILER_PAIRS 20
+
+// Counts the instructions run by the interpreter. The time between one instruction and the
+// next is charged to the first one (so the time of a call to native code that runs more
+// instructions stops at the first of them) and every pair of consecutive opcodes is counted.
+class OpcodeProfiler
+{
+    // Stores the executions and the accumulated time of every opcode.
+    uint64_t counts[PROFILER_OPCODES] = { 0 }, times[PROFILER_OPCODES] = { 0 };
+
+    // Stores the executions and the accumulated time of every opcode followed by every opcode
+    // (the time of a pair is the time of it's first opcode).
+    uint64_t pairs[PROFILER_OPCODES][PROFILER_OPCODES] = { { 0 } }, pair_times[PROFILER_OPCODES][PROFILER_OPCODES] = { { 0 } };
+
+    // The previous opcode (PROFILER_OPCODES if there's none) and when it started.
+    uint64_t previous = PROFILER_OPCODES, start = 0;
+
+    // Returns the current time in cycles (or nanoseconds where there's no cycle counter).
+    static uint64_t now()
+    {
+        #if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+        #else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        #endif
+    }
+
+    public:
+        // Must be called before the interpreter runs an instruction.
+        void step(uint64_t opcode)
+        {
+            auto time = OpcodeProfiler::now();
+            if (this->previous < PROFILER_OPCODES) {
+                this->times[this->previous] += time - this->start;
+                this->pairs[this->previous][opcode]++;
+                this->pair_times[this->previous][opcode] += time - this->start;
+            }
+            this->counts[opcode]++;
+            this->previous = opcode;
+            this->start = time;
+        }
+
+        // Charges the last instruction once the program finished.
+        void finish();
+
+        // Clears the counters.
+        void reset();
+
+        // Prints the opcodes sorted by their time and the most common pairs with their time.
+        void report();
+
+        // Writes the counters as JSON. Returns false if the file can't be written.
+        bool write_json(const std::string &path);
+};
+
+// Stores what the call profiler measured of a function.
+class CallRecord
+{
+    public:
+        // Number of calls (every resumption of a generator counts as one).
+        uint64_t calls = 0;
+
+        // Nanoseconds spent in the function with and without the functions it called.
+        // The recursive calls are only counted once in the inclusive time.
+        uint64_t inclusive = 0, exclusive = 0;
+
+        // Objects allocated by the function itself.
+        uint64_t allocations = 0;
+};
+
+// A function that is running, as seen by the call profiler.
+class CallActivation
+{
+    public:
+        // The function index in the function table.
+        uint64_t function;
+
+        // When it was entered and the allocations counted by then.
+        uint64_t start, allocations;
+
+        // Nanoseconds and allocations of the functions it called.
+        uint64_t children_time = 0, children_allocations = 0;
+};
+
+// Measures the wall time and the allocations of every function, the virtual machine
+// tells it when a function is entered and left (only if it's enabled).
+class CallProfiler
+{
+    // Stores the function of every entry and what was measured of every function.
+    std::unordered_map<uint64_t, uint64_t> functions;
+    std::vector<CallRecord> records;
+
+    // Stores the number of running activations of every function.
+    std::vector<uint32_t> running;
+
+    // The running functions (the last one is the current).
+    std::vector<CallActivation> activations;
+
+    // Returns the objects allocated by the current thread.
+    static uint64_t allocations();
+
+    // Returns the current time in nanoseconds.
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    public:
+        // Prepares the records of the program functions.
+        void reset(Program *program);
+
+        // Must be called when the function starting at the given entry is entered (or a generator resumed).
+        void enter(uint64_t entry);
+
+        // Must be called when the current function returns (or a generator yields).
+        void leave();
+
+        // Leaves the functions that were running when the program finished.
+        void finish();
+
+        // Prints the functions sorted by their exclusive time.
+        void report(Program *program);
+};
+
+#endif
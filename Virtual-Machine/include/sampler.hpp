@@ -0,0 +1,75 @@
+/**
+ * |------------------------|
+ * | Nuua Sampling Profiler |
+ * |------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include "../../Compiler/include/program.hpp"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// The sampler needs the profiling timer signal.
+#if defined(__unix__) || defined(__APPLE__)
+    #define SAMPLER_SUPPORTED 1
+    #include <pthread.h>
+    #include <signal.h>
+#else
+    #define SAMPLER_SUPPORTED 0
+#endif
+
+// Microseconds of CPU time between two samples.
+#define SAMPLER_INTERVAL 1000
+
+// Words of the sample buffer (the samples that don't fit are dropped).
+#define SAMPLER_BUFFER (1 << 20)
+
+class VirtualMachine;
+
+// Samples the interpreter with the profiling timer. Every signal records the position of
+// every frame (the return addresses and the program counter) in a preallocated buffer,
+// nothing is allocated in the signal handler. Once the program finished the positions
+// are resolved to their functions and lines and written as folded stacks, the format
+// flamegraph.pl reads. The code run by the JITs is charged to the last interpreted position.
+class Sampler
+{
+    // The sampler the signal handler writes to (nullptr if it's stopped).
+    static Sampler *active;
+
+    // The virtual machine being sampled and the thread that runs it.
+    VirtualMachine *vm = nullptr;
+    #if SAMPLER_SUPPORTED
+        pthread_t thread;
+        struct sigaction previous;
+    #endif
+
+    // Stores the samples: the number of frames followed by their positions (from the main code to the current one).
+    std::vector<uint64_t> buffer;
+    uint64_t used = 0;
+
+    // The signal handler (the signal is sent to the interpreter thread if another one received it).
+    static void handle(int signal);
+
+    // Records the current stack.
+    void sample();
+
+    public:
+        // Stores the recorded and the dropped samples.
+        uint64_t samples = 0, dropped = 0;
+
+        // Starts sampling the virtual machine. Returns false if the platform has no profiling timer.
+        bool start(VirtualMachine *vm);
+
+        // Stops the timer.
+        void stop();
+
+        // Writes the samples as folded stacks. Returns false if the file can't be written.
+        bool write_folded(Program *program, const std::string &path);
+};
+
+#endif
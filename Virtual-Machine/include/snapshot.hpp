@@ -0,0 +1,63 @@
+/**
+ * |--------------------|
+ * | Nuua Heap Snapshot |
+ * |--------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "../../Compiler/include/program.hpp"
+#include "../../Compiler/include/pool.hpp"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Number of objects listed as the largest ones in the report.
+#define SNAPSHOT_TOP 20
+
+// Describes a reachable object.
+class SnapshotObject
+{
+    public:
+        // The kind of the object.
+        ObjectKind kind;
+
+        // The line that allocated it (0 if it's not known, like the constants).
+        uint32_t line;
+
+        // The bytes it uses: the object and the memory it owns (characters, elements, entries or slots).
+        uint64_t bytes;
+
+        // A short description of it's contents.
+        std::string description;
+};
+
+// Stores the objects a program can reach at some point. The report groups them by
+// kind and lists the largest ones, the written file groups them by kind and allocation
+// line (sorted, so two snapshots can be compared with the diff).
+class HeapSnapshot
+{
+    public:
+        // Stores the reachable objects.
+        std::vector<SnapshotObject> objects;
+
+        // Describes the given reachable objects of a program.
+        void take(Program *program, const std::vector<void *> &objects);
+
+        // Returns the approximate bytes used by an object and the memory it owns.
+        static uint64_t object_bytes(const void *object);
+
+        // Prints the objects and bytes of every kind and the largest objects.
+        void report(uint64_t top = SNAPSHOT_TOP);
+
+        // Writes the objects and bytes of every kind and line. Returns false if the file can't be written.
+        bool write(const std::string &path);
+
+        // Prints what changed between two written snapshots. Returns false if one can't be read.
+        static bool diff(const std::string &before, const std::string &after);
+};
+
+#endif
@@ -0,0 +1,40 @@
+/**
+ * |--------------------------|
+ * | Nuua Pipeline Statistics |
+ * |--------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef STATISTICS_HPP
+#define STATISTICS_HPP
+
+#include <string>
+#include <stdint.h>
+
+// Describes a run of a program: the time spent in every phase, the size of what every
+// phase produced and what the execution did. The executed instructions and the peak
+// depths are counted by the interpreter (the code run by the JITs is not counted).
+class PipelineStatistics
+{
+    public:
+        // Seconds spent scanning, parsing, optimizing the AST, compiling, verifying and running.
+        double scanning_time = 0, parsing_time = 0, optimizing_time = 0, compiling_time = 0, verifying_time = 0, running_time = 0;
+
+        // Tokens scanned, AST nodes parsed, instructions, code words, constants and functions of the linked image.
+        uint64_t tokens = 0, nodes = 0, instructions = 0, code_words = 0, constants = 0, functions = 0;
+
+        // Instructions run by the interpreter and the deepest operand stack (in slots) and frame list it reached.
+        uint64_t executed = 0, peak_stack = 0, peak_frames = 0;
+
+        // Objects allocated while running, bytes allocated in the nursery and collections done.
+        uint64_t allocations = 0, allocated_bytes = 0, minor_collections = 0, major_collections = 0;
+
+        // Prints the statistics.
+        void report();
+
+        // Writes the statistics as JSON. Returns false if the file can't be written.
+        bool write_json(const std::string &path);
+};
+
+#endif
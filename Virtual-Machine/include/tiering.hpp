@@ -0,0 +1,91 @@
+/**
+ * |-----------------------|
+ * | Nuua Tiered Execution |
+ * |-----------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef TIERING_HPP
+#define TIERING_HPP
+
+#include "jit.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Calls to a function before it's queued for compilation.
+#define TIER_HOT_CALLS 1000
+
+// Backward jumps inside a function (or the main code) before it's queued for compilation.
+#define TIER_HOT_LOOP 1000
+
+// Decides when the code is compiled with the baseline JIT without stopping the interpreter.
+// It counts the calls and the backward jumps of every function (and of the main code) and
+// queues the hot ones to a compiler thread. The thread translates the queued functions from
+// a copy of the image (the interpreter keeps quickening the real one) and the interpreter
+// installs the new code at the next call or backward jump, continuing in it.
+class Tiering
+{
+    // Stores the function (0 is the main code) of every instruction (-1 if it's not known).
+    std::vector<int64_t> owners;
+
+    // Stores the first instruction of every function.
+    std::vector<uint64_t> entries;
+
+    // Stores the calls and backward jumps counted for every function.
+    std::vector<uint32_t> calls, loops;
+
+    // Determines if a function was queued and if an instruction belongs to a queued function.
+    std::vector<bool> queued, selected;
+
+    // The virtual machine and the program being compiled.
+    VirtualMachine *vm = nullptr;
+    Program *program = nullptr;
+
+    // The compiler thread and the state it shares with the interpreter.
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    // The copy of the image and the instructions of the next compilation (nullptr if there's none).
+    std::unique_ptr<Memory> request;
+    std::vector<bool> request_selected;
+
+    // Determines if the thread is compiling and if it must stop.
+    bool compiling = false, stopping = false;
+
+    // The code of the last compilation, waiting to be installed.
+    std::unique_ptr<Jit> compiled;
+    std::atomic<bool> finished { false };
+
+    // Queues a function to be compiled (with the ones queued before).
+    void queue(uint64_t function);
+
+    // The loop of the compiler thread.
+    void work();
+
+    public:
+        // Stores the number of functions queued, the compilations (done by the thread) and the installed ones.
+        uint64_t hot_functions = 0, installations = 0;
+        std::atomic<uint64_t> compilations { 0 };
+
+        // Waits for the compilation in progress and forgets the program.
+        void cancel();
+
+        // Finds the functions of a new program.
+        void reset(VirtualMachine *vm, Program *program);
+
+        // Must be called when the program counter is the given instruction after a call or a backward jump.
+        void call(uint64_t index);
+        void loop(uint64_t index);
+
+        // Installs the finished compilation, if any. Returns true if it did.
+        bool install(Jit *jit);
+
+        ~Tiering();
+};
+
+#endif
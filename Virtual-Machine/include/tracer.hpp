@@ -0,0 +1,198 @@
+/**
+ * |------------------|
+ * | Nuua Tracing JIT |
+ * |------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include "jit.hpp"
+#include <memory>
+#include <string>
+
+// Backward jumps to a loop header before it's traced.
+#define TRACE_HOT_LOOP 1000
+
+// Times a side exit that stays inside the loop is taken before the loop is traced again.
+#define TRACE_HOT_EXIT 100
+
+// Maximum number of times a loop is traced (or it's trace is aborted).
+#define TRACE_MAX_RECORDS 4
+
+// Maximum number of recorded instructions, variables and stack values of a trace.
+#define TRACE_MAX_LENGTH 512
+#define TRACE_MAX_VARIABLES 32
+#define TRACE_MAX_STACK 16
+
+// The machine code of a trace: it receives the unboxed variables and the buffer where
+// the temporary stack values are written when it exits. Returns the index of the exit.
+typedef uint64_t (*TraceCode)(int64_t *variables, int64_t *stack);
+
+// Defines where a stack value is found when a trace exits.
+typedef enum : uint8_t {
+    TRACE_CONSTANT, TRACE_VARIABLE, TRACE_TEMPORARY
+} TraceValueKind;
+
+// A value of the stack of a trace while it's compiled.
+class TraceValue
+{
+    public:
+        // Where the value is and it's type (VALUE_INT or VALUE_BOOL).
+        TraceValueKind kind;
+        ValueType type;
+
+        // The register of a temporary.
+        uint8_t reg = 0;
+
+        // The constant or the index of the variable.
+        int64_t value = 0;
+};
+
+// An instruction of a trace.
+class TraceInstruction
+{
+    public:
+        // The index of the instruction in the image.
+        uint64_t index;
+
+        // The opcode (quickened opcodes are stored as the generic ones).
+        uint64_t opcode;
+
+        // Determines if the branch was taken when it was recorded.
+        bool taken;
+};
+
+// A side exit of a trace back to the interpreter.
+class TraceExit
+{
+    public:
+        // The instruction the interpreter resumes at.
+        uint64_t resume;
+
+        // Determines if it resumes inside the loop (a path not recorded) instead of leaving it.
+        bool inside;
+
+        // The stack values the trace pushed.
+        std::vector<TraceValue> stack;
+
+        // Number of times it was taken.
+        uint64_t taken = 0;
+};
+
+// A recorded and compiled loop iteration.
+class Trace
+{
+    public:
+        // The first instruction of the loop and it's backward jump.
+        uint64_t header, end;
+
+        // The recorded instructions.
+        std::vector<TraceInstruction> instructions;
+
+        // The variables used by the trace and their type (checked when it's entered).
+        std::vector<std::string> variables;
+        std::vector<ValueType> types;
+
+        // The side exits.
+        std::vector<TraceExit> exits;
+
+        // The machine code and it's size.
+        uint8_t *code = nullptr;
+        size_t size = 0;
+
+        // Returns the index of a variable, adding it if it's new. Returns -1 if there are too many.
+        int64_t variable(const std::string &name, ValueType type);
+
+        ~Trace();
+};
+
+// Stores what the tracer knows about a loop header.
+class TraceLoop
+{
+    public:
+        // Number of backward jumps since the last record.
+        uint32_t counter = 0;
+
+        // Number of times the loop was traced.
+        uint8_t records = 0;
+
+        // Determines if the loop can't be traced.
+        bool blacklisted = false;
+
+        // The current trace of the loop.
+        std::unique_ptr<Trace> trace;
+};
+
+// The tracing JIT. It counts the backward jumps of every loop and, once a loop is hot,
+// records one iteration while it runs it. The trace is a linear path with the branches
+// turned into guards. It is compiled to machine code with the variable types checked
+// once when it's entered (so the loop has no type guards), the variables unboxed and kept
+// in registers and the constants folded. A failed guard exits back to the interpreter
+// at the path that was not recorded. Only int and bool values are traced.
+class Tracer : Assembler
+{
+    // Stores the loops by the index of their header.
+    std::vector<TraceLoop> loops;
+
+    // Stores the temporary registers that are free while a trace is compiled.
+    uint16_t free_registers = 0;
+
+    // Stores the register of every variable of the trace being compiled (0 if it lives in memory).
+    std::vector<uint8_t> homes;
+
+    // Stores the buffer positions of the jumps to the side exits.
+    std::vector<size_t> guards;
+
+    // Determines if the trace being compiled failed (too many temporaries).
+    bool failed = false;
+
+    // Records an iteration of the loop starting at the program counter, running it.
+    // Returns nullptr if it finds something that can't be traced (the program
+    // counter is left at that instruction, without running it).
+    Trace *record(VirtualMachine *vm, uint64_t header);
+
+    // Compiles a recorded trace. Returns false if it can't be compiled.
+    bool compile(VirtualMachine *vm, Trace *trace);
+
+    // Runs a trace and resumes the interpreter at it's exit.
+    void run(VirtualMachine *vm, TraceLoop *loop);
+
+    // Emits an instruction with a register and a register (or memory) operand.
+    void emit_modrm(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t rm, bool memory = false, int32_t displacement = 0);
+
+    // Returns a free temporary register.
+    uint8_t allocate();
+
+    // Frees the register of a temporary value.
+    void release(TraceValue &value);
+
+    // Moves a value to a register.
+    void load(uint8_t reg, TraceValue &value);
+
+    // Makes a value a temporary and returns it's register.
+    uint8_t temporary(TraceValue &value);
+
+    // Pushes a constant (in a register if it doesn't fit an immediate).
+    void constant(std::vector<TraceValue> &stack, int64_t value, ValueType type);
+
+    // Emits an add, sub, imul or cmp (any other opcode) of a register with a value.
+    void emit_operation(uint64_t opcode, uint8_t reg, TraceValue &value);
+
+    // Emits a conditional jump to a new side exit that resumes at the given instruction.
+    void emit_guard(uint8_t condition, uint64_t resume, std::vector<TraceValue> &stack, Trace *trace);
+
+    public:
+        // Stores the number of traces recorded, aborted and retraced, the times they ran and their side exits.
+        uint64_t recorded = 0, aborted = 0, retraced = 0, executions = 0, side_exits = 0;
+
+        // Forgets the loops of the previous program.
+        void reset(uint64_t size);
+
+        // Must be called after a backward jump (the program counter is the loop header).
+        void loop(VirtualMachine *vm);
+};
+
+#endif
@@ -10,19 +10,56 @@
 #define VIRTUAL_MACHINE_HPP
 
 #include "../../Compiler/include/program.hpp"
+#include "../../Compiler/include/gc.hpp"
+#include "../../Compiler/include/output.hpp"
+#include "jit.hpp"
+#include "tracer.hpp"
+#include "tiering.hpp"
+#include "profiler.hpp"
+#include "sampler.hpp"
+#include "statistics.hpp"
+#include "snapshot.hpp"
 
 #define STACK_SIZE 256
 #define FRAME_SIZE 256
-#define MEMORY_SIZE 256
+
+// Backward jumps before the program is compiled with the baseline JIT (when on-stack replacement is enabled).
+#define OSR_HOT_LOOP 1000
+
+class VirtualMachine;
+class AotProgram;
+
+// Defines a native function (a built-in function implemented by the virtual machine).
+typedef Value (VirtualMachine::*NativeFunction)(std::vector<Value> &arguments);
 
 class VirtualMachine
 {
+    // The JITs and their helpers run the instructions using the virtual machine state.
+    friend class Jit;
+    friend class JitHelpers;
+    friend class Tracer;
+    friend class AotRuntime;
+    friend class Sampler;
+
+    // Stores the native functions available to every program.
+    static const std::unordered_map<std::string, NativeFunction> natives;
+
     // The program the virtual machine is going to run.
     Program program;
 
+    // The garbage collected heap where the values are allocated.
+    Heap heap;
+
+    // The values held by native code while it runs nested main loops.
+    HeapHandles handles;
+
     // The current instruction to execute.
     uint64_t *program_counter = nullptr;
 
+    // The start of the linked code and of it's constants.
+    uint64_t *code = nullptr;
+    Value *constants = nullptr;
+
     // The value stack to perform operations (it's a stack based virtual machine).
     Value stack[STACK_SIZE];
 
@@ -35,15 +72,64 @@ class VirtualMachine
     // The top frame (current frame).
     Frame *top_frame = this->frames;
 
-    // Stores the stack of the memories used.
-    MemoryType memories[MEMORY_SIZE] = { PROGRAM_MEMORY };
+    // The baseline JIT and if it's used to run the programs.
+    Jit jit;
+    bool jit_enabled = false;
+
+    // The tracing JIT and if the hot loops are traced.
+    Tracer tracer;
+    bool tracing = false;
+
+    // Determines if a hot loop compiles the program and continues in the compiled code (on-stack replacement).
+    bool osr = false;
+
+    // Number of backward jumps run by the interpreter and the times it entered the compiled code at one.
+    uint64_t back_edges = 0, osr_entries = 0;
+
+    // The tiering manager and if the hot functions are compiled in the background.
+    Tiering tiering;
+    bool tiered = false;
+
+    // Number of times the interpreter continued in the code compiled in the background.
+    uint64_t tier_entries = 0;
+
+    // The opcode profiler, if the interpreter uses it and the file where it's written as JSON (empty for none).
+    OpcodeProfiler profiler;
+    bool profiling = false;
+    std::string profile_output;
+
+    // The call profiler and if the function calls are measured.
+    CallProfiler call_profiler;
+    bool profiling_calls = false;
+
+    // The statistics of the last run, if they are collected and the file where they are written as JSON (empty to print them).
+    PipelineStatistics statistics;
+    bool collecting_statistics = false;
+    std::string statistics_output;
+
+    // Determines if the allocator, collector, cache and tier counters are printed after the program.
+    bool reporting_runtime = false;
+
+    // The sampling profiler and the file where the folded stacks are written (empty if it's disabled).
+    Sampler sampler;
+    std::string sample_output;
+
+    // The buffered standard output of the program.
+    Output output;
 
-    // The current memory where the program counter is pointing.
-    MemoryType *current_memory = this->memories;
+    // The file where the heap snapshot is written after the program (empty if it's disabled).
+    std::string snapshot_output;
 
-    // Push a new value to the stack.
+    // The ahead-of-time compiled code of the program (it's checked when the program is loaded).
+    const AotProgram *aot = nullptr;
+
+    // Push a new value to the stack. It's not checked, the space is
+    // ensured when a function is entered using it's maximum stack depth.
     void push(Value value);
 
+    // Stops the program if the stack has less free slots than the given ones.
+    void ensure_stack(uint64_t slots);
+
     // Pops and returns a value from the stack.
     Value *pop();
 
@@ -56,15 +142,103 @@ class VirtualMachine
     // Helper to perform OP_ACCESS.
     void do_access();
 
+    // Helper to perform OP_STORE_ACCESS.
+    void do_store_access();
+
     // Helper to perform OP_DECLARE.
     void do_declare();
 
+    // Helper to perform OP_FUNCTION (creates the function of the function table index).
+    void do_function(uint64_t index, Type return_type, bool generator);
+
     // Helper to perform OP_RETURN.
     void do_return();
 
-    // Helper to perform OP_CALL.
+    // Helper to perform OP_CALL. It quickens the instruction depending on the target.
     void do_call();
 
+    // Helper to perform OP_CALL_FUNCTION (a call to a regular function variable).
+    void do_call_function();
+
+    // Helper to perform OP_CALL_NATIVE (a call to the cached native function).
+    void do_call_native();
+
+    // Calls a native function with the arguments on the stack.
+    void call_native(NativeFunction native, uint64_t arguments);
+
+    // Rewrites an instruction into an equivalent one (a quickened one or back the generic one).
+    void quicken(uint64_t *instruction, uint64_t opcode);
+
+    // Helper to perform OP_YIELD.
+    void do_yield();
+
+    // Helper to perform OP_ITER.
+    void do_iter();
+
+    // Helper to perform OP_FOR_NEXT.
+    void do_for_next();
+
+    // Helper to perform OP_CLASS.
+    void do_class();
+
+    // Helper to perform OP_GET_FIELD and OP_SET_FIELD.
+    void do_field(bool store);
+
+    // Helper to perform OP_GET_SLOT and OP_SET_SLOT.
+    void do_slot(bool store);
+
+    // Helper to perform OP_INVOKE.
+    void do_invoke();
+
+    // Returns the object of a value or fails if it's not a constructed object.
+    ValueObject *get_object(Value *value);
+
+    // Stores a value in an object slot casting it to the field type.
+    void store_slot(ValueObject *object, uint64_t slot, Value *value);
+
+    // Calls a function value whose arguments are already on the stack.
+    // Regular functions get their frame set up, generators return an iterator
+    // and classes construct a new object.
+    void call(Value function, uint64_t arguments);
+
+    // Enters a regular function, starting at the given code index.
+    void enter(ValueFunction *function, uint64_t index, uint64_t arguments);
+
+    // Constructs an object of the given class using the arguments on the stack.
+    void construct(ValueClass *klass, uint64_t arguments);
+
+    // Calls a function value from native code and returns its result.
+    Value call_function(Value function, std::vector<Value> arguments);
+
+    // Resumes a generator until it yields (returns true) or finishes (returns false).
+    bool resume(Value generator, Value *result);
+
+    // Gets the next element of an iterator. Returns false if it's exhausted.
+    bool iterator_next(Value iterator, Value *result);
+
+    // Converts the given value to an iterator or fails with an error.
+    Value to_iterator(Value value);
+
+    // Native functions to create iterators and iterator adaptors.
+    Value native_iter(std::vector<Value> &arguments);
+    Value native_map(std::vector<Value> &arguments);
+    Value native_filter(std::vector<Value> &arguments);
+    Value native_take(std::vector<Value> &arguments);
+    Value native_zip(std::vector<Value> &arguments);
+    Value native_collect(std::vector<Value> &arguments);
+
+    // Native function that writes what the program printed so far.
+    Value native_flush(std::vector<Value> &arguments);
+
+    // Native function that writes a heap snapshot to the given file and returns the reachable bytes.
+    Value native_heap_snapshot(std::vector<Value> &arguments);
+
+    // Takes a snapshot of the objects the program can reach.
+    void take_snapshot(HeapSnapshot *snapshot);
+
+    // Checks the number of arguments given to a native function.
+    void check_arguments(const std::string name, std::vector<Value> &arguments, size_t expected);
+
     // Returns true if the value has been declared.
     bool variable_declared(std::string name);
 
@@ -74,20 +248,104 @@ class VirtualMachine
     // Stores a value
     void store_variable(std::string name, Value *new_value, bool only_store);
 
-    // Returns the current used memory.
-    Memory *get_current_memory();
+    // Prints the hit and miss counters of the method inline caches.
+    void dump_inline_caches(Memory *memory);
+
+    // Prints the allocator, collector, inline cache, quickening and tier counters given the running time (in seconds).
+    void report_runtime(double run_time);
 
     // Returns the current executing line.
     uint32_t get_current_line();
 
+    // Executes instructions until the program exits or until the
+    // top frame returns (or yields) back to the given frame.
+    void execute(Frame *until);
+
+    // The dispatch loop of execute, instantiated with and without the opcode profiler and the
+    // statistics counters (the profiled loop counts them too).
+    template <bool profile, bool count>
+    void dispatch(Frame *until);
+
+    // Must be called after a backward jump. It lets the tracer run the loop and, with on-stack
+    // replacement, continues in the baseline JIT code. Returns true if the compiled code finished
+    // the execution (up to the until frame).
+    bool back_edge(Frame *until);
+
+    // Must be called after a call or a backward jump with tiered execution. It counts them, installs
+    // the code compiled in the background and continues in it if the program counter was compiled.
+    // Returns true if the compiled code finished the execution (up to the until frame).
+    bool tier_up(Frame *until, bool call);
+
     // Runs the virtual machine.
     void run();
 
+    // Verifies and runs the loaded program, then prints the reports.
+    void interpret();
+
+    // Returns the roots of the garbage collector.
+    HeapRoots heap_roots();
+
+    // Lets the garbage collector do it's pending work.
+    void safepoint();
+
     public:
+        // Stores the total method inline cache hits and misses.
+        uint64_t invoke_hits = 0, invoke_misses = 0;
+
+        // Stores the number of instructions quickened and deoptimized back to the generic ones.
+        uint64_t quickenings = 0, deoptimizations = 0;
+
+        // Configures the heap limits (0 keeps the default nursery size or means no heap limit).
+        void set_heap_limits(uint64_t nursery_size, uint64_t heap_limit);
+
+        // Configures the number of garbage collector marking threads (0 keeps the default).
+        // It must be called before running any program.
+        void set_mark_threads(uint64_t threads);
+
+        // Enables the baseline JIT (the interpreter is used if the platform is not supported).
+        void set_jit(bool enabled);
+
+        // Enables the tracing JIT for the hot loops.
+        void set_tracing(bool enabled);
+
+        // Enables the on-stack replacement into the baseline JIT code at the hot loops.
+        void set_osr(bool enabled);
+
+        // Enables the compilation of the hot functions in a background thread.
+        void set_tiering(bool enabled);
+
+        // Enables the opcode profiler of the interpreter. The profile is printed after the
+        // program and, if the output is not empty, written to it as JSON.
+        void set_profiling(bool enabled, const std::string &output);
+
+        // Enables the call profiler, the functions are printed after the program.
+        void set_call_profiling(bool enabled);
+
+        // Enables the pipeline statistics. They are printed after the program or, if the output is not empty, written to it as JSON.
+        void set_statistics(bool enabled, const std::string &output);
+
+        // Enables the runtime counters (allocations, collections, inline caches, quickening and tiers), printed after the program.
+        void set_runtime_statistics(bool enabled);
+
+        // Enables the sampling profiler, the folded stacks are written to the output file after the program.
+        void set_sampling(const std::string &output);
+
+        // Flushes the program output after every line (for interactive use).
+        void set_line_buffered(bool enabled);
+
+        // Enables the heap snapshot, it's printed after the program and written to the output file.
+        void set_heap_snapshot(const std::string &output);
+
+        // Compiles a program and writes it's translation to C++ to the output file.
+        void emit_cpp(const char *source, const std::string &name, const std::string &output);
+
         // It runs the virtual machine given a source input.
         void interpret(const char *source);
 
-        // Resets the virtual machine program memories.
+        // Runs an ahead-of-time compiled program (it builds it's own image, nothing is compiled).
+        void interpret(const AotProgram *program);
+
+        // Resets the virtual machine program memories and collects the garbage.
         void reset();
 };
 
@@ -0,0 +1,530 @@
+/**
+ * |--------------------------------|
+ * | Nuua Ahead-Of-Time Compilation |
+ * |--------------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/aot.hpp"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+uint64_t Aot::checksum(Memory *image)
+{
+    // FNV-1a of the code words and the number of constants.
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto word : image->code) hash = (hash ^ word) * 1099511628211ULL;
+
+    return (hash ^ image->constants.size()) * 1099511628211ULL;
+}
+
+std::string Aot::local(const std::string &name)
+{
+    return "l" + std::to_string(this->variables[name].local);
+}
+
+std::string Aot::literal(Value *value)
+{
+    switch (value->type.type) {
+        case VALUE_INT: {
+            if (value->value_int == INT64_MIN) return "INT64_MIN";
+            return "INT64_C(" + std::to_string(value->value_int) + ")";
+        }
+        case VALUE_FLOAT: {
+            if (isnan(value->value_float)) return "std::numeric_limits<double>::quiet_NaN()";
+            if (isinf(value->value_float)) return value->value_float > 0 ? "std::numeric_limits<double>::infinity()" : "-std::numeric_limits<double>::infinity()";
+            // Hexadecimal floats keep the exact value.
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "%a", value->value_float);
+            return buffer;
+        }
+        case VALUE_BOOL: { return value->value_bool ? "true" : "false"; }
+        default: { return ""; }
+    }
+}
+
+// The C++ names of the value types.
+static const char *value_types[] = {
+    "VALUE_NONE", "VALUE_INT", "VALUE_FLOAT", "VALUE_BOOL",
+    "VALUE_STRING", "VALUE_LIST", "VALUE_DICT", "VALUE_FUN",
+    "VALUE_ITER", "VALUE_CLASS", "VALUE_OBJECT"
+};
+
+void Aot::find_class(ValueClass *klass)
+{
+    if (!klass || this->classes.count(klass) > 0) return;
+
+    this->classes[klass] = this->class_order.size();
+    this->class_order.push_back(klass);
+    for (auto &type : klass->field_types) if (type.is(VALUE_OBJECT)) this->find_class(type.classType);
+}
+
+void Aot::find_classes(Value *value)
+{
+    switch (value->type.type) {
+        case VALUE_LIST: { for (auto &element : *value->value_list) this->find_classes(&element); break; }
+        case VALUE_DICT: { for (auto &element : value->value_dict->values) this->find_classes(&element.second); break; }
+        case VALUE_CLASS: { this->find_class(value->value_class); break; }
+        case VALUE_OBJECT: { this->find_class(value->type.classType); break; }
+        default: { break; }
+    }
+}
+
+std::string Aot::string_literal(const std::string &value)
+{
+    // The rest of bytes are octal escapes (they never take the next character like the hexadecimal ones).
+    std::string literal = "std::string(\"";
+    for (auto character : value) {
+        switch (character) {
+            case '\\': { literal += "\\\\"; break; }
+            case '"': { literal += "\\\""; break; }
+            case '\n': { literal += "\\n"; break; }
+            case '\t': { literal += "\\t"; break; }
+            default: {
+                if (character >= ' ' && character <= '~' && character != '?') literal += character;
+                else {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\%03o", static_cast<unsigned char>(character));
+                    literal += buffer;
+                }
+                break;
+            }
+        }
+    }
+
+    return literal + "\", " + std::to_string(value.size()) + ")";
+}
+
+std::string Aot::constant(Value *value)
+{
+    auto klass = [&](ValueClass *klass) { return "c" + std::to_string(this->classes[klass]); };
+
+    switch (value->type.type) {
+        case VALUE_INT: { return "Value(static_cast<int64_t>(" + this->literal(value) + "))"; }
+        case VALUE_FLOAT: { return "Value(static_cast<double>(" + this->literal(value) + "))"; }
+        case VALUE_BOOL: { return "Value(static_cast<bool>(" + this->literal(value) + "))"; }
+        case VALUE_STRING: { return "Value(" + Aot::string_literal(*value->value_string) + ")"; }
+        case VALUE_LIST: {
+            std::string elements;
+            for (auto &element : *value->value_list) elements += (elements.empty() ? "" : ", ") + this->constant(&element);
+            return "Value(std::vector<Value>({ " + elements + " }))";
+        }
+        case VALUE_DICT: {
+            std::string values, keys;
+            for (auto &key : value->value_dict->key_order) {
+                values += (values.empty() ? "{ " : ", { ") + Aot::string_literal(key) + ", " + this->constant(&value->value_dict->values[key]) + " }";
+                keys += (keys.empty() ? "" : ", ") + Aot::string_literal(key);
+            }
+            return "Value(std::unordered_map<std::string, Value>({ " + values + " }), std::vector<std::string>({ " + keys + " }))";
+        }
+        case VALUE_CLASS: { return value->value_class ? "Value(" + klass(value->value_class) + ")" : "Value(Type(VALUE_CLASS))"; }
+        case VALUE_OBJECT: { return value->type.classType ? "Value(Type(VALUE_OBJECT, " + klass(value->type.classType) + "))" : "Value(Type(VALUE_OBJECT))"; }
+        // The compiler only makes the empty functions and iterators of the declared types.
+        case VALUE_FUN: { return "Value(Type(VALUE_FUN))"; }
+        case VALUE_ITER: { return "Value(Type(VALUE_ITER))"; }
+        default: { return "Value()"; }
+    }
+}
+
+void Aot::analyze()
+{
+    auto image = &this->program->image;
+    auto size = image->code.size();
+    this->entries.assign(size, false);
+    this->main.assign(size, false);
+    this->variables.clear();
+
+    // The code is entered at the start, at the functions and wherever the program counter is left
+    // by a jump or by the instructions that move to another function (and return back after them).
+    if (size > 0) this->entries[0] = true;
+    for (auto &function : this->program->function_table) if (function.entry < size) this->entries[function.entry] = true;
+    for (uint64_t i = 0, target; i < size; i += 1 + opcode_constants(image->code[i]) + opcode_cache(image->code[i])) {
+        if (opcode_jump_target(image, i, &target) && target < size) this->entries[target] = true;
+        switch (opcode_generic(image->code[i])) {
+            case OP_CALL: case OP_INVOKE: case OP_FOR_NEXT: case OP_RETURN: case OP_YIELD: {
+                this->entries[i] = true;
+                auto next = i + 1 + opcode_constants(image->code[i]) + opcode_cache(image->code[i]);
+                if (next < size) this->entries[next] = true;
+                break;
+            }
+            default: { break; }
+        }
+    }
+
+    // The main code is the one reached from the start without calls.
+    std::vector<uint64_t> pending = { 0 };
+    while (size > 0 && !pending.empty()) {
+        auto i = pending.back();
+        pending.pop_back();
+        if (i >= size || this->main[i]) continue;
+        this->main[i] = true;
+        uint64_t target;
+        if (opcode_jump_target(image, i, &target)) pending.push_back(target);
+        if (opcode_falls_through(image->code[i])) pending.push_back(i + 1 + opcode_constants(image->code[i]) + opcode_cache(image->code[i]));
+    }
+
+    // The int, float and bool variables declared once by the main code can be native locals if
+    // no other instruction of the main code uses them by name. The functions and classes get
+    // their value when they copy the frame.
+    std::unordered_map<std::string, uint64_t> declarations;
+    std::unordered_map<std::string, ValueType> types;
+    for (uint64_t i = 0; i < size; i += 1 + opcode_constants(image->code[i]) + opcode_cache(image->code[i])) {
+        if (!this->main[i] || image->code[i] != OP_DECLARE) continue;
+        auto name = *image->constants[image->code[i + 1]].value_string;
+        auto type = image->constants[image->code[i + 2]].type.type;
+        declarations[name]++;
+        if (type == VALUE_INT || type == VALUE_FLOAT || type == VALUE_BOOL) types[name] = type;
+    }
+    for (uint64_t i = 0; i < size; i += 1 + opcode_constants(image->code[i]) + opcode_cache(image->code[i])) {
+        if (!this->main[i]) continue;
+        switch (opcode_generic(image->code[i])) {
+            case OP_PUSH: case OP_LOAD: case OP_STORE: case OP_ONLY_STORE: case OP_DECLARE: { break; }
+            default: {
+                for (uint8_t c = 0; c < opcode_constants(image->code[i]); c++) {
+                    auto constant = &image->constants[image->code[i + 1 + c]];
+                    if (constant->is(VALUE_STRING)) types.erase(*constant->value_string);
+                }
+                break;
+            }
+        }
+    }
+    for (auto &variable : types) {
+        if (declarations[variable.first] != 1) continue;
+        auto local = this->variables.size();
+        this->variables[variable.first] = { variable.second, local };
+    }
+}
+
+void Aot::flush()
+{
+    for (auto &value : this->stack) {
+        std::string type;
+        switch (value.type) {
+            case VALUE_INT: { type = "int64_t"; break; }
+            case VALUE_FLOAT: { type = "double"; break; }
+            default: { type = "bool"; break; }
+        }
+        this->code << "        AotRuntime::push(vm, Value(static_cast<" << type << ">(" << value.expression << ")));\n";
+    }
+    this->stack.clear();
+}
+
+void Aot::detach(const std::string &name)
+{
+    for (auto &value : this->stack) {
+        if (std::find(value.variables.begin(), value.variables.end(), name) == value.variables.end()) continue;
+        auto temporary = "t" + std::to_string(this->temporaries.size());
+        this->temporaries.push_back(value.type);
+        this->code << "        " << temporary << " = " << value.expression << ";\n";
+        value = { temporary, value.type, {} };
+    }
+}
+
+bool Aot::translate_operator(uint64_t opcode)
+{
+    // The numbers are converted like Value::to_double does.
+    auto number = [](AotValue &value) {
+        return value.type == VALUE_FLOAT ? value.expression : "static_cast<double>(" + value.expression + ")";
+    };
+
+    if (opcode == OP_MINUS || opcode == OP_NOT) {
+        if (this->stack.empty()) return false;
+        auto &a = this->stack.back();
+        if (opcode == OP_NOT) a = { "(!" + a.expression + ")", VALUE_BOOL, a.variables };
+        else if (a.type == VALUE_BOOL) a = { "(-" + number(a) + ")", VALUE_FLOAT, a.variables };
+        else a.expression = "(-" + a.expression + ")";
+        return true;
+    }
+
+    if (this->stack.size() < 2) return false;
+    auto b = this->stack.back(); this->stack.pop_back();
+    auto a = this->stack.back(); this->stack.pop_back();
+    auto variables = a.variables;
+    variables.insert(variables.end(), b.variables.begin(), b.variables.end());
+
+    // Two ints (or two bools when they are compared) keep their type, the rest are doubles.
+    std::string symbol;
+    switch (opcode) {
+        case OP_ADD: { symbol = " + "; break; }
+        case OP_SUB: { symbol = " - "; break; }
+        case OP_MUL: { symbol = " * "; break; }
+        case OP_EQ: { symbol = " == "; break; }
+        case OP_NEQ: { symbol = " != "; break; }
+        case OP_LT: { symbol = " < "; break; }
+        case OP_LTE: { symbol = " <= "; break; }
+        case OP_HT: { symbol = " > "; break; }
+        case OP_HTE: { symbol = " >= "; break; }
+        default: { break; }
+    }
+    switch (opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: {
+            if (a.type == VALUE_INT && b.type == VALUE_INT) this->stack.push_back({ "(" + a.expression + symbol + b.expression + ")", VALUE_INT, variables });
+            else this->stack.push_back({ "(" + number(a) + symbol + number(b) + ")", VALUE_FLOAT, variables });
+            break;
+        }
+        case OP_DIV: { this->stack.push_back({ "AotRuntime::divide(" + number(a) + ", " + number(b) + ")", VALUE_FLOAT, variables }); break; }
+        default: {
+            if (a.type == b.type && a.type != VALUE_FLOAT) this->stack.push_back({ "(" + a.expression + symbol + b.expression + ")", VALUE_BOOL, variables });
+            else this->stack.push_back({ "(" + number(a) + symbol + number(b) + ")", VALUE_BOOL, variables });
+            break;
+        }
+    }
+
+    return true;
+}
+
+void Aot::translate_instruction(uint64_t index)
+{
+    auto image = &this->program->image;
+    auto opcode = opcode_generic(image->code[index]);
+    auto operands = "code + " + std::to_string(index + 1);
+    auto operand = [&](uint8_t n) { return &image->constants[image->code[index + 1 + n]]; };
+    auto native = [&](uint8_t n) { return this->main[index] && operand(n)->is(VALUE_STRING) && this->variables.count(*operand(n)->value_string) > 0; };
+
+    // The code can be entered at the label, so the known values must be on the real stack.
+    if (this->entries[index]) {
+        this->flush();
+        this->code << "    i" << index << ":\n";
+    }
+
+    uint64_t target;
+    switch (opcode) {
+        case OP_PUSH: {
+            auto expression = this->literal(operand(0));
+            if (!expression.empty()) {
+                this->stack.push_back({ expression, operand(0)->type.type, {} });
+                return;
+            }
+            this->flush();
+            this->code << "        AotRuntime::constant(vm, " << operands << ");\n";
+            return;
+        }
+        case OP_POP: {
+            // The known values have no side effects.
+            if (!this->stack.empty()) this->stack.pop_back();
+            else this->code << "        AotRuntime::pop(vm);\n";
+            return;
+        }
+        case OP_DECLARE: {
+            if (!native(0)) break;
+            auto name = *operand(0)->value_string;
+            auto local = this->local(name);
+            this->code << "        if (d" << local << ") AotRuntime::redeclared(vm, " << operands << ", \"" << name << "\");\n";
+            this->code << "        d" << local << " = true;\n";
+            this->code << "        " << local << " = " << this->literal(operand(1)) << ";\n";
+            return;
+        }
+        case OP_LOAD: {
+            if (!native(0)) break;
+            auto name = *operand(0)->value_string;
+            this->stack.push_back({ this->local(name), this->variables[name].type, { name } });
+            return;
+        }
+        case OP_STORE: case OP_ONLY_STORE: {
+            if (!native(0)) break;
+            auto name = *operand(0)->value_string;
+            auto type = this->variables[name].type;
+            auto local = this->local(name);
+            if (!this->stack.empty() && (this->stack.back().type == type || (this->stack.back().type == VALUE_INT && type == VALUE_FLOAT))) {
+                auto value = this->stack.back();
+                this->stack.pop_back();
+                this->detach(name);
+                this->code << "        " << local << " = " << (value.type == type ? value.expression : "static_cast<double>(" + value.expression + ")") << ";\n";
+            } else {
+                // Any other value is cast like OP_STORE does.
+                this->flush();
+                this->code << "        " << local << " = AotRuntime::pop_" << (type == VALUE_INT ? "int" : type == VALUE_FLOAT ? "float" : "bool") << "(vm);\n";
+            }
+            if (opcode == OP_STORE) this->stack.push_back({ local, type, { name } });
+            return;
+        }
+        case OP_MINUS: case OP_NOT: case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+        case OP_EQ: case OP_NEQ: case OP_LT: case OP_LTE: case OP_HT: case OP_HTE: {
+            if (this->translate_operator(opcode)) return;
+            break;
+        }
+        case OP_BRANCH_TRUE: case OP_BRANCH_FALSE: {
+            opcode_jump_target(image, index, &target);
+            std::string condition;
+            if (!this->stack.empty()) {
+                condition = this->stack.back().expression;
+                this->stack.pop_back();
+                this->flush();
+            } else condition = "JitHelpers::truthy(vm, " + operands + ", until)";
+            this->code << "        if (" << (opcode == OP_BRANCH_TRUE ? "" : "!") << condition << ") goto i" << target << ";\n";
+            return;
+        }
+        case OP_RJUMP: {
+            opcode_jump_target(image, index, &target);
+            this->flush();
+            this->code << "        JitHelpers::safepoint(vm, " << operands << ", until);\n";
+            this->code << "        goto i" << target << ";\n";
+            return;
+        }
+        case OP_CALL: case OP_INVOKE: case OP_FOR_NEXT: {
+            this->flush();
+            this->code << "        JitHelpers::" << (opcode == OP_CALL ? "call" : opcode == OP_INVOKE ? "invoke" : "for_next") << "(vm, " << operands << ", until);\n";
+            this->code << "        goto dispatch;\n";
+            return;
+        }
+        case OP_RETURN: case OP_YIELD: {
+            this->flush();
+            this->code << "        if (!JitHelpers::" << (opcode == OP_RETURN ? "ret" : "yield") << "(vm, " << operands << ", until)) return true;\n";
+            this->code << "        goto dispatch;\n";
+            return;
+        }
+        case OP_EXIT: {
+            this->flush();
+            this->code << "        return true;\n";
+            return;
+        }
+        case OP_FUNCTION: case OP_CLASS: {
+            // They copy the frame, that must have the current value of the native locals.
+            if (!this->main[index]) break;
+            this->flush();
+            for (auto &variable : this->variables) {
+                auto local = this->local(variable.first);
+                this->code << "        if (d" << local << ") AotRuntime::sync(vm, \"" << variable.first << "\", Value(" << local << "));\n";
+            }
+            break;
+        }
+        default: { break; }
+    }
+
+    // The rest of instructions call the baseline JIT helpers.
+    std::string helper;
+    switch (opcode) {
+        case OP_MINUS: { helper = "minus"; break; }
+        case OP_NOT: { helper = "negate"; break; }
+        case OP_ADD: { helper = "add"; break; }
+        case OP_SUB: { helper = "sub"; break; }
+        case OP_MUL: { helper = "mul"; break; }
+        case OP_DIV: { helper = "div"; break; }
+        case OP_EQ: { helper = "eq"; break; }
+        case OP_NEQ: { helper = "neq"; break; }
+        case OP_LT: { helper = "lt"; break; }
+        case OP_LTE: { helper = "lte"; break; }
+        case OP_HT: { helper = "ht"; break; }
+        case OP_HTE: { helper = "hte"; break; }
+        case OP_DECLARE: { helper = "declare"; break; }
+        case OP_STORE: { helper = "store"; break; }
+        case OP_ONLY_STORE: { helper = "only_store"; break; }
+        case OP_LOAD: { helper = "load"; break; }
+        case OP_STORE_ACCESS: { helper = "store_access"; break; }
+        case OP_LIST: { helper = "list"; break; }
+        case OP_DICTIONARY: { helper = "dictionary"; break; }
+        case OP_ACCESS: { helper = "access"; break; }
+        case OP_FUNCTION: { helper = "function"; break; }
+        case OP_ITER: { helper = "iter"; break; }
+        case OP_CLASS: { helper = "klass"; break; }
+        case OP_GET_SLOT: { helper = "get_slot"; break; }
+        case OP_SET_SLOT: { helper = "set_slot"; break; }
+        case OP_GET_FIELD: { helper = "get_field"; break; }
+        case OP_SET_FIELD: { helper = "set_field"; break; }
+        case OP_LEN: { helper = "len"; break; }
+        case OP_PRINT: { helper = "print"; break; }
+        default: { break; }
+    }
+
+    this->flush();
+    if (helper.empty()) this->code << "        return AotRuntime::fallback(vm, code + " << index << ");\n";
+    else this->code << "        JitHelpers::" << helper << "(vm, " << operands << ", until);\n";
+}
+
+std::string Aot::translate(const std::string &name)
+{
+    auto image = &this->program->image;
+    this->code.str("");
+    this->stack.clear();
+    this->temporaries.clear();
+    this->classes.clear();
+    this->class_order.clear();
+    this->analyze();
+
+    for (uint64_t i = 0; i < image->code.size(); i += 1 + opcode_constants(image->code[i]) + opcode_cache(image->code[i])) {
+        this->translate_instruction(i);
+    }
+    this->flush();
+
+    std::ostringstream output;
+    output << "// Generated by nuua --emit-cpp from " << name << ".\n";
+    output << "// Compile it from the nuua directory with the nuua objects (see the native target of the Makefile).\n";
+    output << "// Only the int, float and bool variables of the main code are native locals, the variables of the functions stay boxed in their frames.\n";
+    output << "#include \"Virtual-Machine/include/aot.hpp\"\n\n";
+    output << "#pragma GCC diagnostic ignored \"-Wunused-label\"\n";
+    output << "#pragma GCC diagnostic ignored \"-Wunused-but-set-variable\"\n\n";
+
+    // The linked image is built again when the program starts (the code is not quickened yet).
+    auto words = [&](const char *target, auto &values, const char *suffix) {
+        output << "    program->image." << target << " = {";
+        for (uint64_t i = 0; i < values.size(); i++) output << (i % 16 == 0 ? "\n        " : " ") << values[i] << suffix << ",";
+        output << "\n    };\n";
+    };
+    output << "static void load(Program *program)\n{\n";
+    words("code", image->code, "ULL");
+    words("lines", image->lines, "");
+    for (auto &constant : image->constants) this->find_classes(&constant);
+    for (auto klass : this->class_order) {
+        output << "    auto c" << this->classes[klass] << " = allocate<ValueClass>(OBJECT_CLASS, " << Aot::string_literal(klass->name) << ");\n";
+    }
+    for (auto klass : this->class_order) {
+        auto number = std::to_string(this->classes[klass]);
+        for (uint64_t i = 0; i < klass->fields.size(); i++) {
+            auto &type = klass->field_types[i];
+            auto field_type = type.is(VALUE_OBJECT) && type.classType ? "Type(VALUE_OBJECT, c" + std::to_string(this->classes[type.classType]) + ")" : "Type(" + std::string(value_types[type.type]) + ")";
+            output << "    c" << number << "->add_field(" << Aot::string_literal(klass->fields[i]) << ", " << field_type << ");\n";
+        }
+        // The methods are added in the order of their slots.
+        std::vector<std::string> methods(klass->method_slots.size());
+        for (auto &method : klass->method_slots) methods[method.second] = method.first;
+        for (auto &method : methods) output << "    c" << number << "->add_method(" << Aot::string_literal(method) << ");\n";
+    }
+    output << "    program->image.constants.reserve(" << image->constants.size() << ");\n";
+    for (auto &constant : image->constants) output << "    program->image.constants.push_back(" << this->constant(&constant) << ");\n";
+    for (auto &function : this->program->function_table) {
+        output << "    program->function_table.push_back({ " << function.entry << "ULL, " << function.arity << "ULL, " << function.max_stack << "ULL, ";
+        output << Aot::string_literal(function.name) << ", " << function.line << ", " << Aot::string_literal(function.binding) << " });\n";
+    }
+    output << "    program->max_stack = " << this->program->max_stack << "ULL;\n";
+    output << "}\n\n";
+
+    output << "static bool execute(VirtualMachine *vm, Frame *until)\n{\n";
+    output << "    auto code = AotRuntime::code(vm);\n";
+    output << "    (void) code;\n";
+    output << "    (void) until;\n";
+    for (auto &variable : this->variables) {
+        auto local = this->local(variable.first);
+        std::string type = variable.second.type == VALUE_INT ? "int64_t" : variable.second.type == VALUE_FLOAT ? "double" : "bool";
+        output << "    " << type << " " << local << " = " << type << "(); bool d" << local << " = false; // " << variable.first << "\n";
+    }
+    for (uint64_t i = 0; i < this->temporaries.size(); i++) {
+        output << "    " << (this->temporaries[i] == VALUE_INT ? "int64_t" : this->temporaries[i] == VALUE_FLOAT ? "double" : "bool") << " t" << i << ";\n";
+    }
+    output << "\n    dispatch:\n";
+    output << "    switch (AotRuntime::index(vm)) {\n";
+    for (uint64_t i = 0; i < image->code.size(); i++) if (this->entries[i]) output << "        case " << i << ": { goto i" << i << "; }\n";
+    output << "        default: { return false; }\n";
+    output << "    }\n\n";
+    output << this->code.str();
+    output << "    return true;\n}\n\n";
+
+    output << "static const AotProgram program = { " << image->code.size() << "ULL, " << Aot::checksum(image) << "ULL, &execute, &load };\n\n";
+    output << "// The entry point of a shared object (compiled with -D NUUA_NO_MAIN).\n";
+    output << "extern \"C\" int nuua_main()\n{\n    return AotRuntime::run(&program);\n}\n\n";
+    output << "#ifndef NUUA_NO_MAIN\n";
+    output << "int main()\n{\n    return nuua_main();\n}\n";
+    output << "#endif\n";
+
+    return output.str();
+}
+
+int AotRuntime::run(const AotProgram *program)
+{
+    auto virtual_machine = new VirtualMachine;
+    virtual_machine->interpret(program);
+    delete virtual_machine;
+
+    return EXIT_SUCCESS;
+}
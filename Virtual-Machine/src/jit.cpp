@@ -0,0 +1,367 @@
+/**
+ * |-------------------|
+ * | Nuua Baseline JIT |
+ * |-------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/jit.hpp"
+#include "../include/jit_helpers.hpp"
+#include "../../Logger/include/logger.hpp"
+#include <string.h>
+#include <type_traits>
+#include <unordered_map>
+
+#if JIT_SUPPORTED
+    #include <sys/mman.h>
+#endif
+
+// The inline templates copy values with plain 8 byte moves.
+static_assert(std::is_trivially_copyable<Value>::value, "The JIT copies values as raw memory");
+static_assert(sizeof(Value) % 8 == 0, "The JIT copies values in 8 byte words");
+
+void Assembler::emit(std::initializer_list<uint8_t> bytes)
+{
+    this->buffer.insert(this->buffer.end(), bytes.begin(), bytes.end());
+}
+
+void Assembler::emit32(uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++) this->buffer.push_back(value >> (i * 8));
+}
+
+void Assembler::emit64(uint64_t value)
+{
+    for (uint8_t i = 0; i < 8; i++) this->buffer.push_back(value >> (i * 8));
+}
+
+void Assembler::patch(size_t position, size_t offset)
+{
+    uint32_t relative = offset - (position + 4);
+    memcpy(&this->buffer[position], &relative, 4);
+}
+
+uint8_t *Assembler::finish(size_t *size)
+{
+    #if JIT_SUPPORTED
+        *size = this->buffer.size();
+        auto memory = mmap(nullptr, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return nullptr;
+        memcpy(memory, this->buffer.data(), *size);
+        this->buffer.clear();
+        this->buffer.shrink_to_fit();
+        if (mprotect(memory, *size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, *size);
+            return nullptr;
+        }
+
+        return static_cast<uint8_t *>(memory);
+    #else
+        *size = 0;
+        return nullptr;
+    #endif
+}
+
+void Assembler::release_code(uint8_t *memory, size_t size)
+{
+    #if JIT_SUPPORTED
+        if (memory) munmap(memory, size);
+    #else
+        (void) memory;
+        (void) size;
+    #endif
+}
+
+void Jit::emit_jump(std::initializer_list<uint8_t> opcode, uint64_t instruction)
+{
+    this->emit(opcode);
+    this->jumps.push_back({ this->buffer.size(), instruction });
+    this->emit32(0);
+}
+
+void Jit::emit_jump_offset(std::initializer_list<uint8_t> opcode, size_t offset)
+{
+    this->emit(opcode);
+    this->emit32(offset - (this->buffer.size() + 4));
+}
+
+void Jit::emit_call(void *helper, const uint64_t *address)
+{
+    this->emit({ 0x48, 0x89, 0xDF }); // mov rdi, rbx
+    this->emit({ 0x48, 0xBE }); this->emit64(reinterpret_cast<uint64_t>(address)); // mov rsi, address
+    this->emit({ 0x4C, 0x89, 0xE2 }); // mov rdx, r12
+    this->emit({ 0x48, 0xB8 }); this->emit64(reinterpret_cast<uint64_t>(helper)); // mov rax, helper
+    this->emit({ 0xFF, 0xD0 }); // call rax
+}
+
+void Jit::emit_int_binary(uint64_t opcode, void *helper, const uint64_t *address)
+{
+    // Offsets of the type tag, the type pointer and the value inside a value.
+    static Value sample;
+    static const int32_t tag = reinterpret_cast<char *>(&sample.type.type) - reinterpret_cast<char *>(&sample);
+    static const int32_t pointer = reinterpret_cast<char *>(&sample.type.listType) - reinterpret_cast<char *>(&sample);
+    static const int32_t value = reinterpret_cast<char *>(&sample.value_int) - reinterpret_cast<char *>(&sample);
+    const int32_t size = sizeof(Value), top = JitHelpers::top_stack_offset(this->vm);
+    std::vector<size_t> slow;
+
+    this->emit({ 0x48, 0x8B, 0x8B }); this->emit32(top); // mov rcx, [rbx + top]
+
+    // Both operands must be ints, otherwise the helper is called.
+    for (auto operand : { -size, -2 * size }) {
+        this->emit({ 0x80, 0xB9 }); this->emit32(operand + tag); this->emit({ VALUE_INT }); // cmp byte [rcx + tag], VALUE_INT
+        this->emit({ 0x0F, 0x85 }); slow.push_back(this->buffer.size()); this->emit32(0); // jne slow
+    }
+
+    this->emit({ 0x48, 0x8B, 0x81 }); this->emit32(-2 * size + value); // mov rax, [rcx + a]
+    switch (opcode) {
+        case OP_ADD: { this->emit({ 0x48, 0x03, 0x81 }); this->emit32(-size + value); break; } // add rax, [rcx + b]
+        case OP_SUB: { this->emit({ 0x48, 0x2B, 0x81 }); this->emit32(-size + value); break; } // sub rax, [rcx + b]
+        case OP_MUL: { this->emit({ 0x48, 0x0F, 0xAF, 0x81 }); this->emit32(-size + value); break; } // imul rax, [rcx + b]
+        default: {
+            uint8_t condition;
+            switch (opcode) {
+                case OP_EQ: { condition = 0x94; break; } // sete
+                case OP_NEQ: { condition = 0x95; break; } // setne
+                case OP_LT: { condition = 0x9C; break; } // setl
+                case OP_LTE: { condition = 0x9E; break; } // setle
+                case OP_HT: { condition = 0x9F; break; } // setg
+                default: { condition = 0x9D; break; } // setge
+            }
+            this->emit({ 0x48, 0x3B, 0x81 }); this->emit32(-size + value); // cmp rax, [rcx + b]
+            this->emit({ 0x0F, condition, 0xC0 }); // setcc al
+            this->emit({ 0x0F, 0xB6, 0xC0 }); // movzx eax, al
+            // The result is a bool.
+            this->emit({ 0xC6, 0x81 }); this->emit32(-2 * size + tag); this->emit({ VALUE_BOOL }); // mov byte [rcx + tag], VALUE_BOOL
+            this->emit({ 0x48, 0xC7, 0x81 }); this->emit32(-2 * size + pointer); this->emit32(0); // mov qword [rcx + pointer], 0
+            break;
+        }
+    }
+    this->emit({ 0x48, 0x89, 0x81 }); this->emit32(-2 * size + value); // mov [rcx + a], rax
+    this->emit({ 0x48, 0x81, 0xE9 }); this->emit32(size); // sub rcx, size
+    this->emit({ 0x48, 0x89, 0x8B }); this->emit32(top); // mov [rbx + top], rcx
+    this->emit({ 0xE9 }); auto done = this->buffer.size(); this->emit32(0); // jmp done
+
+    for (auto jump : slow) this->patch(jump, this->buffer.size());
+    this->emit_call(helper, address);
+    this->patch(done, this->buffer.size());
+}
+
+bool Jit::emit_instruction(Program *program, Memory *source, uint64_t index)
+{
+    auto image = &program->image;
+    // The interpreter may have quickened the instructions before they are compiled (on-stack replacement),
+    // the templates are the generic ones (the call helper still runs the quickened calls).
+    auto opcode = opcode_generic(source->code[index]);
+    auto operands = &image->code[index + 1];
+    const int32_t size = sizeof(Value), top = JitHelpers::top_stack_offset(this->vm);
+
+    // The helpers that don't change the control flow.
+    void *helper = nullptr;
+    switch (opcode) {
+        case OP_MINUS: { helper = reinterpret_cast<void *>(&JitHelpers::minus); break; }
+        case OP_NOT: { helper = reinterpret_cast<void *>(&JitHelpers::negate); break; }
+        case OP_DIV: { helper = reinterpret_cast<void *>(&JitHelpers::div); break; }
+        case OP_DECLARE: { helper = reinterpret_cast<void *>(&JitHelpers::declare); break; }
+        case OP_STORE: { helper = reinterpret_cast<void *>(&JitHelpers::store); break; }
+        case OP_ONLY_STORE: { helper = reinterpret_cast<void *>(&JitHelpers::only_store); break; }
+        case OP_LOAD: { helper = reinterpret_cast<void *>(&JitHelpers::load); break; }
+        case OP_STORE_ACCESS: { helper = reinterpret_cast<void *>(&JitHelpers::store_access); break; }
+        case OP_LIST: { helper = reinterpret_cast<void *>(&JitHelpers::list); break; }
+        case OP_DICTIONARY: { helper = reinterpret_cast<void *>(&JitHelpers::dictionary); break; }
+        case OP_ACCESS: { helper = reinterpret_cast<void *>(&JitHelpers::access); break; }
+        case OP_FUNCTION: { helper = reinterpret_cast<void *>(&JitHelpers::function); break; }
+        case OP_ITER: { helper = reinterpret_cast<void *>(&JitHelpers::iter); break; }
+        case OP_CLASS: { helper = reinterpret_cast<void *>(&JitHelpers::klass); break; }
+        case OP_GET_SLOT: { helper = reinterpret_cast<void *>(&JitHelpers::get_slot); break; }
+        case OP_SET_SLOT: { helper = reinterpret_cast<void *>(&JitHelpers::set_slot); break; }
+        case OP_GET_FIELD: { helper = reinterpret_cast<void *>(&JitHelpers::get_field); break; }
+        case OP_SET_FIELD: { helper = reinterpret_cast<void *>(&JitHelpers::set_field); break; }
+        case OP_LEN: { helper = reinterpret_cast<void *>(&JitHelpers::len); break; }
+        case OP_PRINT: { helper = reinterpret_cast<void *>(&JitHelpers::print); break; }
+        default: { break; }
+    }
+    if (helper) {
+        this->emit_call(helper, operands);
+        return true;
+    }
+
+    // The helpers that may move to another function.
+    switch (opcode) {
+        case OP_CALL: { helper = reinterpret_cast<void *>(&JitHelpers::call); break; }
+        case OP_INVOKE: { helper = reinterpret_cast<void *>(&JitHelpers::invoke); break; }
+        case OP_RETURN: { helper = reinterpret_cast<void *>(&JitHelpers::ret); break; }
+        case OP_YIELD: { helper = reinterpret_cast<void *>(&JitHelpers::yield); break; }
+        case OP_FOR_NEXT: { helper = reinterpret_cast<void *>(&JitHelpers::for_next); break; }
+        default: { break; }
+    }
+    if (helper) {
+        this->emit_call(helper, operands);
+        this->emit({ 0x48, 0x85, 0xC0 }); // test rax, rax
+        this->emit_jump_offset({ 0x0F, 0x84 }, this->exit_offset); // jz finished
+        this->emit({ 0xFF, 0xE0 }); // jmp rax
+        return true;
+    }
+
+    uint64_t target;
+    switch (opcode) {
+        case OP_PUSH: {
+            // Copy the constant to the top of the stack.
+            this->emit({ 0x48, 0x8B, 0x8B }); this->emit32(top); // mov rcx, [rbx + top]
+            this->emit({ 0x48, 0xB8 }); this->emit64(reinterpret_cast<uint64_t>(&image->constants[operands[0]])); // mov rax, constant
+            for (int32_t word = 0; word < size; word += 8) {
+                this->emit({ 0x48, 0x8B, 0x90 }); this->emit32(word); // mov rdx, [rax + word]
+                this->emit({ 0x48, 0x89, 0x91 }); this->emit32(word); // mov [rcx + word], rdx
+            }
+            this->emit({ 0x48, 0x81, 0xC1 }); this->emit32(size); // add rcx, size
+            this->emit({ 0x48, 0x89, 0x8B }); this->emit32(top); // mov [rbx + top], rcx
+            return true;
+        }
+        case OP_POP: { this->emit({ 0x48, 0x81, 0xAB }); this->emit32(top); this->emit32(size); return true; } // sub qword [rbx + top], size
+        case OP_ADD: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::add), operands); return true; }
+        case OP_SUB: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::sub), operands); return true; }
+        case OP_MUL: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::mul), operands); return true; }
+        case OP_EQ: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::eq), operands); return true; }
+        case OP_NEQ: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::neq), operands); return true; }
+        case OP_LT: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::lt), operands); return true; }
+        case OP_LTE: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::lte), operands); return true; }
+        case OP_HT: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::ht), operands); return true; }
+        case OP_HTE: { this->emit_int_binary(opcode, reinterpret_cast<void *>(&JitHelpers::hte), operands); return true; }
+        case OP_RJUMP: {
+            opcode_jump_target(source, index, &target);
+            if (target < index && this->vm->tracing) {
+                // The loops are traced from the helper, that continues wherever the trace exits.
+                this->emit_call(reinterpret_cast<void *>(&JitHelpers::loop), operands);
+                this->emit({ 0xFF, 0xE0 }); // jmp rax
+                return true;
+            }
+            this->emit_call(reinterpret_cast<void *>(&JitHelpers::safepoint), operands);
+            this->emit_jump({ 0xE9 }, target); // jmp target
+            return true;
+        }
+        case OP_BRANCH_TRUE: case OP_BRANCH_FALSE: {
+            opcode_jump_target(source, index, &target);
+            this->emit_call(reinterpret_cast<void *>(&JitHelpers::truthy), operands);
+            this->emit({ 0x84, 0xC0 }); // test al, al
+            this->emit_jump({ 0x0F, static_cast<uint8_t>(opcode == OP_BRANCH_TRUE ? 0x85 : 0x84) }, target); // jnz / jz target
+            return true;
+        }
+        case OP_EXIT: { this->emit_jump_offset({ 0xE9 }, this->exit_offset); return true; } // jmp finished
+        default: { return false; }
+    }
+}
+
+void *Jit::address(uint64_t index)
+{
+    if (index >= this->offsets.size() || this->offsets[index] == SIZE_MAX) return this->memory + this->fallback_offset;
+
+    return this->memory + this->offsets[index];
+}
+
+bool Jit::compile(VirtualMachine *vm, Program *program, Memory *source, const std::vector<bool> *selected)
+{
+    #if JIT_SUPPORTED
+        this->release();
+        this->vm = vm;
+        this->buffer.clear();
+        this->jumps.clear();
+        this->translated = this->untranslated = 0;
+
+        auto image = &program->image;
+        if (!source) source = image;
+        this->offsets.assign(image->code.size(), SIZE_MAX);
+
+        // Prologue: keep the virtual machine in rbx and the until frame in r12
+        // (three pushes keep the stack aligned for the calls) and jump to the target.
+        this->emit({ 0x53, 0x41, 0x54, 0x41, 0x55 }); // push rbx; push r12; push r13
+        this->emit({ 0x48, 0x89, 0xFB }); // mov rbx, rdi
+        this->emit({ 0x49, 0x89, 0xF4 }); // mov r12, rsi
+        this->emit({ 0xFF, 0xE2 }); // jmp rdx
+
+        // The finished exit, the epilogue and the fallback exit.
+        this->exit_offset = this->buffer.size();
+        this->emit({ 0x31, 0xC0 }); // xor eax, eax (JIT_FINISHED)
+        auto epilogue = this->buffer.size();
+        this->emit({ 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 }); // pop r13; pop r12; pop rbx; ret
+        this->fallback_offset = this->buffer.size();
+        this->emit({ 0xB8 }); this->emit32(JIT_FALLBACK); // mov eax, JIT_FALLBACK
+        this->emit_jump_offset({ 0xE9 }, epilogue); // jmp epilogue
+
+        for (uint64_t i = 0; i < source->code.size(); i += 1 + opcode_constants(source->code[i]) + opcode_cache(source->code[i])) {
+            if (selected && !(*selected)[i]) continue;
+            this->offsets[i] = this->buffer.size();
+            if (this->emit_instruction(program, source, i)) {
+                this->translated++;
+                continue;
+            }
+
+            // Instructions without template give the execution back to the interpreter.
+            this->untranslated++;
+            this->emit_call(reinterpret_cast<void *>(&JitHelpers::set_program_counter), &image->code[i]);
+            this->emit_jump_offset({ 0xE9 }, this->fallback_offset);
+        }
+
+        // The jumps to instructions that were not selected give the execution back to the interpreter there.
+        std::unordered_map<uint64_t, size_t> stubs;
+        for (auto &jump : this->jumps) {
+            if (this->offsets[jump.second] != SIZE_MAX) {
+                this->patch(jump.first, this->offsets[jump.second]);
+                continue;
+            }
+            if (stubs.count(jump.second) == 0) {
+                stubs[jump.second] = this->buffer.size();
+                this->emit_call(reinterpret_cast<void *>(&JitHelpers::set_program_counter), &image->code[jump.second]);
+                this->emit_jump_offset({ 0xE9 }, this->fallback_offset);
+            }
+            this->patch(jump.first, stubs[jump.second]);
+        }
+
+        this->memory = this->finish(&this->size);
+
+        return this->memory != nullptr;
+    #else
+        (void) vm;
+        (void) program;
+        (void) source;
+        (void) selected;
+        return false;
+    #endif
+}
+
+void Jit::install(Jit &compiled)
+{
+    // The replaced code may still be running below the current call, so it's released with the program.
+    if (this->memory) this->retired.push_back({ this->memory, this->size });
+    this->memory = compiled.memory;
+    this->size = compiled.size;
+    this->offsets = std::move(compiled.offsets);
+    this->exit_offset = compiled.exit_offset;
+    this->fallback_offset = compiled.fallback_offset;
+    this->vm = compiled.vm;
+    this->translated = compiled.translated;
+    this->untranslated = compiled.untranslated;
+    compiled.memory = nullptr;
+    compiled.size = 0;
+}
+
+bool Jit::run(VirtualMachine *vm, Frame *until)
+{
+    auto entry = reinterpret_cast<JitEntry>(this->memory);
+    return entry(vm, until, this->address(vm->program_counter - vm->code)) == JIT_FINISHED;
+}
+
+void Jit::release()
+{
+    for (auto &code : this->retired) Assembler::release_code(code.first, code.second);
+    this->retired.clear();
+    Assembler::release_code(this->memory, this->size);
+    this->memory = nullptr;
+    this->size = 0;
+}
+
+Jit::~Jit()
+{
+    this->release();
+}
+
+#undef OPERAND
@@ -0,0 +1,182 @@
+/**
+ * |----------------------|
+ * | Nuua Opcode Profiler |
+ * |----------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/profiler.hpp"
+#include "../../Compiler/include/pool.hpp"
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+void OpcodeProfiler::finish()
+{
+    if (this->previous < PROFILER_OPCODES) this->times[this->previous] += OpcodeProfiler::now() - this->start;
+    this->previous = PROFILER_OPCODES;
+}
+
+void OpcodeProfiler::reset()
+{
+    memset(this->counts, 0, sizeof(this->counts));
+    memset(this->times, 0, sizeof(this->times));
+    memset(this->pairs, 0, sizeof(this->pairs));
+    memset(this->pair_times, 0, sizeof(this->pair_times));
+    this->previous = PROFILER_OPCODES;
+}
+
+void OpcodeProfiler::report()
+{
+    uint64_t total_count = 0, total_time = 0;
+    std::vector<uint64_t> opcodes;
+    for (uint64_t opcode = 0; opcode < PROFILER_OPCODES; opcode++) {
+        if (this->counts[opcode] == 0) continue;
+        opcodes.push_back(opcode);
+        total_count += this->counts[opcode];
+        total_time += this->times[opcode];
+    }
+    std::sort(opcodes.begin(), opcodes.end(), [this](uint64_t a, uint64_t b) { return this->times[a] > this->times[b]; });
+
+    printf("%-18s %14s %18s %8s %12s\n", "Opcode", "Executions", "Total " PROFILER_UNIT, "Time", PROFILER_UNIT "/op");
+    for (auto opcode : opcodes) {
+        printf(
+            "%-18s %14llu %18llu %7.2f%% %12.1f\n", opcode_to_string(opcode).c_str(),
+            static_cast<unsigned long long>(this->counts[opcode]), static_cast<unsigned long long>(this->times[opcode]),
+            total_time > 0 ? 100.0 * this->times[opcode] / total_time : 0.0, static_cast<double>(this->times[opcode]) / this->counts[opcode]
+        );
+    }
+    printf("%-18s %14llu %18llu\n", "Total", static_cast<unsigned long long>(total_count), static_cast<unsigned long long>(total_time));
+
+    std::vector<std::pair<uint64_t, uint64_t>> pairs;
+    for (uint64_t a = 0; a < PROFILER_OPCODES; a++) {
+        for (uint64_t b = 0; b < PROFILER_OPCODES; b++) if (this->pairs[a][b] > 0) pairs.push_back({ a, b });
+    }
+    std::sort(pairs.begin(), pairs.end(), [this](std::pair<uint64_t, uint64_t> &a, std::pair<uint64_t, uint64_t> &b) {
+        return this->pairs[a.first][a.second] > this->pairs[b.first][b.second];
+    });
+    if (pairs.size() > PROFILER_PAIRS) pairs.resize(PROFILER_PAIRS);
+
+    printf("\n%-37s %14s %18s %8s %12s\n", "Opcode pair", "Executions", "Total " PROFILER_UNIT, "Time", PROFILER_UNIT "/pair");
+    for (auto &pair : pairs) {
+        auto name = opcode_to_string(pair.first) + " -> " + opcode_to_string(pair.second);
+        auto count = this->pairs[pair.first][pair.second], time = this->pair_times[pair.first][pair.second];
+        printf(
+            "%-37s %14llu %18llu %7.2f%% %12.1f\n", name.c_str(), static_cast<unsigned long long>(count), static_cast<unsigned long long>(time),
+            total_time > 0 ? 100.0 * time / total_time : 0.0, static_cast<double>(time) / count
+        );
+    }
+}
+
+bool OpcodeProfiler::write_json(const std::string &path)
+{
+    auto file_stream = std::ofstream(path);
+    if (!file_stream.is_open()) return false;
+
+    file_stream << "{\n  \"unit\": \"" << PROFILER_UNIT << "\",\n  \"opcodes\": [";
+    bool first = true;
+    for (uint64_t opcode = 0; opcode < PROFILER_OPCODES; opcode++) {
+        if (this->counts[opcode] == 0) continue;
+        file_stream << (first ? "\n" : ",\n") << "    { \"opcode\": \"" << opcode_to_string(opcode) << "\", \"executions\": "
+            << this->counts[opcode] << ", \"time\": " << this->times[opcode] << " }";
+        first = false;
+    }
+    file_stream << "\n  ],\n  \"pairs\": [";
+    first = true;
+    for (uint64_t a = 0; a < PROFILER_OPCODES; a++) {
+        for (uint64_t b = 0; b < PROFILER_OPCODES; b++) {
+            if (this->pairs[a][b] == 0) continue;
+            file_stream << (first ? "\n" : ",\n") << "    { \"first\": \"" << opcode_to_string(a) << "\", \"second\": \""
+                << opcode_to_string(b) << "\", \"executions\": " << this->pairs[a][b] << ", \"time\": " << this->pair_times[a][b] << " }";
+            first = false;
+        }
+    }
+    file_stream << "\n  ]\n}\n";
+
+    return true;
+}
+
+uint64_t CallProfiler::allocations()
+{
+    uint64_t total = 0;
+    for (uint8_t kind = 0; kind < OBJECT_KINDS; kind++) total += pool_statistics(static_cast<ObjectKind>(kind)).allocations;
+
+    return total;
+}
+
+void CallProfiler::reset(Program *program)
+{
+    this->functions.clear();
+    for (uint64_t function = 0; function < program->function_table.size(); function++) {
+        this->functions[program->function_table[function].entry] = function;
+    }
+    this->records.assign(program->function_table.size(), CallRecord());
+    this->running.assign(program->function_table.size(), 0);
+    this->activations.clear();
+}
+
+void CallProfiler::enter(uint64_t entry)
+{
+    auto function = this->functions.find(entry);
+    if (function == this->functions.end()) return;
+
+    CallActivation activation;
+    activation.function = function->second;
+    activation.allocations = CallProfiler::allocations();
+    activation.start = CallProfiler::now();
+    this->activations.push_back(activation);
+    this->records[function->second].calls++;
+    this->running[function->second]++;
+}
+
+void CallProfiler::leave()
+{
+    if (this->activations.empty()) return;
+
+    auto time = CallProfiler::now();
+    auto allocations = CallProfiler::allocations();
+    auto activation = this->activations.back();
+    this->activations.pop_back();
+
+    auto record = &this->records[activation.function];
+    auto elapsed = time - activation.start, allocated = allocations - activation.allocations;
+    record->exclusive += elapsed - activation.children_time;
+    record->allocations += allocated - activation.children_allocations;
+    if (--this->running[activation.function] == 0) record->inclusive += elapsed;
+
+    if (!this->activations.empty()) {
+        this->activations.back().children_time += elapsed;
+        this->activations.back().children_allocations += allocated;
+    }
+}
+
+void CallProfiler::finish()
+{
+    while (!this->activations.empty()) this->leave();
+}
+
+void CallProfiler::report(Program *program)
+{
+    uint64_t total_time = 0;
+    std::vector<uint64_t> functions;
+    for (uint64_t function = 0; function < this->records.size(); function++) {
+        if (this->records[function].calls == 0) continue;
+        functions.push_back(function);
+        total_time += this->records[function].exclusive;
+    }
+    std::sort(functions.begin(), functions.end(), [this](uint64_t a, uint64_t b) { return this->records[a].exclusive > this->records[b].exclusive; });
+
+    printf("%-30s %12s %14s %14s %8s %12s\n", "Function", "Calls", "Inclusive ms", "Exclusive ms", "Time", "Allocations");
+    for (auto function : functions) {
+        auto record = &this->records[function];
+        auto name = program->function_table[function].name + ":" + std::to_string(program->function_table[function].line);
+        printf(
+            "%-30s %12llu %14.3f %14.3f %7.2f%% %12llu\n", name.c_str(), static_cast<unsigned long long>(record->calls),
+            record->inclusive / 1e6, record->exclusive / 1e6, total_time > 0 ? 100.0 * record->exclusive / total_time : 0.0,
+            static_cast<unsigned long long>(record->allocations)
+        );
+    }
+}
@@ -0,0 +1,128 @@
+/**
+ * |------------------------|
+ * | Nuua Sampling Profiler |
+ * |------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/sampler.hpp"
+#include "../include/virtual_machine.hpp"
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+#include <errno.h>
+#include <string.h>
+#if SAMPLER_SUPPORTED
+    #include <sys/time.h>
+#endif
+
+Sampler *Sampler::active = nullptr;
+
+void Sampler::handle(int)
+{
+    #if SAMPLER_SUPPORTED
+        auto sampler = Sampler::active;
+        if (!sampler) return;
+        auto error = errno;
+        if (!pthread_equal(pthread_self(), sampler->thread)) pthread_kill(sampler->thread, SIGPROF);
+        else sampler->sample();
+        errno = error;
+    #endif
+}
+
+void Sampler::sample()
+{
+    auto vm = this->vm;
+    if (!vm->code || !vm->program_counter) return;
+
+    // The frame i was entered from the position stored as it's return address.
+    uint64_t depth = vm->top_frame - vm->frames + 1;
+    if (this->used + depth + 1 > this->buffer.size()) {
+        this->dropped++;
+        return;
+    }
+    auto words = &this->buffer[this->used];
+    words[0] = depth;
+    for (uint64_t i = 1; i < depth; i++) words[i] = vm->frames[i].return_address - vm->code;
+    words[depth] = vm->program_counter - vm->code;
+    this->used += depth + 1;
+    this->samples++;
+    std::atomic_signal_fence(std::memory_order_release);
+}
+
+bool Sampler::start(VirtualMachine *vm)
+{
+    #if SAMPLER_SUPPORTED
+        this->vm = vm;
+        this->thread = pthread_self();
+        this->buffer.assign(SAMPLER_BUFFER, 0);
+        this->used = this->samples = this->dropped = 0;
+        Sampler::active = this;
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = Sampler::handle;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &this->previous);
+
+        struct itimerval timer;
+        timer.it_interval.tv_sec = timer.it_value.tv_sec = 0;
+        timer.it_interval.tv_usec = timer.it_value.tv_usec = SAMPLER_INTERVAL;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+
+        return true;
+    #else
+        (void) vm;
+        return false;
+    #endif
+}
+
+void Sampler::stop()
+{
+    #if SAMPLER_SUPPORTED
+        struct itimerval timer;
+        memset(&timer, 0, sizeof(timer));
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        sigaction(SIGPROF, &this->previous, nullptr);
+        Sampler::active = nullptr;
+        std::atomic_signal_fence(std::memory_order_acquire);
+    #endif
+}
+
+bool Sampler::write_folded(Program *program, const std::string &path)
+{
+    auto file_stream = std::ofstream(path);
+    if (!file_stream.is_open()) return false;
+
+    auto owners = program->instruction_owners();
+    std::unordered_map<uint64_t, std::string> names;
+    auto name = [&](uint64_t position) -> const std::string & {
+        auto cached = names.find(position);
+        if (cached != names.end()) return cached->second;
+
+        // The position is past the opcode (or past the call that left the frame), the operands are skipped back.
+        auto &result = names[position];
+        if (position == 0 || position > owners.size()) return result = "<unknown>";
+        auto index = position - 1;
+        while (index > 0 && owners[index] == -1) index--;
+        auto owner = owners[index];
+        result = owner <= 0 ? "<main>" : program->function_table[owner - 1].name;
+        return result += ":" + std::to_string(program->image.lines[index]);
+    };
+
+    std::map<std::string, uint64_t> stacks;
+    for (uint64_t i = 0; i < this->used; i += this->buffer[i] + 1) {
+        std::string stack;
+        for (uint64_t frame = 1; frame <= this->buffer[i]; frame++) {
+            if (frame > 1) stack += ';';
+            stack += name(this->buffer[i + frame]);
+        }
+        stacks[stack]++;
+    }
+    for (auto &stack : stacks) file_stream << stack.first << ' ' << stack.second << '\n';
+
+    return true;
+}
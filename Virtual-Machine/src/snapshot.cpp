@@ -0,0 +1,217 @@
+/**
+ * |--------------------|
+ * | Nuua Heap Snapshot |
+ * |--------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/snapshot.hpp"
+#include "../../Compiler/include/gc.hpp"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Objects and bytes of a kind (or a kind and line) in a snapshot.
+typedef std::pair<int64_t, int64_t> SnapshotTotals;
+
+// Groups the objects of a snapshot by kind and line.
+typedef std::map<std::pair<std::string, uint32_t>, SnapshotTotals> SnapshotGroups;
+
+// Returns the bytes of the nodes and buckets of a map (without what the keys and values own).
+template <typename Key, typename Element>
+static uint64_t map_bytes(const std::unordered_map<Key, Element> &map)
+{
+    uint64_t bytes = map.bucket_count() * sizeof(void *) + map.size() * (sizeof(std::pair<const Key, Element>) + 2 * sizeof(void *));
+    for (auto &element : map) bytes += string_payload(element.first);
+
+    return bytes;
+}
+
+uint64_t HeapSnapshot::object_bytes(const void *object)
+{
+    auto header = object_header(object);
+    uint64_t bytes = header->size;
+    switch (header->kind) {
+        case OBJECT_STRING: { bytes += string_payload(*static_cast<const std::string *>(object)); break; }
+        case OBJECT_LIST: { bytes += static_cast<const std::vector<Value> *>(object)->capacity() * sizeof(Value); break; }
+        case OBJECT_DICT: {
+            auto dictionary = static_cast<const ValueDictionary *>(object);
+            bytes += map_bytes(dictionary->values) + dictionary->key_order.capacity() * sizeof(std::string);
+            for (auto &key : dictionary->key_order) bytes += string_payload(key);
+            break;
+        }
+        case OBJECT_ITERATOR: {
+            auto iterator = static_cast<const ValueIterator *>(object);
+            bytes += (iterator->sources.capacity() + iterator->stack.capacity()) * sizeof(Value);
+            break;
+        }
+        case OBJECT_CLASS: {
+            auto klass = static_cast<const ValueClass *>(object);
+            bytes += string_payload(klass->name) + map_bytes(klass->slots) + map_bytes(klass->method_slots);
+            bytes += klass->fields.capacity() * sizeof(std::string) + klass->field_types.capacity() * sizeof(Type) + klass->methods.capacity() * sizeof(Value);
+            for (auto &field : klass->fields) bytes += string_payload(field);
+            break;
+        }
+        case OBJECT_OBJECT: { bytes += object_header(static_cast<const ValueObject *>(object)->slots)->size; break; }
+        case OBJECT_FRAME: { bytes += map_bytes(static_cast<const Frame *>(object)->heap); break; }
+        default: { break; }
+    }
+
+    return bytes;
+}
+
+void HeapSnapshot::take(Program *program, const std::vector<void *> &objects)
+{
+    static const char *iterator_kinds[] = { "list", "generator", "map", "filter", "take", "zip" };
+    std::unordered_map<uint64_t, std::string> functions;
+    for (auto &function : program->function_table) functions[function.entry] = function.name;
+
+    this->objects.clear();
+    for (auto object : objects) {
+        auto header = object_header(object);
+        SnapshotObject snapshot_object;
+        snapshot_object.kind = header->kind;
+        snapshot_object.line = header->line;
+        snapshot_object.bytes = HeapSnapshot::object_bytes(object);
+        switch (header->kind) {
+            case OBJECT_STRING: {
+                auto string = static_cast<std::string *>(object);
+                auto contents = string->substr(0, 32);
+                std::replace(contents.begin(), contents.end(), '\n', ' ');
+                snapshot_object.description = "\"" + contents + (string->size() > 32 ? "...\"" : "\"");
+                break;
+            }
+            case OBJECT_LIST: { snapshot_object.description = std::to_string(static_cast<std::vector<Value> *>(object)->size()) + " elements"; break; }
+            case OBJECT_DICT: { snapshot_object.description = std::to_string(static_cast<ValueDictionary *>(object)->values.size()) + " entries"; break; }
+            case OBJECT_FUNCTION: {
+                auto function = functions.find(static_cast<ValueFunction *>(object)->index);
+                snapshot_object.description = function != functions.end() ? function->second : "function at " + std::to_string(static_cast<ValueFunction *>(object)->index);
+                break;
+            }
+            case OBJECT_ITERATOR: { snapshot_object.description = std::string(iterator_kinds[static_cast<ValueIterator *>(object)->kind]) + " iterator"; break; }
+            case OBJECT_CLASS: { snapshot_object.description = static_cast<ValueClass *>(object)->name; break; }
+            case OBJECT_OBJECT: { snapshot_object.description = static_cast<ValueObject *>(object)->klass->name + " instance"; break; }
+            case OBJECT_FRAME: { snapshot_object.description = std::to_string(static_cast<Frame *>(object)->heap.size()) + " variables"; break; }
+            default: { break; }
+        }
+        this->objects.push_back(snapshot_object);
+    }
+}
+
+void HeapSnapshot::report(uint64_t top)
+{
+    uint64_t counts[OBJECT_KINDS] = { 0 }, bytes[OBJECT_KINDS] = { 0 }, total_bytes = 0;
+    for (auto &object : this->objects) {
+        counts[object.kind]++;
+        bytes[object.kind] += object.bytes;
+        total_bytes += object.bytes;
+    }
+
+    printf("%-12s %12s %14s %8s\n", "Kind", "Objects", "Bytes", "Share");
+    for (uint8_t kind = 0; kind < OBJECT_KINDS; kind++) {
+        if (counts[kind] == 0) continue;
+        printf(
+            "%-12s %12llu %14llu %7.2f%%\n", object_kind_to_string(static_cast<ObjectKind>(kind)).c_str(),
+            static_cast<unsigned long long>(counts[kind]), static_cast<unsigned long long>(bytes[kind]),
+            total_bytes > 0 ? 100.0 * bytes[kind] / total_bytes : 0.0
+        );
+    }
+    printf("%-12s %12llu %14llu\n", "Total", static_cast<unsigned long long>(this->objects.size()), static_cast<unsigned long long>(total_bytes));
+
+    std::vector<SnapshotObject *> largest;
+    for (auto &object : this->objects) largest.push_back(&object);
+    std::sort(largest.begin(), largest.end(), [](SnapshotObject *a, SnapshotObject *b) { return a->bytes > b->bytes; });
+    if (largest.size() > top) largest.resize(top);
+
+    printf("\n%-12s %8s %14s  %s\n", "Largest", "Line", "Bytes", "Contents");
+    for (auto object : largest) {
+        printf(
+            "%-12s %8s %14llu  %s\n", object_kind_to_string(object->kind).c_str(), object->line > 0 ? std::to_string(object->line).c_str() : "-",
+            static_cast<unsigned long long>(object->bytes), object->description.c_str()
+        );
+    }
+}
+
+bool HeapSnapshot::write(const std::string &path)
+{
+    auto file_stream = std::ofstream(path);
+    if (!file_stream.is_open()) return false;
+
+    SnapshotGroups groups;
+    for (auto &object : this->objects) {
+        auto group = &groups[{ object_kind_to_string(object.kind), object.line }];
+        group->first++;
+        group->second += object.bytes;
+    }
+
+    file_stream << "# kind\tline\tobjects\tbytes\n";
+    for (auto &group : groups) {
+        file_stream << group.first.first << '\t' << group.first.second << '\t' << group.second.first << '\t' << group.second.second << '\n';
+    }
+
+    return true;
+}
+
+// Reads the groups of a written snapshot. Returns false if it can't be read.
+static bool read_snapshot(const std::string &path, SnapshotGroups &groups)
+{
+    auto file_stream = std::ifstream(path);
+    if (!file_stream.is_open()) return false;
+
+    std::string line;
+    while (std::getline(file_stream, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string kind;
+        uint32_t source_line;
+        SnapshotTotals totals;
+        if (fields >> kind >> source_line >> totals.first >> totals.second) groups[{ kind, source_line }] = totals;
+    }
+
+    return true;
+}
+
+bool HeapSnapshot::diff(const std::string &before, const std::string &after)
+{
+    SnapshotGroups before_groups, after_groups;
+    if (!read_snapshot(before, before_groups) || !read_snapshot(after, after_groups)) return false;
+
+    // The changes are stored as negative before values plus the after values.
+    SnapshotGroups changes;
+    for (auto &group : before_groups) {
+        changes[group.first].first -= group.second.first;
+        changes[group.first].second -= group.second.second;
+    }
+    for (auto &group : after_groups) {
+        changes[group.first].first += group.second.first;
+        changes[group.first].second += group.second.second;
+    }
+
+    std::vector<SnapshotGroups::value_type *> changed;
+    SnapshotTotals total = { 0, 0 };
+    for (auto &change : changes) {
+        if (change.second.first == 0 && change.second.second == 0) continue;
+        changed.push_back(&change);
+        total.first += change.second.first;
+        total.second += change.second.second;
+    }
+    std::sort(changed.begin(), changed.end(), [](SnapshotGroups::value_type *a, SnapshotGroups::value_type *b) {
+        return llabs(a->second.second) > llabs(b->second.second);
+    });
+
+    printf("%-12s %8s %12s %14s\n", "Kind", "Line", "Objects", "Bytes");
+    for (auto change : changed) {
+        printf(
+            "%-12s %8s %+12lld %+14lld\n", change->first.first.c_str(), change->first.second > 0 ? std::to_string(change->first.second).c_str() : "-",
+            static_cast<long long>(change->second.first), static_cast<long long>(change->second.second)
+        );
+    }
+    printf("%-12s %8s %+12lld %+14lld\n", "Total", "", static_cast<long long>(total.first), static_cast<long long>(total.second));
+
+    return true;
+}
@@ -0,0 +1,62 @@
+/**
+ * |--------------------------|
+ * | Nuua Pipeline Statistics |
+ * |--------------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/statistics.hpp"
+#include <fstream>
+#include <initializer_list>
+#include <utility>
+#include <stdio.h>
+
+void PipelineStatistics::report()
+{
+    auto total = this->scanning_time + this->parsing_time + this->optimizing_time + this->compiling_time + this->verifying_time + this->running_time;
+    printf("%-12s %12s %8s\n", "Phase", "ms", "Time");
+    for (auto phase : std::initializer_list<std::pair<const char *, double>>({
+        { "Scanning", this->scanning_time }, { "Parsing", this->parsing_time }, { "Optimizing", this->optimizing_time },
+        { "Compiling", this->compiling_time }, { "Verifying", this->verifying_time }, { "Running", this->running_time }
+    })) {
+        printf("%-12s %12.3f %7.2f%%\n", phase.first, phase.second * 1000, total > 0 ? 100 * phase.second / total : 0.0);
+    }
+    printf("%-12s %12.3f\n", "Total", total * 1000);
+    printf(
+        "Tokens: %llu | AST nodes: %llu | Instructions: %llu (%llu words) | Constants: %llu | Functions: %llu\n",
+        static_cast<unsigned long long>(this->tokens), static_cast<unsigned long long>(this->nodes),
+        static_cast<unsigned long long>(this->instructions), static_cast<unsigned long long>(this->code_words),
+        static_cast<unsigned long long>(this->constants), static_cast<unsigned long long>(this->functions)
+    );
+    printf(
+        "Executed instructions: %llu | Peak stack: %llu slots | Peak frames: %llu\n",
+        static_cast<unsigned long long>(this->executed), static_cast<unsigned long long>(this->peak_stack),
+        static_cast<unsigned long long>(this->peak_frames)
+    );
+    printf(
+        "Allocations: %llu objects, %llu nursery bytes | Collections: %llu minor, %llu major\n",
+        static_cast<unsigned long long>(this->allocations), static_cast<unsigned long long>(this->allocated_bytes),
+        static_cast<unsigned long long>(this->minor_collections), static_cast<unsigned long long>(this->major_collections)
+    );
+}
+
+bool PipelineStatistics::write_json(const std::string &path)
+{
+    auto file_stream = std::ofstream(path);
+    if (!file_stream.is_open()) return false;
+
+    file_stream
+        << "{\n  \"time\": { \"scanning\": " << this->scanning_time << ", \"parsing\": " << this->parsing_time
+        << ", \"optimizing\": " << this->optimizing_time << ", \"compiling\": " << this->compiling_time
+        << ", \"verifying\": " << this->verifying_time << ", \"running\": " << this->running_time << " },\n"
+        << "  \"tokens\": " << this->tokens << ",\n  \"nodes\": " << this->nodes << ",\n"
+        << "  \"instructions\": " << this->instructions << ",\n  \"code_words\": " << this->code_words << ",\n"
+        << "  \"constants\": " << this->constants << ",\n  \"functions\": " << this->functions << ",\n"
+        << "  \"executed\": " << this->executed << ",\n  \"peak_stack\": " << this->peak_stack << ",\n"
+        << "  \"peak_frames\": " << this->peak_frames << ",\n  \"allocations\": " << this->allocations << ",\n"
+        << "  \"allocated_bytes\": " << this->allocated_bytes << ",\n  \"minor_collections\": " << this->minor_collections << ",\n"
+        << "  \"major_collections\": " << this->major_collections << "\n}\n";
+
+    return true;
+}
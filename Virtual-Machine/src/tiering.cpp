@@ -0,0 +1,114 @@
+/**
+ * |-----------------------|
+ * | Nuua Tiered Execution |
+ * |-----------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/tiering.hpp"
+
+void Tiering::cancel()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->condition.wait(lock, [this] { return !this->compiling; });
+    this->request.reset();
+    this->compiled.reset();
+    this->finished = false;
+}
+
+void Tiering::reset(VirtualMachine *vm, Program *program)
+{
+    this->cancel();
+    this->vm = vm;
+    this->program = program;
+    this->hot_functions = this->installations = this->compilations = 0;
+
+    auto size = program->image.code.size();
+    this->owners = program->instruction_owners();
+    this->entries = { 0 };
+    for (auto &function : program->function_table) this->entries.push_back(function.entry);
+    this->calls.assign(this->entries.size(), 0);
+    this->loops.assign(this->entries.size(), 0);
+    this->queued.assign(this->entries.size(), false);
+    this->selected.assign(size, false);
+}
+
+void Tiering::call(uint64_t index)
+{
+    // Only the calls that entered a function are counted (not the native ones).
+    if (index >= this->owners.size() || this->owners[index] <= 0) return;
+    auto function = this->owners[index];
+    if (this->entries[function] != index || this->queued[function]) return;
+    if (++this->calls[function] >= TIER_HOT_CALLS) this->queue(function);
+}
+
+void Tiering::loop(uint64_t index)
+{
+    if (index >= this->owners.size() || this->owners[index] < 0) return;
+    auto function = this->owners[index];
+    if (!this->queued[function] && ++this->loops[function] >= TIER_HOT_LOOP) this->queue(function);
+}
+
+void Tiering::queue(uint64_t function)
+{
+    this->queued[function] = true;
+    this->hot_functions++;
+    for (uint64_t i = 0; i < this->owners.size(); i++) if (this->owners[i] == static_cast<int64_t>(function)) this->selected[i] = true;
+
+    // The request replaces the one that is still waiting (it has every function queued before).
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->request.reset(new Memory(this->program->image));
+    this->request_selected = this->selected;
+    if (!this->worker.joinable()) this->worker = std::thread(&Tiering::work, this);
+    this->condition.notify_all();
+}
+
+void Tiering::work()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    for (;;) {
+        this->condition.wait(lock, [this] { return this->stopping || this->request; });
+        if (this->stopping) return;
+
+        auto source = std::move(this->request);
+        auto selected = this->request_selected;
+        this->compiling = true;
+        lock.unlock();
+
+        std::unique_ptr<Jit> jit(new Jit);
+        auto success = jit->compile(this->vm, this->program, source.get(), &selected);
+
+        lock.lock();
+        this->compiling = false;
+        if (success) {
+            this->compiled = std::move(jit);
+            this->compilations++;
+            this->finished.store(true, std::memory_order_release);
+        }
+        this->condition.notify_all();
+    }
+}
+
+bool Tiering::install(Jit *jit)
+{
+    if (!this->finished.load(std::memory_order_acquire)) return false;
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    jit->install(*this->compiled);
+    this->compiled.reset();
+    this->finished = false;
+    this->installations++;
+
+    return true;
+}
+
+Tiering::~Tiering()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+        this->condition.notify_all();
+    }
+    if (this->worker.joinable()) this->worker.join();
+}
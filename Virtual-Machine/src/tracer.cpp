@@ -0,0 +1,569 @@
+/**
+ * |------------------|
+ * | Nuua Tracing JIT |
+ * |------------------|
+ *
+ * Copyright 2019 Erik Campobadal <soc@erik.cat>
+ * https://nuua.io
+ */
+#include "../include/tracer.hpp"
+#include "../include/virtual_machine.hpp"
+#include <algorithm>
+
+// The registers used by the traces.
+#define RBP 5
+#define R11 11
+
+// The variables get the callee saved registers, the rest are temporaries (r11 is a scratch register).
+static const uint8_t variable_registers[] = { 3, 12, 13, 14, 15 };
+static const uint8_t temporary_registers[] = { 0, 1, 2, 6, 7, 8, 9, 10 };
+
+// Returns the x86 condition code that is true when the comparison is.
+static uint8_t condition_code(uint64_t opcode)
+{
+    switch (opcode) {
+        case OP_EQ: { return 0x4; }
+        case OP_NEQ: { return 0x5; }
+        case OP_LT: { return 0xC; }
+        case OP_LTE: { return 0xE; }
+        case OP_HT: { return 0xF; }
+        default: { return 0xD; }
+    }
+}
+
+// Returns the condition code of a comparison with it's operands swapped.
+static uint8_t swap_condition(uint8_t condition)
+{
+    switch (condition) {
+        case 0xC: { return 0xF; }
+        case 0xE: { return 0xD; }
+        case 0xF: { return 0xC; }
+        case 0xD: { return 0xE; }
+        default: { return condition; }
+    }
+}
+
+// Folds an int or bool operation of two constants.
+static int64_t fold(uint64_t opcode, int64_t a, int64_t b)
+{
+    // Unsigned arithmetic wraps like the machine code does.
+    switch (opcode) {
+        case OP_ADD: { return static_cast<uint64_t>(a) + static_cast<uint64_t>(b); }
+        case OP_SUB: { return static_cast<uint64_t>(a) - static_cast<uint64_t>(b); }
+        case OP_MUL: { return static_cast<uint64_t>(a) * static_cast<uint64_t>(b); }
+        case OP_EQ: { return a == b; }
+        case OP_NEQ: { return a != b; }
+        case OP_LT: { return a < b; }
+        case OP_LTE: { return a <= b; }
+        case OP_HT: { return a > b; }
+        default: { return a >= b; }
+    }
+}
+
+// Runs a binary operation with the virtual machine semantics.
+static Value binary(uint64_t opcode, Value &a, Value &b)
+{
+    switch (opcode) {
+        case OP_ADD: { return a + b; }
+        case OP_SUB: { return a - b; }
+        case OP_MUL: { return a * b; }
+        case OP_EQ: { return a == b; }
+        case OP_NEQ: { return a != b; }
+        case OP_LT: { return a < b; }
+        case OP_LTE: { return a <= b; }
+        case OP_HT: { return a > b; }
+        default: { return a >= b; }
+    }
+}
+
+int64_t Trace::variable(const std::string &name, ValueType type)
+{
+    if (type != VALUE_INT && type != VALUE_BOOL) return -1;
+
+    auto position = std::find(this->variables.begin(), this->variables.end(), name);
+    if (position != this->variables.end()) {
+        int64_t index = position - this->variables.begin();
+        return this->types[index] == type ? index : -1;
+    }
+    if (this->variables.size() >= TRACE_MAX_VARIABLES) return -1;
+
+    this->variables.push_back(name);
+    this->types.push_back(type);
+
+    return this->variables.size() - 1;
+}
+
+Trace::~Trace()
+{
+    Assembler::release_code(this->code, this->size);
+}
+
+Trace *Tracer::record(VirtualMachine *vm, uint64_t header)
+{
+    std::unique_ptr<Trace> trace(new Trace);
+    trace->header = header;
+    uint64_t depth = 0;
+
+    for (;;) {
+        if (trace->instructions.size() >= TRACE_MAX_LENGTH) return nullptr;
+
+        uint64_t index = vm->program_counter - vm->code;
+        auto opcode = opcode_generic(vm->code[index]);
+        uint64_t next = index + 1 + opcode_constants(vm->code[index]) + opcode_cache(vm->code[index]);
+        auto a = vm->top_stack - 2, b = vm->top_stack - 1;
+        bool taken = false;
+
+        // Everything is checked before the instruction runs, so an abort leaves it to the interpreter.
+        switch (opcode) {
+            case OP_PUSH: {
+                auto constant = &vm->constants[vm->code[index + 1]];
+                if (depth >= TRACE_MAX_STACK || (constant->type.type != VALUE_INT && constant->type.type != VALUE_BOOL)) return nullptr;
+                vm->push(*constant);
+                depth++;
+                break;
+            }
+            case OP_POP: {
+                if (depth < 1) return nullptr;
+                vm->pop();
+                depth--;
+                break;
+            }
+            case OP_LOAD: {
+                auto name = vm->constants[vm->code[index + 1]].value_string;
+                auto variable = vm->top_frame->heap.find(*name);
+                if (depth >= TRACE_MAX_STACK || variable == vm->top_frame->heap.end() || trace->variable(*name, variable->second.type.type) < 0) return nullptr;
+                vm->push(variable->second);
+                depth++;
+                break;
+            }
+            case OP_STORE: case OP_ONLY_STORE: {
+                auto name = vm->constants[vm->code[index + 1]].value_string;
+                auto variable = vm->top_frame->heap.find(*name);
+                if (depth < 1 || variable == vm->top_frame->heap.end() || variable->second.type.type != b->type.type) return nullptr;
+                if (trace->variable(*name, b->type.type) < 0) return nullptr;
+                vm->store_variable(*name, vm->pop(), opcode == OP_ONLY_STORE);
+                if (opcode == OP_ONLY_STORE) depth--;
+                break;
+            }
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_LT: case OP_LTE: case OP_HT: case OP_HTE: case OP_EQ: case OP_NEQ: {
+                if (depth < 2 || a->type.type != b->type.type) return nullptr;
+                if (a->type.type != VALUE_INT && (a->type.type != VALUE_BOOL || (opcode != OP_EQ && opcode != OP_NEQ))) return nullptr;
+                auto result = binary(opcode, *a, *b);
+                vm->top_stack -= 2;
+                vm->push(result);
+                depth--;
+                break;
+            }
+            case OP_MINUS: {
+                if (depth < 1 || b->type.type != VALUE_INT) return nullptr;
+                vm->push(-*vm->pop());
+                break;
+            }
+            case OP_NOT: {
+                if (depth < 1 || b->type.type != VALUE_BOOL) return nullptr;
+                vm->push(!*vm->pop());
+                break;
+            }
+            case OP_BRANCH_TRUE: case OP_BRANCH_FALSE: {
+                if (depth < 1 || b->type.type != VALUE_BOOL) return nullptr;
+                taken = vm->pop()->value_bool == (opcode == OP_BRANCH_TRUE);
+                depth--;
+                if (taken) opcode_jump_target(&vm->program.image, index, &next);
+                break;
+            }
+            case OP_RJUMP: {
+                opcode_jump_target(&vm->program.image, index, &next);
+                if (next > index) break;
+                // Only the backward jump of the traced loop closes it (inner loops have their own traces).
+                if (next != header || depth != 0) return nullptr;
+                trace->end = index;
+                trace->instructions.push_back({ index, opcode, false });
+                vm->program_counter = vm->code + header;
+                return trace.release();
+            }
+            default: { return nullptr; }
+        }
+
+        trace->instructions.push_back({ index, opcode, taken });
+        vm->program_counter = vm->code + next;
+    }
+}
+
+void Tracer::emit_modrm(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t rm, bool memory, int32_t displacement)
+{
+    this->emit({ static_cast<uint8_t>(0x48 | ((reg >> 3) << 2) | (rm >> 3)) });
+    this->emit(opcode);
+    this->emit({ static_cast<uint8_t>((memory ? 0x80 : 0xC0) | ((reg & 7) << 3) | (rm & 7)) });
+    if (memory) this->emit32(displacement);
+}
+
+uint8_t Tracer::allocate()
+{
+    for (auto reg : temporary_registers) {
+        if (this->free_registers & (1 << reg)) {
+            this->free_registers &= ~(1 << reg);
+            return reg;
+        }
+    }
+    this->failed = true;
+
+    return 0;
+}
+
+void Tracer::release(TraceValue &value)
+{
+    if (value.kind == TRACE_TEMPORARY) this->free_registers |= 1 << value.reg;
+}
+
+void Tracer::load(uint8_t reg, TraceValue &value)
+{
+    switch (value.kind) {
+        case TRACE_CONSTANT: { this->emit_modrm({ 0xC7 }, 0, reg); this->emit32(value.value); break; } // mov reg, imm32
+        case TRACE_TEMPORARY: { if (value.reg != reg) this->emit_modrm({ 0x89 }, value.reg, reg); break; } // mov reg, temporary
+        case TRACE_VARIABLE: {
+            auto home = this->homes[value.value];
+            if (!home) this->emit_modrm({ 0x8B }, reg, RBP, true, value.value * 8); // mov reg, [rbp + variable]
+            else if (home != reg) this->emit_modrm({ 0x89 }, home, reg); // mov reg, home
+            break;
+        }
+    }
+}
+
+uint8_t Tracer::temporary(TraceValue &value)
+{
+    if (value.kind == TRACE_TEMPORARY) return value.reg;
+
+    auto reg = this->allocate();
+    this->load(reg, value);
+    value.kind = TRACE_TEMPORARY;
+    value.reg = reg;
+
+    return reg;
+}
+
+void Tracer::constant(std::vector<TraceValue> &stack, int64_t value, ValueType type)
+{
+    TraceValue result = { TRACE_CONSTANT, type, 0, value };
+
+    // Constants that don't fit an immediate are kept in a register.
+    if (value != static_cast<int32_t>(value)) {
+        result.kind = TRACE_TEMPORARY;
+        result.reg = this->allocate();
+        this->emit({ static_cast<uint8_t>(0x48 | (result.reg >> 3)), static_cast<uint8_t>(0xB8 + (result.reg & 7)) }); // mov reg, imm64
+        this->emit64(value);
+    }
+
+    stack.push_back(result);
+}
+
+void Tracer::emit_operation(uint64_t opcode, uint8_t reg, TraceValue &value)
+{
+    // Emits the register and register / memory form of add, sub, imul or cmp.
+    auto emit_form = [&](uint8_t rm, bool memory, int32_t displacement) {
+        switch (opcode) {
+            case OP_ADD: { this->emit_modrm({ 0x03 }, reg, rm, memory, displacement); break; }
+            case OP_SUB: { this->emit_modrm({ 0x2B }, reg, rm, memory, displacement); break; }
+            case OP_MUL: { this->emit_modrm({ 0x0F, 0xAF }, reg, rm, memory, displacement); break; }
+            default: { this->emit_modrm({ 0x3B }, reg, rm, memory, displacement); break; }
+        }
+    };
+
+    switch (value.kind) {
+        case TRACE_CONSTANT: {
+            switch (opcode) {
+                case OP_ADD: { this->emit_modrm({ 0x81 }, 0, reg); break; } // add reg, imm32
+                case OP_SUB: { this->emit_modrm({ 0x81 }, 5, reg); break; } // sub reg, imm32
+                case OP_MUL: { this->emit_modrm({ 0x69 }, reg, reg); break; } // imul reg, reg, imm32
+                default: { this->emit_modrm({ 0x81 }, 7, reg); break; } // cmp reg, imm32
+            }
+            this->emit32(value.value);
+            break;
+        }
+        case TRACE_TEMPORARY: { emit_form(value.reg, false, 0); break; }
+        case TRACE_VARIABLE: {
+            auto home = this->homes[value.value];
+            if (home) emit_form(home, false, 0);
+            else emit_form(RBP, true, value.value * 8);
+            break;
+        }
+    }
+}
+
+void Tracer::emit_guard(uint8_t condition, uint64_t resume, std::vector<TraceValue> &stack, Trace *trace)
+{
+    trace->exits.push_back({ resume, resume >= trace->header && resume <= trace->end, stack });
+    this->emit({ 0x0F, static_cast<uint8_t>(0x80 | condition) }); // jcc exit
+    this->guards.push_back(this->buffer.size());
+    this->emit32(0);
+}
+
+bool Tracer::compile(VirtualMachine *vm, Trace *trace)
+{
+    #if JIT_SUPPORTED
+        auto image = &vm->program.image;
+        auto variables = trace->variables.size();
+        this->buffer.clear();
+        this->guards.clear();
+        this->failed = false;
+        this->free_registers = 0;
+        for (auto reg : temporary_registers) this->free_registers |= 1 << reg;
+
+        // Returns the variable index of a load or store.
+        auto variable_of = [&](const TraceInstruction &instruction) {
+            auto name = *image->constants[image->code[instruction.index + 1]].value_string;
+            return std::find(trace->variables.begin(), trace->variables.end(), name) - trace->variables.begin();
+        };
+
+        // The most used variables live in registers, the rest in the variables array.
+        std::vector<uint64_t> uses(variables, 0), order(variables);
+        for (auto &instruction : trace->instructions) {
+            if (instruction.opcode == OP_LOAD || instruction.opcode == OP_STORE || instruction.opcode == OP_ONLY_STORE) uses[variable_of(instruction)]++;
+        }
+        for (uint64_t i = 0; i < variables; i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) { return uses[a] > uses[b]; });
+        this->homes.assign(variables, 0);
+        for (uint64_t i = 0; i < variables && i < sizeof(variable_registers); i++) this->homes[order[i]] = variable_registers[i];
+
+        // Prologue: save the callee saved registers and the stack buffer, keep the variables in rbp.
+        this->emit({ 0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x56 }); // push rbp, rbx, r12, r13, r14, r15, rsi
+        this->emit({ 0x48, 0x89, 0xFD }); // mov rbp, rdi
+        for (uint64_t i = 0; i < variables; i++) {
+            if (this->homes[i]) this->emit_modrm({ 0x8B }, this->homes[i], RBP, true, i * 8); // mov home, [rbp + variable]
+        }
+        auto loop = this->buffer.size();
+
+        std::vector<TraceValue> stack;
+        for (uint64_t i = 0; i < trace->instructions.size() && !this->failed; i++) {
+            auto &instruction = trace->instructions[i];
+            switch (instruction.opcode) {
+                case OP_PUSH: {
+                    auto constant = &image->constants[image->code[instruction.index + 1]];
+                    this->constant(stack, constant->type.type == VALUE_INT ? constant->value_int : constant->value_bool, constant->type.type);
+                    break;
+                }
+                case OP_POP: { this->release(stack.back()); stack.pop_back(); break; }
+                case OP_LOAD: {
+                    int64_t index = variable_of(instruction);
+                    stack.push_back({ TRACE_VARIABLE, trace->types[index], 0, index });
+                    break;
+                }
+                case OP_STORE: case OP_ONLY_STORE: {
+                    int64_t index = variable_of(instruction);
+                    auto home = this->homes[index];
+                    // The older loads of the variable must keep the old value.
+                    for (uint64_t j = 0; j + 1 < stack.size(); j++) {
+                        if (stack[j].kind == TRACE_VARIABLE && stack[j].value == index) this->temporary(stack[j]);
+                    }
+                    auto &value = stack.back();
+                    if (value.kind != TRACE_VARIABLE || value.value != index) {
+                        if (home) this->load(home, value);
+                        else if (value.kind == TRACE_CONSTANT) { this->emit_modrm({ 0xC7 }, 0, RBP, true, index * 8); this->emit32(value.value); } // mov qword [rbp + variable], imm32
+                        else {
+                            this->load(R11, value);
+                            this->emit_modrm({ 0x89 }, R11, RBP, true, index * 8); // mov [rbp + variable], r11
+                        }
+                        this->release(value);
+                        value = { TRACE_VARIABLE, trace->types[index], 0, index };
+                    }
+                    if (instruction.opcode == OP_ONLY_STORE) stack.pop_back();
+                    break;
+                }
+                case OP_ADD: case OP_SUB: case OP_MUL: {
+                    auto b = stack.back(); stack.pop_back();
+                    auto a = stack.back(); stack.pop_back();
+                    if (a.kind == TRACE_CONSTANT && b.kind == TRACE_CONSTANT) {
+                        this->constant(stack, fold(instruction.opcode, a.value, b.value), VALUE_INT);
+                        break;
+                    }
+                    // Reuse the temporary of the right operand when the operation is commutative.
+                    if (instruction.opcode != OP_SUB && a.kind != TRACE_TEMPORARY && b.kind == TRACE_TEMPORARY) std::swap(a, b);
+                    auto reg = this->temporary(a);
+                    this->emit_operation(instruction.opcode, reg, b);
+                    this->release(b);
+                    stack.push_back(a);
+                    break;
+                }
+                case OP_MINUS: case OP_NOT: {
+                    auto &a = stack.back();
+                    if (a.kind == TRACE_CONSTANT) {
+                        a.value = instruction.opcode == OP_MINUS ? -static_cast<uint64_t>(a.value) : !a.value;
+                        if (a.value != static_cast<int32_t>(a.value)) { auto value = a; stack.pop_back(); this->constant(stack, value.value, value.type); }
+                        break;
+                    }
+                    auto reg = this->temporary(a);
+                    if (instruction.opcode == OP_MINUS) this->emit_modrm({ 0xF7 }, 3, reg); // neg reg
+                    else { this->emit_modrm({ 0x83 }, 6, reg); this->emit({ 0x01 }); } // xor reg, 1
+                    break;
+                }
+                case OP_EQ: case OP_NEQ: case OP_LT: case OP_LTE: case OP_HT: case OP_HTE: {
+                    auto b = stack.back(); stack.pop_back();
+                    auto a = stack.back(); stack.pop_back();
+                    auto condition = condition_code(instruction.opcode);
+                    bool folded = a.kind == TRACE_CONSTANT && b.kind == TRACE_CONSTANT;
+                    if (!folded) {
+                        if (a.kind == TRACE_CONSTANT) {
+                            std::swap(a, b);
+                            condition = swap_condition(condition);
+                        }
+                        uint8_t reg = R11;
+                        if (a.kind == TRACE_TEMPORARY) reg = a.reg;
+                        else if (a.kind == TRACE_VARIABLE && this->homes[a.value]) reg = this->homes[a.value];
+                        else this->load(R11, a);
+                        this->emit_operation(OP_EQ, reg, b); // cmp reg, b
+                        this->release(a);
+                        this->release(b);
+                    }
+
+                    // A comparison followed by a branch becomes a guard on the flags.
+                    auto next = i + 1 < trace->instructions.size() ? &trace->instructions[i + 1] : nullptr;
+                    if (next && (next->opcode == OP_BRANCH_TRUE || next->opcode == OP_BRANCH_FALSE)) {
+                        i++;
+                        bool recorded = next->taken == (next->opcode == OP_BRANCH_TRUE);
+                        uint64_t resume = next->index + 1 + opcode_constants(next->opcode);
+                        if (!next->taken) opcode_jump_target(image, next->index, &resume);
+                        if (folded) this->failed |= (fold(instruction.opcode, a.value, b.value) != 0) != recorded;
+                        else this->emit_guard(recorded ? condition ^ 1 : condition, resume, stack, trace);
+                        break;
+                    }
+
+                    if (folded) {
+                        this->constant(stack, fold(instruction.opcode, a.value, b.value), VALUE_BOOL);
+                        break;
+                    }
+                    auto reg = this->allocate();
+                    this->emit({ static_cast<uint8_t>(0x40 | (reg >> 3)), 0x0F, static_cast<uint8_t>(0x90 | condition), static_cast<uint8_t>(0xC0 | (reg & 7)) }); // setcc reg8
+                    this->emit_modrm({ 0x0F, 0xB6 }, reg, reg); // movzx reg, reg8
+                    stack.push_back({ TRACE_TEMPORARY, VALUE_BOOL, reg, 0 });
+                    break;
+                }
+                case OP_BRANCH_TRUE: case OP_BRANCH_FALSE: {
+                    auto value = stack.back(); stack.pop_back();
+                    bool recorded = instruction.taken == (instruction.opcode == OP_BRANCH_TRUE);
+                    uint64_t resume = instruction.index + 1 + opcode_constants(instruction.opcode);
+                    if (!instruction.taken) opcode_jump_target(image, instruction.index, &resume);
+                    if (value.kind == TRACE_CONSTANT) {
+                        this->failed |= (value.value != 0) != recorded;
+                        break;
+                    }
+                    if (value.kind == TRACE_TEMPORARY) this->emit_modrm({ 0x85 }, value.reg, value.reg); // test reg, reg
+                    else if (this->homes[value.value]) this->emit_modrm({ 0x85 }, this->homes[value.value], this->homes[value.value]); // test home, home
+                    else { this->emit_modrm({ 0x81 }, 7, RBP, true, value.value * 8); this->emit32(0); } // cmp qword [rbp + variable], 0
+                    this->release(value);
+                    this->emit_guard(recorded ? 0x4 : 0x5, resume, stack, trace); // jz / jnz exit
+                    break;
+                }
+                case OP_RJUMP: {
+                    // Forward jumps are already followed by the trace.
+                    if (instruction.index != trace->end) break;
+                    this->emit({ 0xE9 }); this->emit32(loop - (this->buffer.size() + 4)); // jmp loop
+                    break;
+                }
+                default: { this->failed = true; break; }
+            }
+        }
+        if (this->failed || !stack.empty()) return false;
+
+        // The side exits write the temporaries of the stack and the variables in registers back.
+        std::vector<size_t> epilogues;
+        for (uint64_t i = 0; i < trace->exits.size(); i++) {
+            this->patch(this->guards[i], this->buffer.size());
+            auto &exit = trace->exits[i];
+            this->emit({ 0x4C, 0x8B, 0x1C, 0x24 }); // mov r11, [rsp]
+            for (uint64_t j = 0; j < exit.stack.size(); j++) {
+                if (exit.stack[j].kind == TRACE_TEMPORARY) this->emit_modrm({ 0x89 }, exit.stack[j].reg, R11, true, j * 8); // mov [r11 + value], reg
+            }
+            for (uint64_t j = 0; j < variables; j++) {
+                if (this->homes[j]) this->emit_modrm({ 0x89 }, this->homes[j], RBP, true, j * 8); // mov [rbp + variable], home
+            }
+            this->emit({ 0xB8 }); this->emit32(i); // mov eax, exit
+            this->emit({ 0xE9 }); epilogues.push_back(this->buffer.size()); this->emit32(0); // jmp epilogue
+        }
+        for (auto jump : epilogues) this->patch(jump, this->buffer.size());
+        this->emit({ 0x48, 0x83, 0xC4, 0x08 }); // add rsp, 8
+        this->emit({ 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xC3 }); // pop r15, r14, r13, r12, rbx, rbp; ret
+
+        trace->code = this->finish(&trace->size);
+
+        return trace->code != nullptr;
+    #else
+        (void) vm;
+        (void) trace;
+        return false;
+    #endif
+}
+
+void Tracer::run(VirtualMachine *vm, TraceLoop *loop)
+{
+    auto trace = loop->trace.get();
+    Value *slots[TRACE_MAX_VARIABLES];
+    int64_t variables[TRACE_MAX_VARIABLES], stack[TRACE_MAX_STACK];
+
+    // The variable types are only checked here, the machine code assumes them.
+    for (uint64_t i = 0; i < trace->variables.size(); i++) {
+        auto variable = vm->top_frame->heap.find(trace->variables[i]);
+        if (variable == vm->top_frame->heap.end() || variable->second.type.type != trace->types[i]) return;
+        slots[i] = &variable->second;
+        variables[i] = trace->types[i] == VALUE_INT ? variable->second.value_int : variable->second.value_bool;
+    }
+
+    auto exit = &trace->exits[reinterpret_cast<TraceCode>(trace->code)(variables, stack)];
+    this->executions++;
+
+    // Box the variables and the stack values back.
+    for (uint64_t i = 0; i < trace->variables.size(); i++) {
+        *slots[i] = trace->types[i] == VALUE_INT ? Value(variables[i]) : Value(variables[i] != 0);
+    }
+    for (uint64_t i = 0; i < exit->stack.size(); i++) {
+        auto &value = exit->stack[i];
+        int64_t result = value.kind == TRACE_CONSTANT ? value.value : value.kind == TRACE_VARIABLE ? variables[value.value] : stack[i];
+        vm->push(value.type == VALUE_INT ? Value(result) : Value(result != 0));
+    }
+    vm->program_counter = vm->code + exit->resume;
+
+    // A path that keeps failing it's guard gets it's own trace.
+    if (exit->inside) {
+        this->side_exits++;
+        if (++exit->taken >= TRACE_HOT_EXIT && loop->records < TRACE_MAX_RECORDS) {
+            loop->trace.reset();
+            loop->counter = TRACE_HOT_LOOP - 1;
+            this->retraced++;
+        }
+    }
+}
+
+void Tracer::reset(uint64_t size)
+{
+    this->loops.clear();
+    this->loops.resize(size);
+}
+
+void Tracer::loop(VirtualMachine *vm)
+{
+    uint64_t header = vm->program_counter - vm->code;
+    auto loop = &this->loops[header];
+
+    if (loop->trace) {
+        this->run(vm, loop);
+        return;
+    }
+    if (loop->blacklisted || ++loop->counter < TRACE_HOT_LOOP) return;
+
+    loop->counter = 0;
+    loop->records++;
+    std::unique_ptr<Trace> trace(this->record(vm, header));
+    if (!trace || !this->compile(vm, trace.get())) {
+        // The recorded iteration may have just left the loop, so it's tried again at the next one.
+        if (loop->records >= TRACE_MAX_RECORDS) loop->blacklisted = true;
+        else loop->counter = TRACE_HOT_LOOP - 1;
+        this->aborted++;
+        return;
+    }
+    this->recorded++;
+    loop->trace = std::move(trace);
+
+    // The recorded iteration ended at the header, the trace runs the next ones.
+    this->run(vm, loop);
+}
+
+#undef RBP
+#undef R11
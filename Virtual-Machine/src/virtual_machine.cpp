@@ -8,23 +8,53 @@
  */
 
 #include "../include/virtual_machine.hpp"
+#include "../include/aot.hpp"
 #include "../../Compiler/include/compiler.hpp"
+#include "../../Compiler/include/verifier.hpp"
 #include "../../Logger/include/logger.hpp"
+#include <chrono>
+#include <fstream>
 
 #define BINARY_POP() Value *b = this->pop(); Value *a = this->pop()
 #define READ_INSTRUCTION() (*this->program_counter++)
-#define READ_CONSTANT() (this->get_current_memory()->constants[READ_INSTRUCTION()])
+#define READ_CONSTANT() (this->constants[READ_INSTRUCTION()])
 #define READ_INT() (READ_CONSTANT().value_int)
 #define READ_VARIABLE() (*READ_CONSTANT().value_string)
 
+// Quickens the binary operator that was just read when both operands are ints or floats.
+#define QUICKEN_BINARY(quick_int, quick_float) \
+    if (a->type.type == b->type.type && a->type.type == VALUE_INT) this->quicken(this->program_counter - 1, quick_int); \
+    else if (a->type.type == b->type.type && a->type.type == VALUE_FLOAT) this->quicken(this->program_counter - 1, quick_float)
+
+// Performs a quickened binary operator. If the operands are not of the expected
+// type it's rewritten back to the generic operator and the generic result is used.
+#define QUICK_BINARY(generic, kind, quick_result, generic_result) \
+    BINARY_POP(); \
+    if (a->type.type == kind && b->type.type == kind) this->push(Value(quick_result)); \
+    else { this->quicken(this->program_counter - 1, generic); this->push(generic_result); }
+
+const std::unordered_map<std::string, NativeFunction> VirtualMachine::natives = {
+    { "iter", &VirtualMachine::native_iter },
+    { "map", &VirtualMachine::native_map },
+    { "filter", &VirtualMachine::native_filter },
+    { "take", &VirtualMachine::native_take },
+    { "zip", &VirtualMachine::native_zip },
+    { "collect", &VirtualMachine::native_collect },
+    { "flush", &VirtualMachine::native_flush },
+    { "heap_snapshot", &VirtualMachine::native_heap_snapshot },
+};
+
 void VirtualMachine::push(Value value)
 {
-    if (this->top_stack - this->stack >= STACK_SIZE) {
+    *this->top_stack++ = value;
+}
+
+void VirtualMachine::ensure_stack(uint64_t slots)
+{
+    if (static_cast<uint64_t>(STACK_SIZE - (this->top_stack - this->stack)) < slots) {
         logger->error("Stack overflow", this->get_current_line());
         exit(EXIT_FAILURE);
     }
-
-    *this->top_stack++ = value;
 }
 
 Value *VirtualMachine::pop()
@@ -71,6 +101,33 @@ void VirtualMachine::do_access()
     }
 }
 
+void VirtualMachine::do_store_access()
+{
+    auto var = this->top_frame->heap.at(READ_VARIABLE());
+    auto index = this->pop();
+    auto value = *this->pop();
+
+    if (var.is(VALUE_LIST) && index->is(VALUE_INT)) {
+        if (index->value_int < 0 || static_cast<uint64_t>(index->value_int) >= var.value_list->size()) {
+            logger->error("List index out of range", this->get_current_line());
+            exit(EXIT_FAILURE);
+        }
+        (*var.value_list)[index->value_int] = value;
+        this->heap.write_barrier(var.value_list);
+    } else if (var.is(VALUE_DICT) && index->is(VALUE_STRING)) {
+        auto dictionary = var.value_dict;
+        if (dictionary->values.find(*index->value_string) == dictionary->values.end()) dictionary->key_order.push_back(*index->value_string);
+        dictionary->values[*index->value_string] = value;
+        this->heap.write_barrier(dictionary);
+        this->heap.charge(dictionary);
+    } else {
+        logger->error("Invalid access assignment. Lists need a number as a key and dictionaries a string", this->get_current_line());
+        exit(EXIT_FAILURE);
+    }
+
+    this->push(value);
+}
+
 void VirtualMachine::do_declare()
 {
     // Get the variable name
@@ -85,45 +142,617 @@ void VirtualMachine::do_declare()
     this->top_frame->heap[name] = default_value;
 }
 
+void VirtualMachine::do_function(uint64_t index, Type return_type, bool generator)
+{
+    auto function = &this->program.function_table[index];
+    auto frame = allocate<Frame>(OBJECT_FRAME, *this->top_frame);
+    Value value(function->entry, return_type, frame, generator, function->max_stack);
+
+    // The frame is captured before the function is stored, so the variable it's declared with
+    // still holds it's empty value there. It holds the function itself to let it call itself.
+    if (!function->binding.empty()) {
+        auto self = frame->heap.find(function->binding);
+        if (self != frame->heap.end()) {
+            self->second = value;
+            this->heap.write_barrier(frame);
+        }
+    }
+
+    this->push(value);
+}
+
 void VirtualMachine::do_return()
 {
-    // Check the return type
-    auto return_value = this->top_frame->caller;
+    if (this->profiling_calls) this->call_profiler.leave();
+
     auto returned_value = *(this->top_stack - 1);
-    *(this->top_stack - 1) = returned_value.cast(return_value.value_fun->return_type);
+
+    // Unwind the stack slots used by the frame (for example the iterators of for loops).
+    this->top_stack = this->top_frame->stack_base;
+
+    if (this->top_frame->generator) {
+        // A generator that returns is exhausted, the returned value is discarded.
+        auto generator = this->top_frame->generator;
+        generator->done = true;
+        generator->stack.clear();
+        generator->frame = nullptr;
+    } else {
+        // Check the return type
+        this->push(returned_value.cast(this->top_frame->caller.value_fun->return_type));
+    }
 
     // Turn back the program counter to the original one.
     this->program_counter = (this->top_frame--)->return_address;
-
-    // Change back the current memory
-    this->current_memory--;
 }
 
 void VirtualMachine::do_call()
 {
+    auto instruction = this->program_counter - 1;
     auto name = READ_VARIABLE();
     auto arguments = READ_INT();
+    auto cache = this->program_counter;
+    this->program_counter += CALL_CACHE_WORDS;
+
+    // Native functions are used when no variable shadows them.
+    if (!this->variable_declared(name)) {
+        auto native = VirtualMachine::natives.find(name);
+        if (native != VirtualMachine::natives.end()) {
+            *cache = reinterpret_cast<uint64_t>(&*native);
+            this->quicken(instruction, OP_CALL_NATIVE);
+            this->call_native(native->second, arguments);
+            return;
+        }
+    }
+
     auto value = this->load_variable(name);
 
-    if (!value.type.is(VALUE_FUN)) {
+    if (!value.type.is(VALUE_FUN) && !value.type.is(VALUE_CLASS)) {
         logger->error("Target is not callable. Are you sure that '" + name + "' is a function?");
         exit(EXIT_FAILURE);
     }
 
+    if (value.type.is(VALUE_FUN) && !value.value_fun->generator) {
+        *cache = reinterpret_cast<uint64_t>(value.value_fun);
+        this->quicken(instruction, OP_CALL_FUNCTION);
+    }
+
+    this->call(value, arguments);
+}
+
+void VirtualMachine::do_call_function()
+{
+    auto instruction = this->program_counter - 1;
+    auto name = READ_CONSTANT().value_string;
+    auto arguments = READ_INT();
+    auto target = reinterpret_cast<ValueFunction *>(READ_INSTRUCTION());
+
+    // The guard: the variable must still hold the cached function. Otherwise the generic
+    // instruction is restored and executed again (it caches the new target). The cached
+    // pointer is only compared, a collection may have moved the function it was taken from.
+    auto variable = this->top_frame->heap.find(*name);
+    if (variable == this->top_frame->heap.end() || variable->second.type.type != VALUE_FUN || variable->second.value_fun != target || target->generator) {
+        this->quicken(instruction, OP_CALL);
+        this->program_counter = instruction;
+        return;
+    }
+
+    this->enter(target, target->index, arguments);
+}
+
+void VirtualMachine::do_call_native()
+{
+    auto instruction = this->program_counter - 1;
+    auto name = READ_CONSTANT().value_string;
+    auto arguments = READ_INT();
+    auto native = reinterpret_cast<const std::pair<const std::string, NativeFunction> *>(READ_INSTRUCTION());
+
+    // The guard: a variable declared with the same name shadows the native function.
+    if (this->top_frame->heap.find(*name) != this->top_frame->heap.end()) {
+        this->quicken(instruction, OP_CALL);
+        this->program_counter = instruction;
+        return;
+    }
+
+    this->call_native(native->second, arguments);
+}
+
+void VirtualMachine::call_native(NativeFunction native, uint64_t arguments)
+{
+    std::vector<Value> values(this->top_stack - arguments, this->top_stack);
+    this->top_stack -= arguments;
+    RootScope scope(&this->handles, {}, { &values });
+    this->push((this->*native)(values));
+}
+
+void VirtualMachine::quicken(uint64_t *instruction, uint64_t opcode)
+{
+    if (opcode > OP_EXIT) this->quickenings++;
+    else this->deoptimizations++;
+
+    *instruction = opcode;
+}
+
+void VirtualMachine::call(Value function, uint64_t arguments)
+{
+    if (function.is(VALUE_CLASS)) {
+        this->construct(function.value_class, arguments);
+        return;
+    }
+
+    if (function.value_fun->generator) {
+        // Calling a generator only creates the iterator. The arguments are kept as
+        // it's saved stack so the function prologue stores them on the first resume.
+        std::vector<Value> stack(this->top_stack - arguments, this->top_stack);
+        this->top_stack -= arguments;
+        this->push(Value(allocate<ValueIterator>(OBJECT_ITERATOR, function, allocate<Frame>(OBJECT_FRAME, *function.value_fun->frame), function.value_fun->index, stack)));
+        return;
+    }
+
+    this->enter(function.value_fun, function.value_fun->index, arguments);
+}
+
+void VirtualMachine::enter(ValueFunction *function, uint64_t index, uint64_t arguments)
+{
     // Set the new frame to work on.
-    *(++this->top_frame) = *value.value_fun->frame;
+    *(++this->top_frame) = *function->frame;
 
     // Set the return address
-    this->top_frame->return_address = this->program_counter; // +3 becuase of the OP_CALL and it's 2 arguments.
+    this->top_frame->return_address = this->program_counter;
 
     // Set the frame caller.
-    this->top_frame->caller = value;
+    this->top_frame->caller = Value(function);
+    if (this->profiling_calls) this->call_profiler.enter(index);
 
-    // Set the memory to the functions memory.
-    *(++this->current_memory) = FUNCTIONS_MEMORY;
+    // The arguments belong to the new frame.
+    this->top_frame->stack_base = this->top_stack - arguments;
+    this->ensure_stack(function->max_stack);
+    this->top_frame->generator = nullptr;
 
     // Set the program counter depending on the function index.
-    this->program_counter = &this->get_current_memory()->code[value.value_fun->index];
+    this->program_counter = this->code + index;
+}
+
+void VirtualMachine::construct(ValueClass *klass, uint64_t arguments)
+{
+    auto object = Value(allocate<ValueObject>(OBJECT_OBJECT, klass));
+    auto constructor = klass->method_slots.find("constructor");
+
+    if (constructor == klass->method_slots.end()) {
+        if (arguments > 0) {
+            logger->error("The class '" + klass->name + "' has no constructor to pass the arguments to.", this->get_current_line());
+            exit(EXIT_FAILURE);
+        }
+        this->push(object);
+        return;
+    }
+
+    // Place the object below the arguments, it's the 'self' of the constructor.
+    this->ensure_stack(1);
+    this->push(object);
+    for (auto slot = this->top_stack - 1; slot > this->top_stack - 1 - arguments; slot--) *slot = *(slot - 1);
+    *(this->top_stack - 1 - arguments) = object;
+
+    this->call(klass->methods[constructor->second], arguments + 1);
+}
+
+ValueObject *VirtualMachine::get_object(Value *value)
+{
+    if (!value->is(VALUE_OBJECT) || !value->value_object) {
+        logger->error("Expected a constructed object to access it's properties.", this->get_current_line());
+        exit(EXIT_FAILURE);
+    }
+
+    return value->value_object;
+}
+
+void VirtualMachine::store_slot(ValueObject *object, uint64_t slot, Value *value)
+{
+    auto type = &object->klass->field_types[slot];
+    object->slots[slot] = value->type.same_as(type) ? *value : value->cast(*type);
+    this->heap.write_barrier(object);
+}
+
+void VirtualMachine::do_class()
+{
+    auto klass = READ_CONSTANT().value_class;
+    auto methods = READ_INT();
+
+    // Bind the method functions, they are on the stack in declaration order.
+    // If the class was already bound the existing functions are updated in
+    // place so the method inline caches pointing to them stay valid. The
+    // functions live in the old generation since they are never moved.
+    if (klass->methods.size() == static_cast<uint64_t>(methods)) {
+        for (auto i = 0; i < methods; i++) *klass->methods[i].value_fun = *(this->top_stack - methods + i)->value_fun;
+    } else {
+        RegionScope scope(nullptr);
+        klass->methods.clear();
+        for (auto i = 0; i < methods; i++) klass->methods.push_back(Value(allocate<ValueFunction>(OBJECT_FUNCTION, *(this->top_stack - methods + i)->value_fun)));
+    }
+    for (auto &method : klass->methods) this->heap.write_barrier(method.value_fun);
+    this->heap.write_barrier(klass);
+    this->top_stack -= methods;
+
+    this->push(Value(klass));
+}
+
+void VirtualMachine::do_slot(bool store)
+{
+    auto slot = READ_INT();
+    auto object = this->get_object(this->pop());
+
+    if (store) this->store_slot(object, slot, this->top_stack - 1);
+    else this->push(object->slots[slot]);
+}
+
+void VirtualMachine::do_field(bool store)
+{
+    auto name = READ_CONSTANT().value_string;
+    auto cache = this->program_counter;
+    this->program_counter += 2;
+    auto object = this->get_object(this->pop());
+    auto shape = reinterpret_cast<uint64_t>(object->klass);
+
+    // The inline cache stores the last seen shape and it's slot offset.
+    if (cache[0] != shape) {
+        auto slot = object->klass->slots.find(*name);
+        if (slot == object->klass->slots.end()) {
+            logger->error("The class '" + object->klass->name + "' has no field '" + *name + "'.", this->get_current_line());
+            exit(EXIT_FAILURE);
+        }
+        cache[0] = shape;
+        cache[1] = slot->second;
+    }
+
+    if (store) this->store_slot(object, cache[1], this->top_stack - 1);
+    else this->push(object->slots[cache[1]]);
+}
+
+void VirtualMachine::do_invoke()
+{
+    auto name = READ_CONSTANT().value_string;
+    auto arguments = READ_INT();
+    auto cache = this->program_counter;
+    this->program_counter += INVOKE_CACHE_WORDS;
+    auto object = this->get_object(this->top_stack - arguments - 1);
+    auto shape = reinterpret_cast<uint64_t>(object->klass);
+
+    // Look for the shape in the inline cache entries (shape, function, code index).
+    // The object stays below the arguments as the method 'self'.
+    auto entries = cache + 2;
+    uint8_t entry = 0;
+    for (; entry < INVOKE_CACHE_ENTRIES && entries[entry * 3] != 0; entry++) {
+        if (entries[entry * 3] == shape) {
+            cache[0]++; this->invoke_hits++;
+            this->enter(reinterpret_cast<ValueFunction *>(entries[entry * 3 + 1]), entries[entry * 3 + 2], arguments + 1);
+            return;
+        }
+    }
+
+    cache[1]++; this->invoke_misses++;
+
+    auto method = object->klass->method_slots.find(*name);
+    if (method == object->klass->method_slots.end()) {
+        logger->error("The class '" + object->klass->name + "' has no method '" + *name + "'.", this->get_current_line());
+        exit(EXIT_FAILURE);
+    }
+
+    auto function = object->klass->methods[method->second];
+
+    // Fill a free entry. Once all entries are used the call site is megamorphic
+    // and keeps using the method lookup. Generators are never cached.
+    if (entry < INVOKE_CACHE_ENTRIES && !function.value_fun->generator) {
+        entries[entry * 3] = shape;
+        entries[entry * 3 + 1] = reinterpret_cast<uint64_t>(function.value_fun);
+        entries[entry * 3 + 2] = function.value_fun->index;
+    }
+
+    this->call(function, arguments + 1);
+}
+
+void VirtualMachine::dump_inline_caches(Memory *memory)
+{
+    for (uint64_t i = 0; i < memory->code.size(); i += 1 + opcode_constants(memory->code[i]) + opcode_cache(memory->code[i])) {
+        if (memory->code[i] != OP_INVOKE) continue;
+        auto cache = &memory->code[i + 1 + opcode_constants(OP_INVOKE)];
+        uint8_t entries = 0;
+        while (entries < INVOKE_CACHE_ENTRIES && cache[2 + entries * 3] != 0) entries++;
+        printf(
+            "Method '%s' [Line %u]: %llu hits, %llu misses, %u shapes%s\n", memory->constants[memory->code[i + 1]].value_string->c_str(), memory->lines[i],
+            static_cast<unsigned long long>(cache[0]), static_cast<unsigned long long>(cache[1]), entries, entries == INVOKE_CACHE_ENTRIES ? " (megamorphic)" : ""
+        );
+    }
+}
+
+void VirtualMachine::report_runtime(double run_time)
+{
+    printf("Method inline caches: %llu hits, %llu misses\n", static_cast<unsigned long long>(this->invoke_hits), static_cast<unsigned long long>(this->invoke_misses));
+    this->dump_inline_caches(&this->program.image);
+    printf("Quickened instructions: %llu rewrites, %llu deoptimizations\n", static_cast<unsigned long long>(this->quickenings), static_cast<unsigned long long>(this->deoptimizations));
+    if (this->tiered) {
+        printf(
+            "Tiering: %llu hot functions, %llu background compilations, %llu installed, %llu entries to the compiled code\n",
+            static_cast<unsigned long long>(this->tiering.hot_functions), static_cast<unsigned long long>(this->tiering.compilations.load()),
+            static_cast<unsigned long long>(this->tiering.installations), static_cast<unsigned long long>(this->tier_entries)
+        );
+    }
+    if (this->osr) {
+        printf(
+            "On-stack replacement: %llu interpreted backward jumps, %llu entries to the compiled code\n",
+            static_cast<unsigned long long>(this->back_edges), static_cast<unsigned long long>(this->osr_entries)
+        );
+    }
+    if (this->tracing) {
+        printf(
+            "Traces: %llu recorded, %llu aborted, %llu retraced, %llu runs, %llu side exits\n",
+            static_cast<unsigned long long>(this->tracer.recorded), static_cast<unsigned long long>(this->tracer.aborted),
+            static_cast<unsigned long long>(this->tracer.retraced), static_cast<unsigned long long>(this->tracer.executions),
+            static_cast<unsigned long long>(this->tracer.side_exits)
+        );
+    }
+
+    printf("\nAllocation statistics:\n");
+    print_pool_statistics();
+    printf("\nGarbage collector statistics:\n");
+    this->heap.print_statistics(run_time);
+}
+
+Value VirtualMachine::call_function(Value function, std::vector<Value> arguments)
+{
+    auto frame = this->top_frame;
+
+    this->ensure_stack(arguments.size());
+    for (auto &argument : arguments) this->push(argument);
+    this->call(function, arguments.size());
+
+    // Run the function until it returns back to the current frame.
+    if (this->top_frame != frame) this->execute(frame);
+
+    return *this->pop();
+}
+
+void VirtualMachine::do_yield()
+{
+    if (this->profiling_calls) this->call_profiler.leave();
+
+    auto generator = this->top_frame->generator;
+    auto value = *this->pop();
+
+    // Suspend the generator: save it's stack, where to resume and it's variables.
+    generator->stack.assign(this->top_frame->stack_base, this->top_stack);
+    this->top_stack = this->top_frame->stack_base;
+    generator->resume = this->program_counter - this->code;
+    generator->frame->heap.swap(this->top_frame->heap);
+    this->heap.write_barrier(generator);
+    this->heap.write_barrier(generator->frame);
+    this->heap.charge(generator);
+    this->heap.charge(generator->frame);
+
+    // Turn back to the code that resumed the generator.
+    this->program_counter = (this->top_frame--)->return_address;
+
+    this->push(value);
+}
+
+bool VirtualMachine::resume(Value value, Value *result)
+{
+    auto generator = value.value_iter;
+    if (generator->done) return false;
+
+    if (generator->running) {
+        logger->error("A generator can't be resumed while it's running.", this->get_current_line());
+        exit(EXIT_FAILURE);
+    }
+
+    auto frame = this->top_frame;
+
+    // Restore the suspended frame. The variables are swapped to avoid copying them
+    // (the old variables of the frame slot are cleared so they are never seen again).
+    ++this->top_frame;
+    this->top_frame->heap.clear();
+    this->top_frame->heap.swap(generator->frame->heap);
+    this->top_frame->return_address = this->program_counter;
+    this->top_frame->caller = generator->target;
+    this->top_frame->stack_base = this->top_stack;
+    this->top_frame->generator = generator;
+    if (this->profiling_calls) this->call_profiler.enter(generator->target.value_fun->index);
+    this->ensure_stack(generator->stack.size() + generator->target.value_fun->max_stack);
+    for (auto &value : generator->stack) this->push(value);
+
+    this->program_counter = this->code + generator->resume;
+
+    generator->running = true;
+    {
+        RootScope scope(&this->handles, { &value });
+        this->execute(frame);
+    }
+
+    // A collection may have moved the generator.
+    generator = value.value_iter;
+    generator->running = false;
+
+    if (generator->done) return false;
+
+    *result = *this->pop();
+
+    return true;
+}
+
+bool VirtualMachine::iterator_next(Value value, Value *result)
+{
+    if (value.value_iter->done) return false;
+
+    // The sources and the targets run nested main loops that may collect and move
+    // the iterator, so it is read again from the rooted value after each one.
+    RootScope scope(&this->handles, { &value });
+    auto iterator = value.value_iter;
+
+    switch (iterator->kind) {
+        case ITERATOR_LIST: {
+            if (static_cast<uint64_t>(iterator->index) < iterator->target.value_list->size()) {
+                *result = (*iterator->target.value_list)[iterator->index++];
+                return true;
+            }
+            break;
+        }
+        case ITERATOR_GENERATOR: { return this->resume(value, result); }
+        case ITERATOR_MAP: {
+            Value element;
+            if (this->iterator_next(iterator->sources[0], &element)) {
+                *result = this->call_function(value.value_iter->target, { element });
+                return true;
+            }
+            break;
+        }
+        case ITERATOR_FILTER: {
+            Value element;
+            RootScope elements(&this->handles, { &element });
+            while (this->iterator_next(value.value_iter->sources[0], &element)) {
+                if (this->call_function(value.value_iter->target, { element }).to_bool()) {
+                    *result = element;
+                    return true;
+                }
+            }
+            break;
+        }
+        case ITERATOR_TAKE: {
+            if (iterator->index > 0 && this->iterator_next(iterator->sources[0], result)) {
+                value.value_iter->index--;
+                return true;
+            }
+            break;
+        }
+        case ITERATOR_ZIP: {
+            Value a, b;
+            RootScope elements(&this->handles, { &a });
+            if (this->iterator_next(iterator->sources[0], &a) && this->iterator_next(value.value_iter->sources[1], &b)) {
+                *result = Value(std::vector<Value>({ a, b }));
+                return true;
+            }
+            break;
+        }
+    }
+
+    // Once exhausted, the iterator stays exhausted.
+    value.value_iter->done = true;
+
+    return false;
+}
+
+Value VirtualMachine::to_iterator(Value value)
+{
+    if (value.is(VALUE_ITER)) return value;
+    if (value.is(VALUE_LIST)) return Value(allocate<ValueIterator>(OBJECT_ITERATOR, ITERATOR_LIST, value));
+
+    logger->error("The value is not iterable. Only lists and iterators can be iterated.", this->get_current_line());
+    exit(EXIT_FAILURE);
+}
+
+void VirtualMachine::do_iter()
+{
+    auto value = *this->pop();
+    this->push(this->to_iterator(value));
+}
+
+void VirtualMachine::do_for_next()
+{
+    auto name = READ_VARIABLE();
+    auto to = READ_INT() - 1;
+    Value element;
+    if (!this->iterator_next(*(this->top_stack - 1), &element)) {
+        // Pop the iterator and exit the loop.
+        this->pop();
+        this->program_counter += to;
+        return;
+    }
+
+    // The loop variable is bound again on every iteration (elements may have diferent types).
+    this->top_frame->heap[name] = element;
+}
+
+void VirtualMachine::check_arguments(const std::string name, std::vector<Value> &arguments, size_t expected)
+{
+    if (arguments.size() != expected) {
+        logger->error("The function '" + name + "' expects " + std::to_string(expected) + " arguments.", this->get_current_line());
+        exit(EXIT_FAILURE);
+    }
+}
+
+Value VirtualMachine::native_iter(std::vector<Value> &arguments)
+{
+    this->check_arguments("iter", arguments, 1);
+
+    return this->to_iterator(arguments[0]);
+}
+
+Value VirtualMachine::native_map(std::vector<Value> &arguments)
+{
+    this->check_arguments("map", arguments, 2);
+
+    return Value(allocate<ValueIterator>(OBJECT_ITERATOR, ITERATOR_MAP, arguments[1], std::vector<Value>({ this->to_iterator(arguments[0]) })));
+}
+
+Value VirtualMachine::native_filter(std::vector<Value> &arguments)
+{
+    this->check_arguments("filter", arguments, 2);
+
+    return Value(allocate<ValueIterator>(OBJECT_ITERATOR, ITERATOR_FILTER, arguments[1], std::vector<Value>({ this->to_iterator(arguments[0]) })));
+}
+
+Value VirtualMachine::native_take(std::vector<Value> &arguments)
+{
+    this->check_arguments("take", arguments, 2);
+
+    return Value(allocate<ValueIterator>(OBJECT_ITERATOR, ITERATOR_TAKE, Value(), std::vector<Value>({ this->to_iterator(arguments[0]) }), arguments[1].cast(Type(VALUE_INT)).value_int));
+}
+
+Value VirtualMachine::native_zip(std::vector<Value> &arguments)
+{
+    this->check_arguments("zip", arguments, 2);
+
+    return Value(allocate<ValueIterator>(OBJECT_ITERATOR, ITERATOR_ZIP, Value(), std::vector<Value>({ this->to_iterator(arguments[0]), this->to_iterator(arguments[1]) })));
+}
+
+Value VirtualMachine::native_collect(std::vector<Value> &arguments)
+{
+    this->check_arguments("collect", arguments, 1);
+
+    auto iterator = this->to_iterator(arguments[0]);
+    std::vector<Value> list;
+    RootScope scope(&this->handles, { &iterator }, { &list });
+    for (Value element; this->iterator_next(iterator, &element);) list.push_back(element);
+
+    return Value(list);
+}
+
+Value VirtualMachine::native_flush(std::vector<Value> &arguments)
+{
+    this->check_arguments("flush", arguments, 0);
+    this->output.flush();
+
+    return Value();
+}
+
+Value VirtualMachine::native_heap_snapshot(std::vector<Value> &arguments)
+{
+    this->check_arguments("heap_snapshot", arguments, 1);
+
+    HeapSnapshot snapshot;
+    this->take_snapshot(&snapshot);
+    auto path = arguments[0].to_string();
+    if (!snapshot.write(path)) {
+        logger->error("Unable to write the heap snapshot to '" + path + "'", this->get_current_line());
+        exit(EXIT_FAILURE);
+    }
+    int64_t bytes = 0;
+    for (auto &object : snapshot.objects) bytes += object.bytes;
+
+    return Value(bytes);
+}
+
+void VirtualMachine::take_snapshot(HeapSnapshot *snapshot)
+{
+    auto roots = this->heap_roots();
+    snapshot->take(&this->program, this->heap.reachable(roots));
 }
 
 bool VirtualMachine::variable_declared(std::string name)
@@ -161,100 +790,409 @@ void VirtualMachine::store_variable(std::string name, Value *new_value, bool onl
     if (!only_store) this->push(this->top_frame->heap[name]);
 }
 
-Memory *VirtualMachine::get_current_memory()
-{
-    switch (*this->current_memory) {
-        case FUNCTIONS_MEMORY: { return &this->program.functions; }
-        case CLASSES_MEMORY: { return &this->program.classes; }
-        default: { return &this->program.program; }
-    }
-}
-
 uint32_t VirtualMachine::get_current_line()
 {
-    return this->get_current_memory()->lines[
-        static_cast<uint64_t>(this->program_counter - &this->get_current_memory()->code.front()) - 1
-    ];
+    // The program counter is already past the opcode (unless nothing has run yet).
+    auto index = static_cast<uint64_t>(this->program_counter - this->code);
+    return this->program.image.lines[index > 0 ? index - 1 : 0];
 }
 
-void VirtualMachine::run()
+void VirtualMachine::execute(Frame *until)
 {
-    this->program_counter = &this->program.program.code[0];
+    // The compiled code runs until it finishes or reaches an instruction without template.
+    if (this->aot && this->aot->execute(this, until)) return;
+    if (this->jit.ready() && this->jit.run(this, until)) return;
 
-    #if DEBUG
-        uint64_t times = 0;
-    #endif
+    // The profiled and counted loops are separate instantiations, so the regular one has no profiling code.
+    if (this->profiling) this->dispatch<true, true>(until);
+    else if (this->collecting_statistics) this->dispatch<false, true>(until);
+    else this->dispatch<false, false>(until);
+}
 
+template <bool profile, bool count>
+void VirtualMachine::dispatch(Frame *until)
+{
     for (uint64_t instruction;;) {
         instruction = READ_INSTRUCTION();
-        #if DEBUG
-            // printf("=> %s (%llu) [%llu]\n", opcode_to_string(instruction).c_str(), instruction, times++);
-        #endif
+        if (profile) this->profiler.step(instruction);
+        if (count) {
+            auto statistics = &this->statistics;
+            statistics->executed++;
+            if (static_cast<uint64_t>(this->top_stack - this->stack) > statistics->peak_stack) statistics->peak_stack = this->top_stack - this->stack;
+            if (static_cast<uint64_t>(this->top_frame - this->frames) >= statistics->peak_frames) statistics->peak_frames = this->top_frame - this->frames + 1;
+        }
         switch (instruction) {
             case OP_PUSH: { this->push(READ_CONSTANT()); break; }
             case OP_POP: { this->pop(); break; }
             case OP_MINUS: { this->push(-*this->pop()); break; }
             case OP_NOT: { this->push(!*this->pop()); break; }
-            case OP_ADD: { BINARY_POP(); this->push(*a + *b); break; }
-            case OP_SUB: { BINARY_POP(); this->push(*a - *b); break; }
-            case OP_MUL: { BINARY_POP(); this->push(*a * *b); break; }
+            case OP_ADD: { BINARY_POP(); QUICKEN_BINARY(OP_ADD_INT, OP_ADD_FLOAT); this->push(*a + *b); break; }
+            case OP_SUB: { BINARY_POP(); QUICKEN_BINARY(OP_SUB_INT, OP_SUB_FLOAT); this->push(*a - *b); break; }
+            case OP_MUL: { BINARY_POP(); QUICKEN_BINARY(OP_MUL_INT, OP_MUL_FLOAT); this->push(*a * *b); break; }
             case OP_DIV: { BINARY_POP(); this->push(*a / *b); break; }
-            case OP_EQ: { BINARY_POP(); this->push(*a == *b); break; }
-            case OP_NEQ: { BINARY_POP(); this->push(*a != *b); break; }
-            case OP_LT: { BINARY_POP(); this->push(*a < *b); break; }
-            case OP_LTE: { BINARY_POP(); this->push(*a <= *b); break; }
-            case OP_HT: { BINARY_POP(); this->push(*a > *b); break; }
-            case OP_HTE: { BINARY_POP(); this->push(*a >= *b); break; }
-            // case OP_JUMP: { this->program_counter = &this->get_current_memory()->code.front() + (READ_INT() - 1); break; }
-            case OP_RJUMP: { this->program_counter += READ_INT() - 1; break; }
+            case OP_EQ: { BINARY_POP(); QUICKEN_BINARY(OP_EQ_INT, OP_EQ_FLOAT); this->push(*a == *b); break; }
+            case OP_NEQ: { BINARY_POP(); QUICKEN_BINARY(OP_NEQ_INT, OP_NEQ_FLOAT); this->push(*a != *b); break; }
+            case OP_LT: { BINARY_POP(); QUICKEN_BINARY(OP_LT_INT, OP_LT_FLOAT); this->push(*a < *b); break; }
+            case OP_LTE: { BINARY_POP(); QUICKEN_BINARY(OP_LTE_INT, OP_LTE_FLOAT); this->push(*a <= *b); break; }
+            case OP_HT: { BINARY_POP(); QUICKEN_BINARY(OP_HT_INT, OP_HT_FLOAT); this->push(*a > *b); break; }
+            case OP_HTE: { BINARY_POP(); QUICKEN_BINARY(OP_HTE_INT, OP_HTE_FLOAT); this->push(*a >= *b); break; }
+            case OP_RJUMP: { auto to = READ_INT() - 1; this->program_counter += to; this->safepoint(); if (to < 0 && (this->tracing || this->osr || this->tiered) && this->back_edge(until)) return; break; }
             case OP_BRANCH_TRUE: { auto to = READ_INT() - 1; if (this->pop()->to_bool()) this->program_counter += to; break; }
             case OP_BRANCH_FALSE: { auto to = READ_INT() - 1; if (!this->pop()->to_bool()) this->program_counter += to; break; }
             case OP_DECLARE: { this->do_declare(); break; }
             case OP_STORE: { this->store_variable(READ_VARIABLE(), this->pop(), false); break; }
             case OP_ONLY_STORE: { this->store_variable(READ_VARIABLE(), this->pop(), true); break; }
-            // OP_STORE_ACCESS needs a re-write for dicts.
-            case OP_STORE_ACCESS: { BINARY_POP(); (*this->top_frame->heap[READ_VARIABLE()].value_list)[b->value_int] = a; break; }
+            case OP_STORE_ACCESS: { this->do_store_access(); break; }
             case OP_LOAD: { this->push(this->load_variable(READ_VARIABLE())); break; }
             case OP_LIST: { this->do_list(); break; }
             case OP_DICTIONARY: { this->do_dictionary(); break; }
             case OP_ACCESS: { this->do_access(); break; }
-            case OP_FUNCTION: { auto index = READ_INT(); auto return_type = READ_VARIABLE(); this->push(Value(index, return_type, new Frame(*this->top_frame))); break; }
-            case OP_RETURN: { this->do_return(); break; }
-            case OP_CALL: { this->do_call(); break; }
+            case OP_FUNCTION: { auto index = READ_INT(); auto return_type = READ_CONSTANT().type; auto generator = READ_CONSTANT().value_bool; this->do_function(index, return_type, generator); break; }
+            case OP_RETURN: { this->do_return(); if (this->top_frame == until) return; break; }
+            case OP_CALL: { this->safepoint(); this->do_call(); if (this->tiered && this->tier_up(until, true)) return; break; }
+            case OP_YIELD: { this->do_yield(); if (this->top_frame == until) return; break; }
+            case OP_ITER: { this->do_iter(); break; }
+            case OP_FOR_NEXT: { this->do_for_next(); break; }
+            case OP_CLASS: { this->do_class(); break; }
+            case OP_GET_SLOT: { this->do_slot(false); break; }
+            case OP_SET_SLOT: { this->do_slot(true); break; }
+            case OP_GET_FIELD: { this->do_field(false); break; }
+            case OP_SET_FIELD: { this->do_field(true); break; }
+            case OP_INVOKE: { this->safepoint(); this->do_invoke(); if (this->tiered && this->tier_up(until, true)) return; break; }
             case OP_LEN: { this->push(this->pop()->length()); break; }
-            case OP_PRINT: { this->pop()->println(); break; }
+            case OP_PRINT: { this->pop()->println(&this->output); break; }
             case OP_EXIT: { return; }
-            default: { logger->error("Unknown instruction at line", this->get_current_line()); exit(EXIT_FAILURE); break; }
+            case OP_ADD_INT: { QUICK_BINARY(OP_ADD, VALUE_INT, a->value_int + b->value_int, *a + *b); break; }
+            case OP_SUB_INT: { QUICK_BINARY(OP_SUB, VALUE_INT, a->value_int - b->value_int, *a - *b); break; }
+            case OP_MUL_INT: { QUICK_BINARY(OP_MUL, VALUE_INT, a->value_int * b->value_int, *a * *b); break; }
+            case OP_EQ_INT: { QUICK_BINARY(OP_EQ, VALUE_INT, a->value_int == b->value_int, *a == *b); break; }
+            case OP_NEQ_INT: { QUICK_BINARY(OP_NEQ, VALUE_INT, a->value_int != b->value_int, *a != *b); break; }
+            case OP_LT_INT: { QUICK_BINARY(OP_LT, VALUE_INT, a->value_int < b->value_int, *a < *b); break; }
+            case OP_LTE_INT: { QUICK_BINARY(OP_LTE, VALUE_INT, a->value_int <= b->value_int, *a <= *b); break; }
+            case OP_HT_INT: { QUICK_BINARY(OP_HT, VALUE_INT, a->value_int > b->value_int, *a > *b); break; }
+            case OP_HTE_INT: { QUICK_BINARY(OP_HTE, VALUE_INT, a->value_int >= b->value_int, *a >= *b); break; }
+            case OP_ADD_FLOAT: { QUICK_BINARY(OP_ADD, VALUE_FLOAT, a->value_float + b->value_float, *a + *b); break; }
+            case OP_SUB_FLOAT: { QUICK_BINARY(OP_SUB, VALUE_FLOAT, a->value_float - b->value_float, *a - *b); break; }
+            case OP_MUL_FLOAT: { QUICK_BINARY(OP_MUL, VALUE_FLOAT, a->value_float * b->value_float, *a * *b); break; }
+            case OP_EQ_FLOAT: { QUICK_BINARY(OP_EQ, VALUE_FLOAT, a->value_float == b->value_float, *a == *b); break; }
+            case OP_NEQ_FLOAT: { QUICK_BINARY(OP_NEQ, VALUE_FLOAT, a->value_float != b->value_float, *a != *b); break; }
+            case OP_LT_FLOAT: { QUICK_BINARY(OP_LT, VALUE_FLOAT, a->value_float < b->value_float, *a < *b); break; }
+            case OP_LTE_FLOAT: { QUICK_BINARY(OP_LTE, VALUE_FLOAT, a->value_float <= b->value_float, *a <= *b); break; }
+            case OP_HT_FLOAT: { QUICK_BINARY(OP_HT, VALUE_FLOAT, a->value_float > b->value_float, *a > *b); break; }
+            case OP_HTE_FLOAT: { QUICK_BINARY(OP_HTE, VALUE_FLOAT, a->value_float >= b->value_float, *a >= *b); break; }
+            case OP_CALL_FUNCTION: { this->safepoint(); this->do_call_function(); if (this->tiered && this->tier_up(until, true)) return; break; }
+            case OP_CALL_NATIVE: { this->safepoint(); this->do_call_native(); break; }
+            #if DEBUG
+                default: { logger->error("Unknown instruction at line", this->get_current_line()); exit(EXIT_FAILURE); break; }
+            #else
+                // The verifier rejects the unknown opcodes.
+                default: { __builtin_unreachable(); }
+            #endif
         }
     }
 }
 
+bool VirtualMachine::back_edge(Frame *until)
+{
+    if (this->tracing) this->tracer.loop(this);
+    if (this->tiered) return this->tier_up(until, false);
+    if (!this->osr) return false;
+
+    if (!this->jit.ready()) {
+        if (++this->back_edges < OSR_HOT_LOOP) return false;
+        if (!this->jit.compile(this, &this->program)) {
+            this->osr = false;
+            return false;
+        }
+    }
+
+    // The compiled code works on the same stack and frames, so it continues from the current
+    // program counter with the live state (a trace side exit may have left it inside the loop).
+    this->osr_entries++;
+
+    return this->jit.run(this, until);
+}
+
+bool VirtualMachine::tier_up(Frame *until, bool call)
+{
+    auto index = static_cast<uint64_t>(this->program_counter - this->code);
+    if (call) this->tiering.call(index);
+    else this->tiering.loop(index);
+
+    // The new code has every function compiled before, so it replaces the old one.
+    this->tiering.install(&this->jit);
+    if (!this->jit.covers(index)) return false;
+
+    this->tier_entries++;
+
+    return this->jit.run(this, until);
+}
+
+void VirtualMachine::run()
+{
+    this->code = this->program.image.code.data();
+    this->constants = this->program.image.constants.data();
+    this->program_counter = this->code;
+    this->ensure_stack(this->program.max_stack);
+
+    // The objects remember the line of the instruction that allocated them.
+    AllocationSite site = { &this->program_counter, this->code, this->program.image.code.size(), this->program.image.lines.data() };
+    AllocationSiteScope site_scope(&site);
+    this->execute(nullptr);
+}
+
 void VirtualMachine::interpret(const char *source)
 {
+    // The constants are allocated in the old generation and the values
+    // created while running in the nursery.
+    HeapScope scope(&this->heap);
+
     auto compiler = new Compiler;
     this->program = compiler->compile(source);
+    this->statistics = PipelineStatistics();
+    this->statistics.tokens = compiler->tokens;
+    this->statistics.nodes = compiler->nodes;
+    this->statistics.scanning_time = compiler->scanning_time;
+    this->statistics.parsing_time = compiler->parsing_time;
+    this->statistics.optimizing_time = compiler->optimizing_time;
+    this->statistics.compiling_time = compiler->compiling_time;
     delete compiler;
 
-    logger->info("Started interpreting...");
+    this->interpret();
+}
+
+void VirtualMachine::interpret(const AotProgram *program)
+{
+    // The constants are allocated in the old generation like the compiler does.
+    HeapScope scope(&this->heap);
+
+    this->aot = program;
+    this->program = Program();
+    program->load(&this->program);
+    this->statistics = PipelineStatistics();
+
+    this->interpret();
+}
+
+void VirtualMachine::interpret()
+{
+    // The dispatch loop trusts the bytecode, so it's verified once before running it.
+    auto verifying = std::chrono::steady_clock::now();
+    Verifier(&this->program).verify();
+    this->statistics.verifying_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - verifying).count();
+
+    if (this->aot && (this->aot->size != this->program.image.code.size() || this->aot->checksum != Aot::checksum(&this->program.image))) {
+        logger->error("The compiled code was generated from a different program");
+        exit(EXIT_FAILURE);
+    }
+
+    if (this->tracing) this->tracer.reset(this->program.image.code.size());
+    if (this->tiered) this->tiering.reset(this, &this->program);
 
-    if (this->program.program.code.size() > 0) this->run();
+    // The code of the previous program is useless, on-stack replacement compiles it again once it's hot.
+    this->jit.release();
+    this->back_edges = this->tier_entries = 0;
 
-    logger->success("Finished interpreting");
+    if (this->jit_enabled) {
+        if (!this->jit.compile(this, &this->program)) LOG_WARNING("The JIT is not supported on this platform, using the interpreter");
+        else LOG_INFO("JIT: " + std::to_string(this->jit.translated) + " instructions translated, " + std::to_string(this->jit.untranslated) + " left to the interpreter");
+    }
+
+    if (this->profiling) this->profiler.reset();
+    if (this->profiling_calls) this->call_profiler.reset(&this->program);
+    auto heap_statistics = this->heap.statistics;
+    auto nursery_bytes = this->heap.nursery_used();
+    uint64_t allocations = 0;
+    for (uint8_t kind = 0; kind < OBJECT_KINDS; kind++) allocations += pool_statistics(static_cast<ObjectKind>(kind)).allocations;
+    auto sampling = !this->sample_output.empty() && this->sampler.start(this);
+    if (!this->sample_output.empty() && !sampling) LOG_WARNING("The sampling profiler is not supported on this platform");
+
+    LOG_INFO("Started interpreting...");
+
+    auto start = std::chrono::steady_clock::now();
+    if (this->program.image.code.size() > 0) {
+        RegionScope nursery(&this->heap.nursery);
+        this->run();
+    }
+    std::chrono::duration<double> run_time = std::chrono::steady_clock::now() - start;
+    if (sampling) this->sampler.stop();
+    this->output.flush();
+
+    LOG_SUCCESS("Finished interpreting");
+
+    if (sampling) {
+        if (!this->sampler.write_folded(&this->program, this->sample_output)) {
+            LOG_WARNING("Unable to write the sampled stacks to '" + this->sample_output + "'");
+        } else {
+            LOG_INFO(
+                "Sampler: " + std::to_string(this->sampler.samples) + " samples written to " + this->sample_output
+                + (this->sampler.dropped > 0 ? " (" + std::to_string(this->sampler.dropped) + " dropped)" : "")
+            );
+        }
+    }
+
+    if (!this->snapshot_output.empty()) {
+        HeapSnapshot snapshot;
+        this->take_snapshot(&snapshot);
+        snapshot.report();
+        if (!snapshot.write(this->snapshot_output)) LOG_WARNING("Unable to write the heap snapshot to '" + this->snapshot_output + "'");
+    }
+
+    if (this->profiling) {
+        this->profiler.finish();
+        this->profiler.report();
+        if (!this->profile_output.empty() && !this->profiler.write_json(this->profile_output)) {
+            LOG_WARNING("Unable to write the opcode profile to '" + this->profile_output + "'");
+        }
+    }
+
+    if (this->profiling_calls) {
+        this->call_profiler.finish();
+        this->call_profiler.report(&this->program);
+    }
+
+    if (this->collecting_statistics) {
+        auto statistics = &this->statistics;
+        auto image = &this->program.image;
+        statistics->running_time = run_time.count();
+        for (uint64_t i = 0; i < image->code.size(); i += 1 + opcode_constants(image->code[i]) + opcode_cache(image->code[i])) statistics->instructions++;
+        statistics->code_words = image->code.size();
+        statistics->constants = image->constants.size();
+        statistics->functions = this->program.function_table.size();
+        for (uint8_t kind = 0; kind < OBJECT_KINDS; kind++) statistics->allocations += pool_statistics(static_cast<ObjectKind>(kind)).allocations;
+        statistics->allocations -= allocations;
+        statistics->allocated_bytes = this->heap.statistics.nursery_bytes + this->heap.nursery_used() - heap_statistics.nursery_bytes - nursery_bytes;
+        statistics->minor_collections = this->heap.statistics.minor_collections - heap_statistics.minor_collections;
+        statistics->major_collections = this->heap.statistics.major_collections - heap_statistics.major_collections;
+        if (this->statistics_output.empty()) statistics->report();
+        else if (!statistics->write_json(this->statistics_output)) LOG_WARNING("Unable to write the statistics to '" + this->statistics_output + "'");
+    }
 
     #if DEBUG
         if (this->top_stack - this->stack == 0) {
-            logger->success("No memory leak detected");
+            LOG_SUCCESS("No memory leak detected");
         } else {
-            logger->warning("Memory leak detected!");
-            for (auto i = this->stack; i < this->top_stack; i++) i->println();
+            LOG_WARNING("Memory leak detected!");
+            for (auto i = this->stack; i < this->top_stack; i++) i->println(&this->output);
         }
     #endif
 
+    if (this->reporting_runtime) this->report_runtime(run_time.count());
+}
+
+HeapRoots VirtualMachine::heap_roots()
+{
+    return { this->stack, this->top_stack, this->frames, this->top_frame, { &this->program.image }, &this->handles };
+}
+
+void VirtualMachine::safepoint()
+{
+    // The values native code holds across nested main loops are in the handles.
+    if (!this->heap.pending()) return;
+
+    auto roots = this->heap_roots();
+    this->heap.collect(roots);
+}
+
+void VirtualMachine::set_heap_limits(uint64_t nursery_size, uint64_t heap_limit)
+{
+    if (nursery_size > 0) this->heap.nursery_size = nursery_size;
+    this->heap.heap_limit = heap_limit;
+}
+
+void VirtualMachine::set_mark_threads(uint64_t threads)
+{
+    if (threads > 0) this->heap.mark_threads = threads > GC_MAX_MARK_THREADS ? GC_MAX_MARK_THREADS : threads;
+}
+
+void VirtualMachine::set_jit(bool enabled)
+{
+    this->jit_enabled = enabled;
+}
+
+void VirtualMachine::set_tracing(bool enabled)
+{
+    this->tracing = enabled;
+}
+
+void VirtualMachine::set_osr(bool enabled)
+{
+    this->osr = enabled;
+}
+
+void VirtualMachine::set_tiering(bool enabled)
+{
+    this->tiered = enabled;
+}
+
+void VirtualMachine::set_profiling(bool enabled, const std::string &output)
+{
+    this->profiling = enabled;
+    this->profile_output = output;
+}
+
+void VirtualMachine::set_call_profiling(bool enabled)
+{
+    this->profiling_calls = enabled;
+}
+
+void VirtualMachine::set_statistics(bool enabled, const std::string &output)
+{
+    this->collecting_statistics = enabled;
+    this->statistics_output = output;
+}
+
+void VirtualMachine::set_runtime_statistics(bool enabled)
+{
+    this->reporting_runtime = enabled;
+}
+
+void VirtualMachine::set_sampling(const std::string &output)
+{
+    this->sample_output = output;
+}
+
+void VirtualMachine::set_line_buffered(bool enabled)
+{
+    this->output.line_buffered = enabled;
+}
+
+void VirtualMachine::set_heap_snapshot(const std::string &output)
+{
+    this->snapshot_output = output;
+}
+
+void VirtualMachine::emit_cpp(const char *source, const std::string &name, const std::string &output)
+{
+    HeapScope scope(&this->heap);
+
+    auto compiler = new Compiler;
+    this->program = compiler->compile(source);
+    delete compiler;
+
+    // The generated code trusts the bytecode like the dispatch loop does.
+    Verifier(&this->program).verify();
+
+    auto file_stream = std::ofstream(output);
+    if (!file_stream.is_open()) {
+        logger->error("Unable to write the file '" + output + "'");
+        exit(EXIT_FAILURE);
+    }
+    file_stream << Aot(&this->program).translate(name);
+
+    LOG_SUCCESS("Translated to " + output);
 }
 
 void VirtualMachine::reset()
 {
+    // The compiler thread may still be reading the program.
+    this->tiering.cancel();
     this->program.reset();
+
+    // Only the global variables survive, everything else created by the run is collected.
+    HeapScope scope(&this->heap);
+    auto roots = this->heap_roots();
+    this->heap.collect_full(roots);
 }
 
 #undef BINARY_POP